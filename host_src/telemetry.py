@@ -0,0 +1,271 @@
+"""
+Telemetry decoder for the Teensy ambisonic microphone array.
+
+The master and slave sketches send binary status frames over USB serial
+(teensy_src/audio_telemetry.h has the format): audio levels, CPU and memory,
+ISR profiles, link counters, which slave channels are dead and how the USB
+transmit queue holds up. This module decodes them, passes through
+any text lines printed between frames, and can poll several arrays at once.
+
+    python telemetry.py /dev/ttyACM0 [/dev/ttyACM1 ...]
+    python telemetry.py --file capture.bin
+    python telemetry.py --check capture.bin    (exit non-zero on a bad stream)
+"""
+
+import argparse
+import struct
+import sys
+import time
+from typing import Any, Dict, List, Optional
+
+SYNC = b"\xa5\x5a"
+HEADER = 6
+OVERHEAD = HEADER + 2
+
+SYSTEM = 1
+LEVELS = 2
+PROFILE = 3
+LINK = 4
+PASSTHROUGH = 5
+LIVENESS = 6
+USB = 7
+
+PROFILE_NAMES = {
+    0: "update_all",
+    1: "tdm rx",
+    2: "usb tx",
+    3: "usb rx",
+    4: "tdm isr",
+    5: "i2s rx",
+}
+
+# Fixed part of each record: struct format and field names. Records only grow
+# at the end, so longer payloads are decoded as far as these go.
+RECORDS = {
+    SYSTEM: ("<IHHHHI", ("millis", "cpu", "cpu_max", "memory", "memory_max", "dropped")),
+    LEVELS: ("<IIBB", ("window", "samples", "first", "count")),
+    PROFILE: ("<B3xIIII", ("id", "count", "min", "mean", "max")),
+    LINK: ("<BxHHHhxxIIII", ("synced", "underruns", "overruns", "latency", "phase",
+                             "sequence", "lost", "resets", "errors")),
+    PASSTHROUGH: ("<I", ("slips",)),
+    LIVENESS: ("<BBxxIII", ("first", "count", "dead", "dropouts", "recoveries")),
+    USB: ("<HHHHiI", ("fill", "fill_min", "fill_max", "target", "correction", "underruns")),
+}
+# Fields added since, each decoded only if the payload reaches that far.
+EXTENSIONS = {
+    SYSTEM: [("<H", ("memory_reserved",))],
+    USB: [("<I", ("overruns",))],
+}
+LEVEL = struct.Struct("<HHH")
+
+
+def crc16_ccitt(data: bytes, crc: int = 0xFFFF) -> int:
+    """CRC-16/CCITT, polynomial 0x1021, as telemetry_crc16()."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def decode_record(rtype: int, payload: bytes) -> Optional[Dict[str, Any]]:
+    """Decode one record payload into a dict, or None for unknown types."""
+    if rtype not in RECORDS:
+        return None
+    fmt, names = RECORDS[rtype]
+    size = struct.calcsize(fmt)
+    if len(payload) < size:
+        return None
+    record = dict(zip(names, struct.unpack_from(fmt, payload)))
+    offset = size
+    for fmt, names in EXTENSIONS.get(rtype, []):
+        if offset + struct.calcsize(fmt) > len(payload):
+            break
+        record.update(zip(names, struct.unpack_from(fmt, payload, offset)))
+        offset += struct.calcsize(fmt)
+    if rtype == SYSTEM:
+        record["cpu"] /= 100.0
+        record["cpu_max"] /= 100.0
+    elif rtype == LEVELS:
+        levels = []
+        for i in range(record["count"]):
+            offset = size + i * LEVEL.size
+            if offset + LEVEL.size > len(payload):
+                break
+            peak, rms, clips = LEVEL.unpack_from(payload, offset)
+            levels.append({"channel": record["first"] + i, "peak": peak / 32767.0,
+                           "rms": rms / 32767.0, "clips": clips})
+        record["levels"] = levels
+    elif rtype == PROFILE:
+        record["name"] = PROFILE_NAMES.get(record["id"], f"profile {record['id']}")
+    elif rtype == LIVENESS:
+        # channel numbers to leave out of anything computed on the array
+        record["dead_channels"] = [record["first"] + i for i in range(record["count"])
+                                   if record["dead"] & (1 << i)]
+    return record
+
+
+class TelemetryDecoder:
+    """Incremental decoder for one serial stream.
+
+    feed() takes whatever bytes arrived and returns the decoded items:
+    ("record", board, type, dict) for frames and ("text", line) for text
+    printed between them. Frames with a bad CRC are skipped by resyncing on
+    the next sync bytes; sequence gaps count frames lost on the way.
+    """
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.text = bytearray()
+        self.frames = 0
+        self.crc_errors = 0
+        self.lost = 0
+        self.sequence: Dict[int, int] = {}
+
+    def feed(self, data: bytes) -> List[tuple]:
+        self.buffer.extend(data)
+        items = []
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                # keep a trailing first sync byte, the rest is text
+                keep = 1 if self.buffer.endswith(SYNC[:1]) else 0
+                self._text(self.buffer[:len(self.buffer) - keep], items)
+                del self.buffer[:len(self.buffer) - keep]
+                return items
+            self._text(self.buffer[:start], items)
+            del self.buffer[:start]
+            if len(self.buffer) < HEADER:
+                return items
+            length = self.buffer[3]
+            if len(self.buffer) < OVERHEAD + length:
+                return items
+            frame = bytes(self.buffer[:OVERHEAD + length])
+            crc = frame[HEADER + length] | (frame[HEADER + length + 1] << 8)
+            if crc != crc16_ccitt(frame[2:HEADER + length]):
+                # not a frame after all, or a damaged one: resync past it
+                self.crc_errors += 1
+                self._text(self.buffer[:1], items)
+                del self.buffer[:1]
+                continue
+            del self.buffer[:OVERHEAD + length]
+            rtype, board, seq = frame[2], frame[4], frame[5]
+            if board in self.sequence:
+                self.lost += (seq - self.sequence[board] - 1) & 0xFF
+            self.sequence[board] = seq
+            self.frames += 1
+            record = decode_record(rtype, frame[HEADER:HEADER + length])
+            if record is not None:
+                items.append(("record", board, rtype, record))
+
+    def _text(self, data: bytes, items: List[tuple]):
+        self.text.extend(data)
+        while b"\n" in self.text:
+            line, _, rest = bytes(self.text).partition(b"\n")
+            self.text = bytearray(rest)
+            line = line.rstrip(b"\r").decode("ascii", "replace")
+            if line:
+                items.append(("text", line))
+
+
+def format_record(board: int, rtype: int, r: Dict[str, Any]) -> str:
+    """One line for a decoded record."""
+    tag = f"[{board}]"
+    if rtype == SYSTEM:
+        reserved = f" of {r['memory_reserved']}" if "memory_reserved" in r else ""
+        return (f"{tag} t={r['millis'] / 1000.0:.1f}s  CPU {r['cpu']:.2f}% (max {r['cpu_max']:.2f}%)"
+                f"  blocks {r['memory']}/{r['memory_max']}{reserved}  telemetry dropped {r['dropped']}")
+    if rtype == LEVELS:
+        chans = "  ".join(f"ch{l['channel']} {l['peak']:.2f}/{l['rms']:.3f}"
+                          + (f" CLIP {l['clips']}" if l["clips"] else "")
+                          for l in r["levels"])
+        return f"{tag} levels #{r['window']} (peak/rms): {chans}"
+    if rtype == PROFILE:
+        return (f"{tag} {r['name']:<12} n={r['count']}  min {r['min']}  mean {r['mean']}"
+                f"  max {r['max']} cycles")
+    if rtype == LINK:
+        return (f"{tag} slave link {'synced' if r['synced'] else 'NO SYNC'}  seq {r['sequence']}"
+                f"  lost {r['lost']}  resets {r['resets']}  errors {r['errors']}"
+                f"  slave under/overruns {r['underruns']}/{r['overruns']}"
+                f"  latency {r['latency']}+{r['phase']} samples")
+    if rtype == PASSTHROUGH:
+        return f"{tag} pass-through slips {r['slips']}"
+    if rtype == LIVENESS:
+        dead = " ".join(f"ch{c}" for c in r["dead_channels"]) or "none"
+        return (f"{tag} channels {r['first']}-{r['first'] + r['count'] - 1} dead: {dead}"
+                f"  dropouts {r['dropouts']}  recoveries {r['recoveries']}")
+    if rtype == USB:
+        overruns = f"  overruns {r['overruns']}" if "overruns" in r else ""
+        return (f"{tag} usb out queue {r['fill']} ({r['fill_min']}-{r['fill_max']}) samples,"
+                f" target {r['target']}  clock {r['correction']:+d} ppm  underruns {r['underruns']}"
+                f"{overruns}")
+    return f"{tag} record type {rtype}"
+
+
+def print_items(items: List[tuple], port: str = ""):
+    prefix = f"{port} " if port else ""
+    for item in items:
+        if item[0] == "text":
+            print(f"{prefix}| {item[1]}")
+        else:
+            print(prefix + format_record(item[1], item[2], item[3]))
+
+
+def decode_file(path: str, check: bool) -> int:
+    """Decode a capture; with check, fail on CRC errors, gaps or no frames."""
+    decoder = TelemetryDecoder()
+    with open(path, "rb") as f:
+        items = decoder.feed(f.read())
+    if not check:
+        print_items(items)
+    print(f"{path}: {decoder.frames} frames, {decoder.crc_errors} CRC errors, "
+          f"{decoder.lost} lost")
+    if check and (decoder.frames == 0 or decoder.crc_errors or decoder.lost):
+        print("FAIL")
+        return 1
+    return 0
+
+
+def poll_ports(ports: List[str], baudrate: int) -> int:
+    """Read every port without blocking and print what each one sends."""
+    import serial
+
+    streams = [(name, serial.Serial(name, baudrate, timeout=0), TelemetryDecoder())
+               for name in ports]
+    try:
+        while True:
+            idle = True
+            for name, port, decoder in streams:
+                data = port.read(4096)
+                if data:
+                    idle = False
+                    print_items(decoder.feed(data), name if len(streams) > 1 else "")
+            if idle:
+                time.sleep(0.01)
+    except KeyboardInterrupt:
+        for name, _, decoder in streams:
+            print(f"{name}: {decoder.frames} frames, {decoder.crc_errors} CRC errors, "
+                  f"{decoder.lost} lost")
+    return 0
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Decode Teensy array telemetry")
+    parser.add_argument("ports", nargs="*", help="serial ports to poll")
+    parser.add_argument("--file", help="decode a captured byte stream")
+    parser.add_argument("--check", metavar="FILE", help="verify a capture, exit 1 on errors")
+    parser.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    if args.check:
+        return decode_file(args.check, True)
+    if args.file:
+        return decode_file(args.file, False)
+    if not args.ports:
+        parser.error("give one or more serial ports, --file or --check")
+    return poll_ports(args.ports, args.baud)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,152 @@
+/* Peak, RMS and clip metering of N channels in one object
+ */
+
+#include <Arduino.h>
+#include "AudioAnalyzeMeter.h"
+
+#if defined(__ARM_ARCH_7EM__)
+#define METER_DSP 1
+#else
+#define METER_DSP 0
+#endif
+
+static_assert((AUDIO_BLOCK_SAMPLES % 4) == 0, "the meter reads blocks two words at a time");
+
+// sum + a.lo*a.lo + a.hi*a.hi
+static inline uint64_t meter_square_add(uint64_t sum, uint32_t a) __attribute__((always_inline, unused));
+static inline uint64_t meter_square_add(uint64_t sum, uint32_t a)
+{
+#if METER_DSP
+	asm ("smlald %Q0, %R0, %1, %1" : "+r" (sum) : "r" (a));
+	return sum;
+#else
+	int32_t lo = (int16_t)a, hi = (int16_t)(a >> 16);
+	return sum + (uint64_t)(lo * lo) + (uint64_t)(hi * hi);
+#endif
+}
+
+// per halfword max(a, b) and min(a, b), signed
+static inline uint32_t meter_max16(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline uint32_t meter_max16(uint32_t a, uint32_t b)
+{
+#if METER_DSP
+	uint32_t out;
+	asm ("ssub16 %0, %1, %2\n\tsel %0, %1, %2" : "=&r" (out) : "r" (a), "r" (b) : "cc");
+	return out;
+#else
+	int16_t lo = (int16_t)a > (int16_t)b ? a : b;
+	int16_t hi = (int16_t)(a >> 16) > (int16_t)(b >> 16) ? a >> 16 : b >> 16;
+	return ((uint32_t)(uint16_t)hi << 16) | (uint16_t)lo;
+#endif
+}
+
+static inline uint32_t meter_min16(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline uint32_t meter_min16(uint32_t a, uint32_t b)
+{
+#if METER_DSP
+	uint32_t out;
+	asm ("ssub16 %0, %1, %2\n\tsel %0, %2, %1" : "=&r" (out) : "r" (a), "r" (b) : "cc");
+	return out;
+#else
+	int16_t lo = (int16_t)a < (int16_t)b ? a : b;
+	int16_t hi = (int16_t)(a >> 16) < (int16_t)(b >> 16) ? a >> 16 : b >> 16;
+	return ((uint32_t)(uint16_t)hi << 16) | (uint16_t)lo;
+#endif
+}
+
+static inline int16_t meter_high(uint32_t a) { return (int16_t)(a >> 16); }
+static inline int16_t meter_low(uint32_t a) { return (int16_t)a; }
+
+template <unsigned int Channels>
+void AudioAnalyzeMeterT<Channels>::update(void)
+{
+	for (unsigned int ch=0; ch < Channels; ch++) {
+		audio_block_t *block = receiveReadOnly(ch);
+		if (!block) continue;
+		const uint32_t *p = (const uint32_t *)block->data;
+		const uint32_t *end = p + AUDIO_BLOCK_SAMPLES/2;
+		uint64_t sum = acc[ch].sum_squares;
+		uint32_t max = *p, min = *p;
+		// two words per pass: the loads of one pair issue alongside the
+		// arithmetic of the other
+		do {
+			uint32_t a = *p++;
+			uint32_t b = *p++;
+			sum = meter_square_add(sum, a);
+			max = meter_max16(a, max);
+			min = meter_min16(a, min);
+			sum = meter_square_add(sum, b);
+			max = meter_max16(b, max);
+			min = meter_min16(b, min);
+		} while (p < end);
+		acc[ch].sum_squares = sum;
+		int16_t hi = meter_high(max) > meter_low(max) ? meter_high(max) : meter_low(max);
+		int16_t lo = meter_high(min) < meter_low(min) ? meter_high(min) : meter_low(min);
+		if (hi > acc_max[ch]) acc_max[ch] = hi;
+		if (lo < acc_min[ch]) acc_min[ch] = lo;
+		if (hi >= AUDIO_METER_CLIP || lo <= -AUDIO_METER_CLIP) {
+			uint32_t clips = 0;
+			for (unsigned int i=0; i < AUDIO_BLOCK_SAMPLES; i++) {
+				int16_t s = block->data[i];
+				if (s >= AUDIO_METER_CLIP || s <= -AUDIO_METER_CLIP) clips++;
+			}
+			acc[ch].clips += clips;
+		}
+		release(block);
+	}
+	if (++blocks >= window_blocks) publish();
+}
+
+template <unsigned int Channels>
+void AudioAnalyzeMeterT<Channels>::clear(void)
+{
+	for (unsigned int ch=0; ch < Channels; ch++) {
+		acc[ch].peak = 0;
+		acc[ch].clips = 0;
+		acc[ch].sum_squares = 0;
+		acc_max[ch] = 0;
+		acc_min[ch] = 0;
+	}
+	blocks = 0;
+}
+
+template <unsigned int Channels>
+void AudioAnalyzeMeterT<Channels>::publish(void)
+{
+	uint32_t n = published + 1;
+	snapshot_t &s = snapshot[n & 1];
+
+	s.sequence = n;
+	s.samples = blocks * AUDIO_BLOCK_SAMPLES;
+	for (unsigned int ch=0; ch < Channels; ch++) {
+		int32_t hi = acc_max[ch], lo = -(int32_t)acc_min[ch];
+		s.channel[ch].peak = hi > lo ? hi : lo;
+		s.channel[ch].clips = acc[ch].clips;
+		s.channel[ch].sum_squares = acc[ch].sum_squares;
+	}
+	// the snapshot is complete before it is announced
+	asm volatile ("" ::: "memory");
+	published = n;
+	clear();
+}
+
+template <unsigned int Channels>
+bool AudioAnalyzeMeterT<Channels>::read(snapshot_t &out)
+{
+	uint32_t n;
+
+	do {
+		n = published;
+		asm volatile ("" ::: "memory");
+		out = snapshot[n & 1];
+		asm volatile ("" ::: "memory");
+		// window n + 2 overwrites snapshot[n & 1], and is written while
+		// published is n + 1
+	} while (n != published);
+	consumed = n;
+	return n != 0;
+}
+
+template class AudioAnalyzeMeterT<4>;
+template class AudioAnalyzeMeterT<8>;
+template class AudioAnalyzeMeterT<16>;
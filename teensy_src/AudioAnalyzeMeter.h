@@ -0,0 +1,95 @@
+/* Peak, RMS and clip metering of N channels in one object
+ *
+ * One update() walks the blocks of all inputs, a pair of samples per word:
+ * on Cortex-M7 the squares go through SMLALD into a 64-bit sum, and the
+ * running maximum and minimum through SSUB16/SEL, so a block costs about
+ * two instructions per sample pair.  Clipped samples (|x| >= 32767) are
+ * only counted in blocks whose extremes reach full scale.
+ *
+ * Readings are collected over a window of blocks (window()) and then
+ * published to one of two snapshots, alternately.  read() copies the
+ * latest complete window from loop() without masking interrupts: it
+ * retries if the audio interrupt published again while it was copying,
+ * which can only happen if the copy takes longer than a window.
+ *
+ * A missing input block is silence: it adds samples but no energy.
+ */
+
+#ifndef AudioAnalyzeMeter_h_
+#define AudioAnalyzeMeter_h_
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <math.h>
+
+#define AUDIO_METER_CLIP	32767
+
+struct audio_meter_channel_t {
+	uint32_t peak;			// largest |sample|, 0-32768
+	uint32_t clips;			// samples at or beyond +-AUDIO_METER_CLIP
+	uint64_t sum_squares;
+};
+
+template <unsigned int Channels>
+struct audio_meter_snapshot_t {
+	uint32_t sequence;		// windows published, 0 before the first
+	uint32_t samples;		// per channel in this window
+	audio_meter_channel_t channel[Channels];
+
+	// full scale is 1.0, as AudioAnalyzePeak and AudioAnalyzeRMS
+	float peak(unsigned int ch) const {
+		return channel[ch].peak / 32767.0f;
+	}
+	float rms(unsigned int ch) const {
+		if (!samples) return 0.0f;
+		return sqrtf((float)channel[ch].sum_squares / samples) / 32767.0f;
+	}
+	uint32_t clips(unsigned int ch) const { return channel[ch].clips; }
+};
+
+template <unsigned int Channels>
+class AudioAnalyzeMeterT : public AudioStream
+{
+	static_assert(Channels >= 1 && Channels <= 16, "one meter takes 1 to 16 inputs");
+public:
+	typedef audio_meter_snapshot_t<Channels> snapshot_t;
+
+	AudioAnalyzeMeterT(unsigned int blocks = 1) : AudioStream(Channels, inputQueueArray) {
+		window(blocks);
+		clear();
+		published = 0;
+		consumed = 0;
+		for (unsigned int b=0; b < 2; b++) snapshot[b] = snapshot_t();
+	}
+	virtual void update(void);
+	// blocks per published window, from the next window
+	void window(unsigned int blocks) { window_blocks = blocks ? blocks : 1; }
+	unsigned int window(void) { return window_blocks; }
+	// a window was published since the last read()
+	bool available(void) { return published != consumed; }
+	// the latest complete window; false before the first one
+	bool read(snapshot_t &out);
+private:
+	void clear(void);
+	void publish(void);
+	audio_block_t *inputQueueArray[Channels];
+	// the window being collected, audio interrupt only
+	audio_meter_channel_t acc[Channels];
+	int16_t acc_max[Channels];
+	int16_t acc_min[Channels];
+	unsigned int blocks;
+	volatile unsigned int window_blocks;
+	// snapshot[n & 1] holds window n, so the one being written is never
+	// the latest
+	snapshot_t snapshot[2];
+	volatile uint32_t published;
+	uint32_t consumed;
+};
+
+extern template class AudioAnalyzeMeterT<4>;
+extern template class AudioAnalyzeMeterT<8>;
+extern template class AudioAnalyzeMeterT<16>;
+
+typedef AudioAnalyzeMeterT<8> AudioAnalyzeMeter8;
+
+#endif
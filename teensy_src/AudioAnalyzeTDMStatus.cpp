@@ -0,0 +1,19 @@
+/* Master-side check of the slave's in-band TDM status packet
+ */
+
+#include <Arduino.h>
+#include "AudioAnalyzeTDMStatus.h"
+
+void AudioAnalyzeTDMStatus::update(void)
+{
+	audio_block_t *block;
+
+	block = receiveReadOnly(0);
+	if (!block) {
+		// nothing from AudioInputTDM counts as a block without a packet
+		status.parse(nullptr, 0);
+		return;
+	}
+	status.parse(block->data, AUDIO_BLOCK_SAMPLES);
+	release(block);
+}
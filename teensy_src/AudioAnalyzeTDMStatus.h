@@ -0,0 +1,43 @@
+/* Master-side check of the slave's in-band TDM status packet
+ *
+ * Connect the AudioInputTDM channel carrying the slave's status slot (see
+ * AudioOutputTDM_SlaveT::statusSlot) to input 0.  Every block is run
+ * through TDMStatusParser; the readings below are updated from the audio
+ * interrupt and may be polled from loop().
+ */
+
+#ifndef AudioAnalyzeTDMStatus_h_
+#define AudioAnalyzeTDMStatus_h_
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "tdm_status.h"
+
+class AudioAnalyzeTDMStatus : public AudioStream
+{
+public:
+	AudioAnalyzeTDMStatus(void) : AudioStream(1, inputQueueArray) { }
+	virtual void update(void);
+	// a valid packet arrived within the last block
+	bool synced(void) { return status.synced; }
+	uint32_t sequence(void) { return status.sequence; }
+	// blocks the slave sent that never arrived, and slave restarts
+	uint32_t lostBlocks(void) { return status.lost; }
+	uint32_t resets(void) { return status.resets; }
+	// corrupt packets, plus losses of sync (slot slip or silent slave)
+	uint32_t errors(void) { return status.errors; }
+	// samples from the slave's update() to its wire, and the offset of the
+	// packet within the block it arrived in here (negative if it started
+	// in the previous block); together they place the slave's blocks on
+	// the master's timeline
+	uint16_t slaveLatency(void) { return status.latency; }
+	int phase(void) { return status.phase; }
+	uint16_t slaveUnderruns(void) { return status.underruns; }
+	uint16_t slaveOverruns(void) { return status.overruns; }
+	void reset(void) { __disable_irq(); status.reset(); __enable_irq(); }
+private:
+	audio_block_t *inputQueueArray[1];
+	TDMStatusParser status;
+};
+
+#endif
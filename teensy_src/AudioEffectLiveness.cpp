@@ -0,0 +1,80 @@
+/* Liveness check of the slave's channels on the master
+ */
+
+#include <Arduino.h>
+#include "AudioEffectLiveness.h"
+
+// One pass over the block, a word at a time: true if every sample equals
+// the first, and a hash of the block for the repeat check.
+static bool liveness_scan(const int16_t *data, uint32_t *hash)
+{
+	const uint32_t *p = (const uint32_t *)data;
+	const uint32_t *end = p + AUDIO_BLOCK_SAMPLES/2;
+	uint32_t first = (uint16_t)data[0] * 0x00010001u;
+	uint32_t diff = 0, h = 0x811C9DC5u;
+
+	do {
+		uint32_t w = *p++;
+		diff |= w ^ first;
+		h = ((h << 5) | (h >> 27)) ^ w;
+		h *= 0x01000193u;
+	} while (p < end);
+	*hash = h;
+	return diff == 0;
+}
+
+template <unsigned int Channels>
+void AudioEffectLivenessT<Channels>::update(void)
+{
+	audio_block_t *block[Channels];
+	audio_block_t *marker_block = NULL;
+	bool unsynced = status && !status->synced();
+	uint32_t dead = dead_mask;
+	unsigned int ch, k;
+
+	for (ch=0; ch < Channels; ch++) {
+		block[ch] = receiveReadOnly(ch);
+		// no block, nothing to judge
+		if (!block[ch]) continue;
+		uint32_t h, bit = 1u << ch;
+		bool live = !liveness_scan(block[ch]->data, &h) && !unsynced;
+		for (k=0; live && k < AUDIO_LIVENESS_HISTORY; k++) {
+			if (history[k][ch] == h) live = false;
+		}
+		history[history_head][ch] = h;
+		if (!live) {
+			live_run[ch] = 0;
+			if (!(dead & bit)) {
+				dead |= bit;
+				dropout_count++;
+			}
+		} else if ((dead & bit) && ++live_run[ch] >= recover_blocks) {
+			live_run[ch] = 0;
+			dead &= ~bit;
+			recovery_count++;
+		}
+	}
+	if (++history_head >= AUDIO_LIVENESS_HISTORY) history_head = 0;
+	dead_mask = dead;
+
+	for (ch=0; ch < Channels; ch++) {
+		if (!block[ch]) continue;
+		if (mark && (dead & (1u << ch))) {
+			// one marker block serves every dead channel
+			if (!marker_block && (marker_block = allocate()) != NULL) {
+				for (k=0; k < AUDIO_BLOCK_SAMPLES; k++) marker_block->data[k] = AUDIO_LIVENESS_MARKER;
+			}
+			if (marker_block) {
+				transmit(marker_block, ch);
+				release(block[ch]);
+				continue;
+			}
+		}
+		transmit(block[ch], ch);
+		release(block[ch]);
+	}
+	if (marker_block) release(marker_block);
+}
+
+template class AudioEffectLivenessT<4>;
+template class AudioEffectLivenessT<8>;
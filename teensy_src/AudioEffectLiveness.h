@@ -0,0 +1,93 @@
+/* Liveness check of the slave's channels on the master
+ *
+ * Put it between the receiver's slave outputs and whatever consumes them:
+ * every block passes through, and each channel is judged on the block
+ * itself, so a channel is flagged in the same update its first bad block
+ * arrives in.  A block is dead if
+ *
+ *   - all its samples are equal: a slave that stopped driving its lane,
+ *     or lost its clocks, reads as a constant (all zeros, or all ones);
+ *   - it repeats one of the last AUDIO_LIVENESS_HISTORY blocks word for
+ *     word: a slave whose CPU stopped leaves its DMA ring replaying;
+ *   - watch() was given the status analyzer and the status packet has
+ *     lost sync: whatever is on the lane is not the slave's frame.
+ *
+ * A microphone never produces the first two within a block.  A tone whose
+ * period divides one to AUDIO_LIVENESS_HISTORY blocks exactly would read
+ * as a repeat; the slave's test tones do not.
+ *
+ * Dead channels pass through unchanged, or with marker(true) as blocks of
+ * AUDIO_LIVENESS_MARKER, a constant no live channel carries for a whole
+ * block.  A channel comes back after recover() live blocks in a row.  The
+ * readings may be polled from loop(); AudioTelemetry::liveness() sends
+ * them, so the host can drop dead channels before computing on them.
+ */
+
+#ifndef AudioEffectLiveness_h_
+#define AudioEffectLiveness_h_
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <audio_memory.h>
+#include "AudioAnalyzeTDMStatus.h"
+
+#ifndef AUDIO_LIVENESS_HISTORY
+#define AUDIO_LIVENESS_HISTORY	4
+#endif
+
+#ifndef AUDIO_LIVENESS_MARKER
+#define AUDIO_LIVENESS_MARKER	(-32768)
+#endif
+
+template <unsigned int Channels>
+class AudioEffectLivenessT : public AudioStream, public AudioMemoryUser
+{
+	static_assert(Channels >= 1 && Channels <= 32, "one liveness check takes 1 to 32 channels");
+public:
+	static const unsigned int channels = Channels;
+
+	AudioEffectLivenessT(void) : AudioStream(Channels, inputQueueArray), status(NULL),
+		dead_mask(0), dropout_count(0), recovery_count(0), recover_blocks(4),
+		mark(false), history_head(0) {
+		for (unsigned int ch=0; ch < Channels; ch++) {
+			live_run[ch] = 0;
+			for (unsigned int k=0; k < AUDIO_LIVENESS_HISTORY; k++) history[k][ch] = 0;
+		}
+	}
+	virtual void update(void);
+	// also treat every channel as dead while the status packet is out of
+	// sync; construct the analyzer first so it has seen the same block
+	void watch(AudioAnalyzeTDMStatus &s) { status = &s; }
+	// live blocks in a row before a dead channel counts as live again
+	void recover(unsigned int blocks) { recover_blocks = blocks ? blocks : 1; }
+	// send AUDIO_LIVENESS_MARKER in place of dead channels
+	void marker(bool on) { mark = on; }
+	// bit n set while channel n is dead
+	uint32_t dead(void) { return dead_mask; }
+	// channels that went dead, and dead channels that came back
+	uint32_t dropouts(void) { return dropout_count; }
+	uint32_t recoveries(void) { return recovery_count; }
+	// the marker block
+	virtual unsigned int memoryBlocks(void) { return 1; }
+private:
+	audio_block_t *inputQueueArray[Channels];
+	AudioAnalyzeTDMStatus *status;
+	volatile uint32_t dead_mask;
+	volatile uint32_t dropout_count;
+	volatile uint32_t recovery_count;
+	volatile unsigned int recover_blocks;
+	volatile bool mark;
+	// live blocks since a dead channel's last bad one
+	uint16_t live_run[Channels];
+	// hashes of each channel's last blocks, history[history_head] oldest
+	uint32_t history[AUDIO_LIVENESS_HISTORY][Channels];
+	unsigned int history_head;
+};
+
+extern template class AudioEffectLivenessT<4>;
+extern template class AudioEffectLivenessT<8>;
+
+// The master's four slave microphone slots.
+typedef AudioEffectLivenessT<4> AudioEffectLiveness4;
+
+#endif
@@ -0,0 +1,318 @@
+/* Audio Library for Teensy 3.X
+ * Copyright (c) 2017, Paul Stoffregen, paul@pjrc.com
+ * Modified for multi-lane I2S slave operation
+ *
+ * Development of this audio library was funded by PJRC.COM, LLC by sales of
+ * Teensy and Audio Adaptor boards.  Please support PJRC's efforts to develop
+ * open source software by purchasing Teensy or other PJRC products.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice, development funding notice, and this permission
+ * notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+
+#if defined(__IMXRT1062__)
+
+#include "AudioInputI2SQuadSlave.h"
+#include "tdm_pack.h"
+#include "audio_profile.h"
+#include "audio_dma_mem.h"
+
+#define I2S_SLAVE_TEMPLATE template <unsigned int Lanes, unsigned int Upstream>
+#define I2S_SLAVE AudioInputI2SSlaveT<Lanes, Upstream>
+
+I2S_SLAVE_TEMPLATE audio_block_t * I2S_SLAVE::block_incoming[channels];
+I2S_SLAVE_TEMPLATE uint32_t I2S_SLAVE::incoming_mask = 0;
+I2S_SLAVE_TEMPLATE volatile uint32_t I2S_SLAVE::slot_mask = 0;
+I2S_SLAVE_TEMPLATE bool I2S_SLAVE::update_responsibility = false;
+I2S_SLAVE_TEMPLATE DMAChannel I2S_SLAVE::dma(false);
+I2S_SLAVE_TEMPLATE DMASetting I2S_SLAVE::pass_ring[pass_segments];
+I2S_SLAVE_TEMPLATE const tdm_passthrough_t * I2S_SLAVE::pass_target = nullptr;
+I2S_SLAVE_TEMPLATE unsigned int I2S_SLAVE::pass_frame = 0;
+I2S_SLAVE_TEMPLATE bool I2S_SLAVE::pass_locked = false;
+I2S_SLAVE_TEMPLATE volatile uint32_t I2S_SLAVE::pass_slips = 0;
+
+I2S_SLAVE_TEMPLATE
+void I2S_SLAVE::begin(void)
+{
+	dma.begin(true); // Allocate the DMA channel first
+
+	for (unsigned int i=0; i < channels; i++) {
+		block_incoming[i] = nullptr;
+	}
+	incoming_mask = 0;
+	pass_target = nullptr;
+	pass_locked = false;
+	pass_slips = 0;
+	config_i2s_slave();
+	// set even when another object configured SAI1 first
+	I2S1_RCR3 = I2S_RCR3_RCE * ((1u << rx_lanes) - 1);
+
+	CORE_PIN8_CONFIG  = 3;  //RX_DATA0
+	IOMUXC_SAI1_RX_DATA0_SELECT_INPUT = 2; // GPIO_B1_00_ALT3, pg 873
+	if (rx_lanes > 1) {
+		CORE_PIN6_CONFIG  = 3;  //RX_DATA1
+		IOMUXC_SAI1_RX_DATA1_SELECT_INPUT = 1; // GPIO_B0_10_ALT3, pg 873
+	}
+	if (rx_lanes > 2) {
+		CORE_PIN9_CONFIG  = 3;  //RX_DATA2
+		IOMUXC_SAI1_RX_DATA2_SELECT_INPUT = 1; // GPIO_B0_11_ALT3
+	}
+	if (rx_lanes > 3) {
+		CORE_PIN32_CONFIG = 3;  //RX_DATA3
+		IOMUXC_SAI1_RX_DATA3_SELECT_INPUT = 1; // GPIO_B0_12_ALT3
+	}
+
+	config_dma(dma, i2s_rx_buffer, buffer_words);
+	dma.TCD->CSR = DMA_TCD_CSR_INTHALF | DMA_TCD_CSR_INTMAJOR;
+	dma.triggerAtHardwareEvent(DMAMUX_SOURCE_SAI1_RX);
+	update_responsibility = update_setup();
+	dma.enable();
+
+	I2S1_RCSR = I2S_RCSR_RE | I2S_RCSR_BCE | I2S_RCSR_FRDE | I2S_RCSR_FR;
+	dma.attachInterrupt(isr);
+}
+
+// Each minor loop reads one word from every lane, then the minor loop
+// offset takes the source back to RDR0.
+I2S_SLAVE_TEMPLATE
+void I2S_SLAVE::config_dma(DMABaseClass &d, uint32_t *dest, unsigned int words)
+{
+	d.TCD->SADDR = &I2S1_RDR0;
+	d.TCD->SOFF = (rx_lanes > 1) ? 4 : 0;
+	d.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+	if (rx_lanes > 1) {
+		d.TCD->NBYTES_MLOFFYES = DMA_TCD_NBYTES_SMLOE |
+			DMA_TCD_NBYTES_MLOFFYES_MLOFF(-4 * (int32_t)rx_lanes) |
+			DMA_TCD_NBYTES_MLOFFYES_NBYTES(4 * rx_lanes);
+	} else {
+		d.TCD->NBYTES_MLNO = 4;
+	}
+	d.TCD->SLAST = 0;
+	d.TCD->DADDR = dest;
+	d.TCD->DOFF = 4;
+	d.TCD->CITER_ELINKNO = words / rx_lanes;
+	d.TCD->DLASTSGA = -(int32_t)(words * 4);
+	d.TCD->BITER_ELINKNO = words / rx_lanes;
+	d.TCD->CSR = 0;
+}
+
+// Switch the running DMA to a ring of pass-through segments.  The ring
+// takes over at the word the DMA had reached, so the frame phase in the
+// buffer is kept and the receiver never stops (the transmitter runs from
+// its clocks).
+I2S_SLAVE_TEMPLATE
+bool I2S_SLAVE::passthrough(const tdm_passthrough_t *target)
+{
+	unsigned int offset, segment;
+
+	if (!target) return false;
+	// a segment is written whole, ahead of the transmitter and behind its
+	// own previous write
+	if (target->frames < passthrough_lead + 2 * passthrough_frames) return false;
+	for (unsigned int i=0; i < pass_segments; i++) {
+		config_dma(pass_ring[i], i2s_rx_buffer + i * pass_words, pass_words);
+		pass_ring[i].replaceSettingsOnCompletion(pass_ring[(i + 1) % pass_segments]);
+		pass_ring[i].interruptAtCompletion();
+	}
+	__disable_irq();
+	dma.disable();
+	offset = ((uintptr_t)(dma.TCD->DADDR) - (uintptr_t)i2s_rx_buffer) / 4;
+	if (offset >= buffer_words) offset = 0;
+	segment = offset / pass_words;
+	dma = pass_ring[segment];
+	dma.TCD->DADDR = i2s_rx_buffer + offset;
+	dma.TCD->CITER_ELINKNO = (pass_words - (offset - segment * pass_words)) / rx_lanes;
+	pass_target = target;
+	pass_locked = false;
+	dma.enable();
+	__enable_irq();
+	return true;
+}
+
+// Write one segment into the transmit buffer.  The transmitter runs on the
+// same frame clock, so the distance to its DMA only changes if this
+// interrupt was held off for longer than the lead; lock on again then.
+I2S_SLAVE_TEMPLATE
+void I2S_SLAVE::passthrough_write(const uint32_t *src)
+{
+	const tdm_passthrough_t *t = pass_target;
+	unsigned int position = t->position();
+	unsigned int ahead = (pass_frame + t->frames - position) % t->frames;
+	uint32_t *dest;
+
+	if (!pass_locked || ahead == 0 || ahead >= passthrough_lead + passthrough_frames * 2) {
+		if (pass_locked) pass_slips++;
+		// segments start on a multiple of their length, so none wraps
+		pass_frame = (position + passthrough_lead + passthrough_frames - 1) / passthrough_frames;
+		pass_frame = (pass_frame * passthrough_frames) % t->frames;
+		pass_locked = true;
+	}
+	dest = t->buffer + pass_frame * t->stride;
+	for (unsigned int n=0; n < Lanes; n++) {
+		if (t->wide) {
+			tdm_repack_single<words_per_sample>(dest + t->column[n * 2], t->stride,
+				src + n, passthrough_frames);
+			tdm_repack_single<words_per_sample>(dest + t->column[n * 2 + 1], t->stride,
+				src + rx_lanes + n, passthrough_frames);
+		} else {
+			tdm_repack_pair<words_per_sample>(dest + t->column[n * 2], t->stride,
+				src + n, rx_lanes, passthrough_frames);
+		}
+	}
+	for (unsigned int n=0; n < Upstream; n++) {
+		for (unsigned int w=0; w < words_per_frame; w++) {
+			if (t->relay_column[n][w] == TDM_PASSTHROUGH_NONE) continue;
+			tdm_relay_word<words_per_sample>(dest + t->relay_column[n][w], t->stride,
+				src + w * rx_lanes + Lanes + n, passthrough_frames);
+		}
+	}
+	audio_dma_flush(dest, passthrough_frames * t->stride * 4);
+	pass_frame += passthrough_frames;
+	if (pass_frame >= t->frames) pass_frame = 0;
+}
+
+I2S_SLAVE_TEMPLATE
+void I2S_SLAVE::isr(void)
+{
+	uintptr_t daddr;
+	const uint32_t *src;
+	uint32_t mask;
+	unsigned int c, segment;
+	AudioProfileScope profile(&audio_profile_i2s_rx);
+
+	daddr = (uintptr_t)(dma.TCD->DADDR);
+	dma.clearInterrupt();
+
+	if (pass_target) {
+		// the DMA has moved on from a pass-through segment; the blocks
+		// are still taken once per half buffer
+		segment = (daddr - (uintptr_t)i2s_rx_buffer) / (pass_words * 4);
+		if (segment >= pass_segments) segment = 0;
+		segment = (segment == 0 ? pass_segments : segment) - 1;
+		src = &i2s_rx_buffer[segment * pass_words];
+		audio_dma_delete((void*)src, pass_words * 4);
+		passthrough_write(src);
+		if ((segment + 1) % (pass_segments / 2)) return;
+		// already invalidated segment by segment
+		src = &i2s_rx_buffer[(segment + 1) * pass_words - buffer_words / 2];
+	} else {
+		if (daddr < (uintptr_t)i2s_rx_buffer + sizeof(i2s_rx_buffer) / 2) {
+			// DMA is receiving to the first half of the buffer
+			// need to remove data from the second half
+			src = &i2s_rx_buffer[buffer_words / 2];
+		} else {
+			// DMA is receiving to the second half of the buffer
+			// need to remove data from the first half
+			src = &i2s_rx_buffer[0];
+		}
+		if (incoming_mask) audio_dma_delete((void*)src, sizeof(i2s_rx_buffer) / 2);
+	}
+	if (incoming_mask) {
+		// channel 2n+w is word w of lane n, the sample in the upper half
+		mask = incoming_mask;
+		while (mask) {
+			c = __builtin_ctz(mask);
+			mask &= mask - 1;
+			tdm_unpack_upper<words_per_sample>((uint32_t *)(block_incoming[c]->data),
+				src + (c & 1) * rx_lanes + (c >> 1));
+		}
+	}
+	if (update_responsibility) AudioStream::update_all();
+}
+
+I2S_SLAVE_TEMPLATE
+void I2S_SLAVE::update(void)
+{
+	unsigned int i, j;
+	audio_block_t *new_block[channels];
+	audio_block_t *out_block[channels];
+	uint32_t mask, out_mask;
+
+	// allocate a block for each wanted output.  If any fails, allocate none
+	mask = slot_mask & ((1u << channels) - 1);
+	for (i=0; i < channels; i++) {
+		new_block[i] = nullptr;
+		if (!(mask & (1u << i))) continue;
+		new_block[i] = allocate();
+		if (new_block[i] == nullptr) {
+			for (j=0; j < i; j++) {
+				if (new_block[j]) release(new_block[j]);
+			}
+			memset(new_block, 0, sizeof(new_block));
+			mask = 0;
+			break;
+		}
+	}
+	__disable_irq();
+	memcpy(out_block, block_incoming, sizeof(out_block));
+	memcpy(block_incoming, new_block, sizeof(block_incoming));
+	out_mask = incoming_mask;
+	incoming_mask = mask;
+	__enable_irq();
+	for (i=0; i < channels; i++) {
+		if (!(out_mask & (1u << i))) continue;
+		transmit(out_block[i], i);
+		release(out_block[i]);
+	}
+}
+
+// External clocks on the receiver's pins, the transmitter synchronous to
+// the receiver, and an I2S frame (LRCLK low starts it), matching
+// AudioOutputTDM_SlaveT::config_tdm_slave() for a two word frame.
+I2S_SLAVE_TEMPLATE
+void I2S_SLAVE::config_i2s_slave(void)
+{
+	CCM_CCGR5 |= CCM_CCGR5_SAI1(CCM_CCGR_ON);
+
+	// if either transmitter or receiver is enabled, do nothing
+	if (I2S1_TCSR & I2S_TCSR_TE) return;
+	if (I2S1_RCSR & I2S_RCSR_RE) return;
+
+	I2S1_TMR = 0;
+	I2S1_TCR1 = I2S_TCR1_RFW(4);
+	I2S1_TCR2 = I2S_TCR2_SYNC(1) | I2S_TCR2_BCP;
+	I2S1_TCR4 = I2S_TCR4_FRSZ(words_per_frame-1) | I2S_TCR4_SYWD(31) | I2S_TCR4_MF
+		| I2S_TCR4_FSE | I2S_TCR4_FSP;
+	I2S1_TCR5 = I2S_TCR5_WNW(31) | I2S_TCR5_W0W(31) | I2S_TCR5_FBT(31);
+
+	I2S1_RMR = 0;
+	I2S1_RCR1 = I2S_RCR1_RFW(4);
+	I2S1_RCR2 = I2S_RCR2_SYNC(0) | I2S_RCR2_BCP;
+	I2S1_RCR4 = I2S_RCR4_FRSZ(words_per_frame-1) | I2S_RCR4_SYWD(31) | I2S_RCR4_MF
+		| I2S_RCR4_FSE | I2S_RCR4_FSP;
+	I2S1_RCR5 = I2S_RCR5_WNW(31) | I2S_RCR5_W0W(31) | I2S_RCR5_FBT(31);
+
+	CORE_PIN21_CONFIG = 3;  //RX_BCLK
+	CORE_PIN20_CONFIG = 3;  //RX_SYNC
+}
+
+// Explicit specializations for the DMA buffer, as in AudioOutputTDM_Slave.cpp:
+// GCC drops the DMAMEM section attribute from implicitly instantiated
+// static members.
+#define I2S_SLAVE_INSTANTIATE(L, U) \
+	template <> AUDIO_DMA_MEM __attribute__((aligned(32))) \
+	uint32_t AudioInputI2SSlaveT<L, U>::i2s_rx_buffer[AudioInputI2SSlaveT<L, U>::buffer_words] = {}; \
+	template class AudioInputI2SSlaveT<L, U>;
+
+I2S_SLAVE_INSTANTIATE(2, 0)
+I2S_SLAVE_INSTANTIATE(4, 0)
+I2S_SLAVE_INSTANTIATE(2, 1)
+
+#endif
@@ -0,0 +1,164 @@
+/* Audio Library for Teensy 3.X
+ * Copyright (c) 2017, Paul Stoffregen, paul@pjrc.com
+ * Modified for multi-lane I2S slave operation
+ *
+ * Development of this audio library was funded by PJRC.COM, LLC by sales of
+ * Teensy and Audio Adaptor boards.  Please support PJRC's efforts to develop
+ * open source software by purchasing Teensy or other PJRC products.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice, development funding notice, and this permission
+ * notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef AudioInputI2SQuadSlave_h_
+#define AudioInputI2SQuadSlave_h_
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <DMAChannel.h>
+#include <audio_memory.h>
+#include "tdm_passthrough.h"
+
+// Frames per DMA interrupt in pass-through mode; half a block with small
+// blocks, so the transmit ring still holds two segments and the lead
+#ifndef I2S_SLAVE_PASSTHROUGH_FRAMES
+#if AUDIO_BLOCK_SAMPLES >= 32
+#define I2S_SLAVE_PASSTHROUGH_FRAMES 16
+#else
+#define I2S_SLAVE_PASSTHROUGH_FRAMES (AUDIO_BLOCK_SAMPLES / 2)
+#endif
+#endif
+
+// I2S microphone input clocked by an external BCLK/LRCLK (pins 21 and 20)
+// on Lanes SAI1 receive data pins: RXD0-3 on pins 8, 6, 9 and 32.  Output
+// 2n is the left and 2n+1 the right channel of lane n, as in
+// AudioInputI2SQuad and AudioInputI2SOct.
+//
+// One DMA channel reads every lane with a minor loop per frame word, so
+// four or eight microphones cost one channel and one interrupt instead of
+// an AudioInputI2Sslave per pair.  Channels in the mask are allocated,
+// deinterleaved and transmitted, as in AudioInputTDM_Sparse.
+//
+// It shares SAI1 with AudioOutputTDM_SlaveT, whichever begins first
+// setting up the clocks; the transmitter must then use the same I2S frame
+// (a slave layout with two words per lane, e.g. <8, 16, 2, 2>).  The
+// receive and transmit data pins overlap from the other end (RXD3 is TXD1
+// on pin 32, RXD2 is TXD2 on pin 9, RXD1 is TXD3 on pin 6), so the octo
+// variant cannot run beside a multi-lane slave output.
+//
+// passthrough() sends the microphones to slots of that output without
+// going through update().  The DMA runs as a ring of
+// I2S_SLAVE_PASSTHROUGH_FRAMES frame segments, and the interrupt after
+// each one writes it straight into the transmit buffer, passthrough_lead
+// frames ahead of the transmit DMA.  Microphone to wire latency drops from
+// the output's latency_samples plus a block to about one segment, the lead
+// and the transmit FIFO.  Outputs in the mask still deliver blocks, once
+// per half buffer as before, for local analysis; slots(0) turns them off.
+// passthrough() fails if the transmit ring is shorter than the lead plus
+// two segments, as it can be with small blocks and a larger
+// I2S_SLAVE_PASSTHROUGH_FRAMES.
+//
+// Upstream adds that many receive lanes after the microphones for a daisy
+// chain (see AudioOutputTDM_SlaveT): the same DMA stream reads them, and
+// in pass-through mode their words are relayed unchanged into the slots
+// below the output's slot offset.  AudioInputI2SQuadSlaveChain takes the
+// upstream board's TXD0 on RXD2 (pin 9).
+//
+// Teensy 4 only.
+template <unsigned int Lanes, unsigned int Upstream = 0>
+class AudioInputI2SSlaveT : public AudioStream, public AudioMemoryUser
+{
+	static_assert(Lanes >= 1 && Lanes + Upstream <= 4, "SAI1 has four receive lanes");
+	static_assert(Upstream <= TDM_PASSTHROUGH_MAX_RELAY_LANES, "too many upstream lanes");
+public:
+	static const unsigned int lanes = Lanes;
+	static const unsigned int upstream_lanes = Upstream;
+	static const unsigned int rx_lanes = Lanes + Upstream;
+	static const unsigned int channels = Lanes * 2;
+	// SAI words per lane in each frame, and buffer words per sample period
+	static const unsigned int words_per_frame = 2;
+	static const unsigned int words_per_sample = words_per_frame * rx_lanes;
+	static const unsigned int buffer_words = AUDIO_BLOCK_SAMPLES * words_per_sample * 2;
+	static const unsigned int passthrough_frames = I2S_SLAVE_PASSTHROUGH_FRAMES;
+	// frames the pass-through writer keeps ahead of the transmit DMA
+	static const unsigned int passthrough_lead = 4;
+	static_assert(passthrough_frames >= 4 && (passthrough_frames % 4) == 0 &&
+		(AUDIO_BLOCK_SAMPLES % passthrough_frames) == 0,
+		"I2S_SLAVE_PASSTHROUGH_FRAMES must be a multiple of 4 dividing the block");
+
+	AudioInputI2SSlaveT(uint32_t mask = (1u << channels) - 1) : AudioStream(0, NULL) {
+		slot_mask = mask;
+		begin();
+	}
+	virtual void update(void);
+	void begin(void);
+	// bit n set delivers output n
+	static void slots(uint32_t mask) { slot_mask = mask; }
+	static uint32_t slots(void) { return slot_mask; }
+	// a period's blocks being filled plus the last period's, held until
+	// transmitted, for the slots in the mask; widen the mask before
+	// AudioMemoryAuto() if it will be widened at all
+	virtual unsigned int memoryBlocks(void) {
+		return 2 * __builtin_popcount(slot_mask) + numConnections;
+	}
+	// write channel n straight into slot first_slot + n (after its slot
+	// offset) of an AudioOutputTDM_SlaveT on the same SAI1, and relay the
+	// upstream lanes; first_slot must be even
+	template <class Output>
+	bool passthrough(Output &out, unsigned int first_slot) {
+		return passthrough(out.passthroughTarget(first_slot, channels, Upstream));
+	}
+	bool passthrough(const tdm_passthrough_t *target);
+	// times the pass-through writer fell behind the transmitter and
+	// locked on again
+	static uint32_t passthroughSlips(void) { return pass_slips; }
+protected:
+	static const unsigned int pass_segments = AUDIO_BLOCK_SAMPLES * 2 / passthrough_frames;
+	static const unsigned int pass_words = passthrough_frames * words_per_sample;
+	static void config_i2s_slave(void);
+	static void config_dma(DMABaseClass &d, uint32_t *dest, unsigned int words);
+	static void passthrough_write(const uint32_t *src);
+	static bool update_responsibility;
+	static DMAChannel dma;
+	static uint32_t i2s_rx_buffer[buffer_words];
+	static DMASetting pass_ring[pass_segments];
+	static void isr(void);
+private:
+	// block_incoming[] and incoming_mask are swapped together by update()
+	// with interrupts masked; the ISR fills the outputs in incoming_mask
+	static audio_block_t *block_incoming[channels];
+	static uint32_t incoming_mask;
+	static volatile uint32_t slot_mask;
+	// pass_frame is the transmit frame the next segment goes to
+	static const tdm_passthrough_t *pass_target;
+	static unsigned int pass_frame;
+	static bool pass_locked;
+	static volatile uint32_t pass_slips;
+};
+
+#if defined(__IMXRT1062__)
+extern template class AudioInputI2SSlaveT<2>;
+extern template class AudioInputI2SSlaveT<4>;
+extern template class AudioInputI2SSlaveT<2, 1>;
+#endif
+
+typedef AudioInputI2SSlaveT<2> AudioInputI2SQuadSlave;
+typedef AudioInputI2SSlaveT<4> AudioInputI2SOctSlave;
+typedef AudioInputI2SSlaveT<2, 1> AudioInputI2SQuadSlaveChain;
+
+#endif
@@ -0,0 +1,116 @@
+/* Audio Library for Teensy 3.X
+ * Copyright (c) 2017, Paul Stoffregen, paul@pjrc.com
+ * Modified to receive I2S and TDM lanes through one DMA channel
+ *
+ * Development of this audio library was funded by PJRC.COM, LLC by sales of
+ * Teensy and Audio Adaptor boards.  Please support PJRC's efforts to develop
+ * open source software by purchasing Teensy or other PJRC products.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice, development funding notice, and this permission
+ * notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef AudioInputI2SQuadTDM_h_
+#define AudioInputI2SQuadTDM_h_
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <DMAChannel.h>
+#include <audio_memory.h>
+
+// The whole SAI1 receiver of the master in one object: the local I2S
+// microphone pairs on RXD0 and RXD1 (pins 8 and 6), and the slave's TDM
+// stream on RXD2 (pin 9) and, with RemoteLanes = 2, RXD3 (pin 32).  SAI1
+// is the clock master and every lane shares its frame, so the slave runs
+// in I2S framing: 64 BCLKs per frame, two 32-bit words per lane, each word
+// carrying two 16-bit slots.  That is AudioOutputTDM_SlaveT<4 * RemoteLanes,
+// 16, QueueDepth, RemoteLanes> on the slave.
+//
+// One DMA channel reads all lanes with a minor loop per frame word, so one
+// interrupt per half buffer deinterleaves everything.  Outputs 0-3 are the
+// local channels in AudioInputI2SQuad order (RXD0 left/right, RXD1
+// left/right), outputs 4 and up are the slave's slots in its channel
+// order.  As with AudioInputTDM_Sparse, only channels in the mask are
+// allocated, deinterleaved and transmitted, and slots() changes the mask
+// from the next update.
+//
+// Teensy 4 only.
+template <unsigned int RemoteLanes = 1>
+class AudioInputI2SQuadTDMT : public AudioStream, public AudioMemoryUser
+{
+	static_assert(RemoteLanes >= 1 && RemoteLanes <= 2, "SAI1 has two receive lanes left for TDM");
+public:
+	static const unsigned int local_lanes = 2;
+	static const unsigned int lanes = local_lanes + RemoteLanes;
+	static const unsigned int local_channels = local_lanes * 2;
+	static const unsigned int remote_channels = RemoteLanes * 4;
+	static const unsigned int channels = local_channels + remote_channels;
+	// SAI words per lane in each frame, and buffer words per sample period
+	static const unsigned int words_per_frame = 2;
+	static const unsigned int words_per_sample = words_per_frame * lanes;
+	static const unsigned int buffer_words = AUDIO_BLOCK_SAMPLES * words_per_sample * 2;
+
+	AudioInputI2SQuadTDMT(uint32_t mask = (1u << channels) - 1) : AudioStream(0, NULL) {
+		slot_mask = mask;
+		begin();
+	}
+	virtual void update(void);
+	void begin(void);
+	// bit n set delivers output n
+	static void slots(uint32_t mask) { slot_mask = mask; }
+	static uint32_t slots(void) { return slot_mask; }
+	// a period's blocks being filled plus the last period's, held until
+	// transmitted, for the slots in the mask; widen the mask before
+	// AudioMemoryAuto() if it will be widened at all
+	virtual unsigned int memoryBlocks(void) {
+		return 2 * __builtin_popcount(slot_mask) + numConnections;
+	}
+protected:
+	// outputs carried in the upper and lower half of a buffer word column;
+	// the lower half of a microphone word is sub-16-bit data, never used
+	static int upper_channel(unsigned int col) {
+		unsigned int word = col / lanes, lane = col % lanes;
+		if (lane < local_lanes) return lane * 2 + word;
+		return local_channels + (lane - local_lanes) * 4 + word * 2;
+	}
+	static int lower_channel(unsigned int col) {
+		unsigned int lane = col % lanes;
+		return (lane < local_lanes) ? -1 : upper_channel(col) + 1;
+	}
+	static void config_i2s(void);
+	static bool update_responsibility;
+	static DMAChannel dma;
+	static uint32_t i2s_rx_buffer[buffer_words];
+	static void isr(void);
+private:
+	// block_incoming[] and incoming_mask are swapped together by update()
+	// with interrupts masked; the ISR fills the outputs in incoming_mask
+	static audio_block_t *block_incoming[channels];
+	static uint32_t incoming_mask;
+	static volatile uint32_t slot_mask;
+};
+
+#if defined(__IMXRT1062__)
+extern template class AudioInputI2SQuadTDMT<1>;
+extern template class AudioInputI2SQuadTDMT<2>;
+#endif
+
+// Local quad plus one TDM lane of four slave slots.
+typedef AudioInputI2SQuadTDMT<1> AudioInputI2SQuadTDM;
+
+#endif
@@ -0,0 +1,222 @@
+/* Audio Library for Teensy 3.X
+ * Copyright (c) 2017, Paul Stoffregen, paul@pjrc.com
+ * Modified to receive only selected slots
+ *
+ * Development of this audio library was funded by PJRC.COM, LLC by sales of
+ * Teensy and Audio Adaptor boards.  Please support PJRC's efforts to develop
+ * open source software by purchasing Teensy or other PJRC products.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice, development funding notice, and this permission
+ * notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+
+#if defined(__IMXRT1062__)
+
+#include "AudioInputTDM_Sparse.h"
+#include "tdm_pack.h"
+#include "audio_profile.h"
+#include "audio_dma_mem.h"
+#include "utility/imxrt_hw.h"
+
+#define TDM_WORDS_PER_FRAME	8
+
+AUDIO_DMA_MEM __attribute__((aligned(32)))
+static uint32_t tdm_rx_buffer[AUDIO_BLOCK_SAMPLES*TDM_WORDS_PER_FRAME*2];
+audio_block_t * AudioInputTDM_Sparse::block_incoming[channels] = {
+	nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+	nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr
+};
+uint16_t AudioInputTDM_Sparse::incoming_mask = 0;
+volatile uint16_t AudioInputTDM_Sparse::slot_mask = 0xFFFF;
+bool AudioInputTDM_Sparse::update_responsibility = false;
+DMAChannel AudioInputTDM_Sparse::dma(false);
+
+void AudioInputTDM_Sparse::begin(void)
+{
+	dma.begin(true); // Allocate the DMA channel first
+
+	for (unsigned int i=0; i < channels; i++) {
+		block_incoming[i] = nullptr;
+	}
+	incoming_mask = 0;
+	config_tdm();
+
+	CORE_PIN8_CONFIG  = 3;  //RX_DATA0
+	IOMUXC_SAI1_RX_DATA0_SELECT_INPUT = 2;
+	dma.TCD->SADDR = &I2S1_RDR0;
+	dma.TCD->SOFF = 0;
+	dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+	dma.TCD->NBYTES_MLNO = 4;
+	dma.TCD->SLAST = 0;
+	dma.TCD->DADDR = tdm_rx_buffer;
+	dma.TCD->DOFF = 4;
+	dma.TCD->CITER_ELINKNO = sizeof(tdm_rx_buffer) / 4;
+	dma.TCD->DLASTSGA = -sizeof(tdm_rx_buffer);
+	dma.TCD->BITER_ELINKNO = sizeof(tdm_rx_buffer) / 4;
+	dma.TCD->CSR = DMA_TCD_CSR_INTHALF | DMA_TCD_CSR_INTMAJOR;
+	dma.triggerAtHardwareEvent(DMAMUX_SOURCE_SAI1_RX);
+	update_responsibility = update_setup();
+	dma.enable();
+
+	I2S1_RCSR = I2S_RCSR_RE | I2S_RCSR_BCE | I2S_RCSR_FRDE | I2S_RCSR_FR;
+	I2S1_TCSR |= I2S_TCSR_TE | I2S_TCSR_BCE; // TX clock enable, because sync'd to TX
+	dma.attachInterrupt(isr);
+}
+
+void AudioInputTDM_Sparse::isr(void)
+{
+	uintptr_t daddr;
+	uint32_t columns, i;
+	const uint32_t *src;
+	uint32_t *dest1, *dest2;
+	audio_block_t *upper, *lower;
+	AudioProfileScope profile(&audio_profile_tdm_rx);
+
+	daddr = (uintptr_t)(dma.TCD->DADDR);
+	dma.clearInterrupt();
+
+	if (daddr < (uintptr_t)tdm_rx_buffer + sizeof(tdm_rx_buffer) / 2) {
+		// DMA is receiving to the first half of the buffer
+		// need to remove data from the second half
+		src = &tdm_rx_buffer[AUDIO_BLOCK_SAMPLES*TDM_WORDS_PER_FRAME];
+	} else {
+		// DMA is receiving to the second half of the buffer
+		// need to remove data from the first half
+		src = &tdm_rx_buffer[0];
+	}
+	if (incoming_mask) {
+		audio_dma_delete((void*)src, sizeof(tdm_rx_buffer) / 2);
+		// i is an even slot: word column i/2 carries slot i in its
+		// upper half and i+1 in its lower half; columns with neither
+		// slot wanted are skipped
+		columns = incoming_mask | (incoming_mask >> 1);
+		columns &= 0x5555;
+		while (columns) {
+			i = __builtin_ctz(columns);
+			columns &= columns - 1;
+			upper = block_incoming[i];
+			lower = block_incoming[i+1];
+			dest1 = upper ? (uint32_t *)(upper->data) : NULL;
+			dest2 = lower ? (uint32_t *)(lower->data) : NULL;
+			if (dest1 && dest2) {
+				tdm_unpack_pair<TDM_WORDS_PER_FRAME>(dest1, dest2, src + i/2);
+			} else if (dest1) {
+				tdm_unpack_upper<TDM_WORDS_PER_FRAME>(dest1, src + i/2);
+			} else {
+				tdm_unpack_lower<TDM_WORDS_PER_FRAME>(dest2, src + i/2);
+			}
+		}
+	}
+	if (update_responsibility) update_all();
+}
+
+void AudioInputTDM_Sparse::update(void)
+{
+	unsigned int i, j;
+	audio_block_t *new_block[channels];
+	audio_block_t *out_block[channels];
+	uint16_t mask, out_mask;
+
+	// allocate a block for each wanted slot.  If any fails, allocate none
+	mask = slot_mask;
+	for (i=0; i < channels; i++) {
+		new_block[i] = nullptr;
+		if (!(mask & (1 << i))) continue;
+		new_block[i] = allocate();
+		if (new_block[i] == nullptr) {
+			for (j=0; j < i; j++) {
+				if (new_block[j]) release(new_block[j]);
+			}
+			memset(new_block, 0, sizeof(new_block));
+			mask = 0;
+			break;
+		}
+	}
+	__disable_irq();
+	memcpy(out_block, block_incoming, sizeof(out_block));
+	memcpy(block_incoming, new_block, sizeof(block_incoming));
+	out_mask = incoming_mask;
+	incoming_mask = mask;
+	__enable_irq();
+	for (i=0; i < channels; i++) {
+		if (!(out_mask & (1 << i))) continue;
+		transmit(out_block[i], i);
+		release(out_block[i]);
+	}
+}
+
+// The clock setup of AudioOutputTDM::config_tdm(), which is protected in
+// the stock library: SAI1 as master at 256 BCLKs per frame, MCLK on pin 23.
+void AudioInputTDM_Sparse::config_tdm(void)
+{
+	CCM_CCGR5 |= CCM_CCGR5_SAI1(CCM_CCGR_ON);
+
+	// if either transmitter or receiver is enabled, do nothing
+	if (I2S1_TCSR & I2S_TCSR_TE) return;
+	if (I2S1_RCSR & I2S_RCSR_RE) return;
+//PLL:
+	int fs = AUDIO_SAMPLE_RATE_EXACT;
+	// PLL between 27*24 = 648MHz und 54*24=1296MHz
+	int n1 = 4; //SAI prescaler 4 => (n1*n2) = multiple of 4
+	int n2 = 1 + (24000000 * 27) / (fs * 256 * n1);
+
+	double C = ((double)fs * 256 * n1 * n2) / 24000000;
+	int c0 = C;
+	int c2 = 10000;
+	int c1 = C * c2 - (c0 * c2);
+	set_audioClock(c0, c1, c2);
+	// clear SAI1_CLK register locations
+	CCM_CSCMR1 = (CCM_CSCMR1 & ~(CCM_CSCMR1_SAI1_CLK_SEL_MASK))
+		   | CCM_CSCMR1_SAI1_CLK_SEL(2); // &0x03 // (0,1,2): PLL3PFD0, PLL5, PLL4
+	n1 = n1 / 2; //Double Speed for TDM
+	CCM_CS1CDR = (CCM_CS1CDR & ~(CCM_CS1CDR_SAI1_CLK_PRED_MASK | CCM_CS1CDR_SAI1_CLK_PODF_MASK))
+		   | CCM_CS1CDR_SAI1_CLK_PRED(n1-1) // &0x07
+		   | CCM_CS1CDR_SAI1_CLK_PODF(n2-1); // &0x3f
+
+	IOMUXC_GPR_GPR1 = (IOMUXC_GPR_GPR1 & ~(IOMUXC_GPR_GPR1_SAI1_MCLK1_SEL_MASK))
+			| (IOMUXC_GPR_GPR1_SAI1_MCLK_DIR | IOMUXC_GPR_GPR1_SAI1_MCLK1_SEL(0));	//Select MCLK
+
+	// configure transmitter
+	int rsync = 0;
+	int tsync = 1;
+
+	I2S1_TMR = 0;
+	I2S1_TCR1 = I2S_TCR1_RFW(4);
+	I2S1_TCR2 = I2S_TCR2_SYNC(tsync) | I2S_TCR2_BCP | I2S_TCR2_MSEL(1)
+		| I2S_TCR2_BCD | I2S_TCR2_DIV(0);
+	I2S1_TCR4 = I2S_TCR4_FRSZ(TDM_WORDS_PER_FRAME-1) | I2S_TCR4_SYWD(0) | I2S_TCR4_MF
+		| I2S_TCR4_FSE | I2S_TCR4_FSD;
+	I2S1_TCR5 = I2S_TCR5_WNW(31) | I2S_TCR5_W0W(31) | I2S_TCR5_FBT(31);
+
+	I2S1_RMR = 0;
+	I2S1_RCR1 = I2S_RCR1_RFW(4);
+	I2S1_RCR2 = I2S_RCR2_SYNC(rsync) | I2S_TCR2_BCP | I2S_RCR2_MSEL(1)
+		| I2S_RCR2_BCD | I2S_RCR2_DIV(0);
+	I2S1_RCR3 = I2S_RCR3_RCE;
+	I2S1_RCR4 = I2S_RCR4_FRSZ(TDM_WORDS_PER_FRAME-1) | I2S_RCR4_SYWD(0) | I2S_RCR4_MF
+		| I2S_RCR4_FSE | I2S_RCR4_FSD;
+	I2S1_RCR5 = I2S_RCR5_WNW(31) | I2S_RCR5_W0W(31) | I2S_RCR5_FBT(31);
+
+	CORE_PIN23_CONFIG = 3;  //1:MCLK
+	CORE_PIN21_CONFIG = 3;  //1:RX_BCLK
+	CORE_PIN20_CONFIG = 3;  //1:RX_SYNC
+}
+
+#endif
@@ -0,0 +1,85 @@
+/* Audio Library for Teensy 3.X
+ * Copyright (c) 2017, Paul Stoffregen, paul@pjrc.com
+ * Modified to receive only selected slots
+ *
+ * Development of this audio library was funded by PJRC.COM, LLC by sales of
+ * Teensy and Audio Adaptor boards.  Please support PJRC's efforts to develop
+ * open source software by purchasing Teensy or other PJRC products.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice, development funding notice, and this permission
+ * notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef AudioInputTDM_Sparse_h_
+#define AudioInputTDM_Sparse_h_
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <DMAChannel.h>
+#include <audio_memory.h>
+
+// TDM receiver for the master that handles only the slots it is asked
+// for.  The wire format and clocking are those of AudioInputTDM: SAI1 is
+// the clock master, 16 slots of 16 bits arrive on RXD0 (pin 8) in a
+// 256-bit frame.  Output n is still slot n, so it drops in for
+// AudioInputTDM without renumbering any AudioConnection.
+//
+// Only slots set in the mask get a block allocated, deinterleaved and
+// transmitted each period; the other outputs never transmit.  With four
+// slots in use this takes 4 blocks from the pool per period instead of 16,
+// and the ISR skips the word columns no masked slot lives in.
+//
+// The mask is normally fixed by the constructor.  slots() changes it at
+// runtime; update() picks the new mask up when it allocates the next
+// period's blocks, so the ISR never sees a half-applied change.
+//
+// Teensy 4 only.
+class AudioInputTDM_Sparse : public AudioStream, public AudioMemoryUser
+{
+public:
+	static const unsigned int channels = 16;
+
+	AudioInputTDM_Sparse(uint16_t mask = 0xFFFF) : AudioStream(0, NULL) {
+		slot_mask = mask;
+		begin();
+	}
+	virtual void update(void);
+	void begin(void);
+	// bit n set delivers slot n
+	static void slots(uint16_t mask) { slot_mask = mask; }
+	static uint16_t slots(void) { return slot_mask; }
+	// a period's blocks being filled plus the last period's, held until
+	// transmitted, for the slots in the mask; widen the mask before
+	// AudioMemoryAuto() if it will be widened at all
+	virtual unsigned int memoryBlocks(void) {
+		return 2 * __builtin_popcount(slot_mask) + numConnections;
+	}
+protected:
+	static void config_tdm(void);
+	static bool update_responsibility;
+	static DMAChannel dma;
+	static void isr(void);
+private:
+	// block_incoming[] and incoming_mask are swapped together by update()
+	// with interrupts masked; the ISR fills the slots in incoming_mask
+	static audio_block_t *block_incoming[channels];
+	static uint16_t incoming_mask;
+	static volatile uint16_t slot_mask;
+};
+
+#endif
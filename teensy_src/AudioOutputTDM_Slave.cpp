@@ -31,26 +31,56 @@
 
 #include "AudioOutputTDM_Slave.h"
 #include "memcpy_audio.h"
+#include "tdm_pack.h"
+#include "tdm_status.h"
+#include "audio_profile.h"
+#include "audio_dma_mem.h"
 #include "utility/imxrt_hw.h"
 
-audio_block_t * AudioOutputTDM_Slave::block_input[16] = {
-	nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
-	nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr
-};
-bool AudioOutputTDM_Slave::update_responsibility = false;
-DMAChannel AudioOutputTDM_Slave::dma(false);
+#define TDM_SLAVE_TEMPLATE template <unsigned int Slots, unsigned int SlotBits, unsigned int QueueDepth, unsigned int Lanes>
+#define TDM_SLAVE AudioOutputTDM_SlaveT<Slots, SlotBits, QueueDepth, Lanes>
+
+TDM_SLAVE_TEMPLATE audio_block_t * volatile TDM_SLAVE::queue[Slots][queue_size];
+TDM_SLAVE_TEMPLATE volatile uint8_t TDM_SLAVE::queue_head[Slots];
+TDM_SLAVE_TEMPLATE volatile uint8_t TDM_SLAVE::queue_tail[Slots];
+TDM_SLAVE_TEMPLATE uint32_t TDM_SLAVE::primed_slots = 0;
+TDM_SLAVE_TEMPLATE volatile uint32_t TDM_SLAVE::underrun_count = 0;
+TDM_SLAVE_TEMPLATE volatile uint32_t TDM_SLAVE::overrun_count = 0;
+TDM_SLAVE_TEMPLATE uint32_t TDM_SLAVE::active_slots = 0;
+TDM_SLAVE_TEMPLATE volatile uint8_t TDM_SLAVE::status_slot = TDM_SLAVE::NO_STATUS_SLOT;
+TDM_SLAVE_TEMPLATE uint32_t TDM_SLAVE::status_sequence = 0;
+TDM_SLAVE_TEMPLATE audio_block_t TDM_SLAVE::status_block;
+TDM_SLAVE_TEMPLATE uint32_t TDM_SLAVE::written_columns[dma_buffers];
+TDM_SLAVE_TEMPLATE uint8_t TDM_SLAVE::slot_offset = 0;
+TDM_SLAVE_TEMPLATE uint32_t TDM_SLAVE::passthrough_slots = 0;
+TDM_SLAVE_TEMPLATE uint32_t TDM_SLAVE::passthrough_columns = 0;
+TDM_SLAVE_TEMPLATE tdm_passthrough_t TDM_SLAVE::passthrough_target;
+TDM_SLAVE_TEMPLATE bool TDM_SLAVE::update_responsibility = false;
+TDM_SLAVE_TEMPLATE DMAChannel TDM_SLAVE::dma(false);
+TDM_SLAVE_TEMPLATE DMASetting TDM_SLAVE::dma_ring[dma_buffers];
 DMAMEM __attribute__((aligned(32)))
 static uint32_t zeros[AUDIO_BLOCK_SAMPLES/2];
-DMAMEM __attribute__((aligned(32)))
-static uint32_t tdm_tx_buffer[AUDIO_BLOCK_SAMPLES*16];
 
-void AudioOutputTDM_Slave::begin(void)
+TDM_SLAVE_TEMPLATE
+void TDM_SLAVE::begin(void)
 {
 	dma.begin(true);
 
-	for (int i=0; i < 16; i++) {
-		block_input[i] = nullptr;
+	for (unsigned int i=0; i < Slots; i++) {
+		queue_head[i] = 0;
+		queue_tail[i] = 0;
+	}
+	primed_slots = 0;
+	underrun_count = 0;
+	overrun_count = 0;
+	active_slots = 0;
+	status_sequence = 0;
+	memset(status_block.data, 0, sizeof(status_block.data));
+	for (unsigned int i=0; i < dma_buffers; i++) {
+		written_columns[i] = 0;
 	}
+	passthrough_slots = 0;
+	passthrough_columns = 0;
 	memset(zeros, 0, sizeof(zeros));
 	memset(tdm_tx_buffer, 0, sizeof(tdm_tx_buffer));
 
@@ -58,17 +88,7 @@ void AudioOutputTDM_Slave::begin(void)
 #if defined(KINETISK)
 	CORE_PIN22_CONFIG = PORT_PCR_MUX(6);
 
-	dma.TCD->SADDR = tdm_tx_buffer;
-	dma.TCD->SOFF = 4;
-	dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
-	dma.TCD->NBYTES_MLNO = 4;
-	dma.TCD->SLAST = -sizeof(tdm_tx_buffer);
-	dma.TCD->DADDR = &I2S0_TDR0;
-	dma.TCD->DOFF = 0;
-	dma.TCD->CITER_ELINKNO = sizeof(tdm_tx_buffer) / 4;
-	dma.TCD->DLASTSGA = 0;
-	dma.TCD->BITER_ELINKNO = sizeof(tdm_tx_buffer) / 4;
-	dma.TCD->CSR = DMA_TCD_CSR_INTHALF | DMA_TCD_CSR_INTMAJOR;
+	config_dma_ring(&I2S0_TDR0);
 	dma.triggerAtHardwareEvent(DMAMUX_SOURCE_I2S0_TX);
 
 	update_responsibility = update_setup();
@@ -78,18 +98,13 @@ void AudioOutputTDM_Slave::begin(void)
 	I2S0_TCSR = I2S_TCSR_TE | I2S_TCSR_BCE | I2S_TCSR_FRDE;
 #elif defined(__IMXRT1062__)
 	CORE_PIN7_CONFIG  = 3;
+	if (Lanes > 1) CORE_PIN32_CONFIG = 3;
+	if (Lanes > 2) CORE_PIN9_CONFIG  = 3;
+	if (Lanes > 3) CORE_PIN6_CONFIG  = 3;
+	// set even when another object configured SAI1 first
+	I2S1_TCR3 = I2S_TCR3_TCE * ((1u << Lanes) - 1);
 
-	dma.TCD->SADDR = tdm_tx_buffer;
-	dma.TCD->SOFF = 4;
-	dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
-	dma.TCD->NBYTES_MLNO = 4;
-	dma.TCD->SLAST = -sizeof(tdm_tx_buffer);
-	dma.TCD->DADDR = &I2S1_TDR0;
-	dma.TCD->DOFF = 0;
-	dma.TCD->CITER_ELINKNO = sizeof(tdm_tx_buffer) / 4;
-	dma.TCD->DLASTSGA = 0;
-	dma.TCD->BITER_ELINKNO = sizeof(tdm_tx_buffer) / 4;
-	dma.TCD->CSR = DMA_TCD_CSR_INTHALF | DMA_TCD_CSR_INTMAJOR;
+	config_dma_ring(&I2S1_TDR0);
 	dma.triggerAtHardwareEvent(DMAMUX_SOURCE_SAI1_TX);
 
 	update_responsibility = update_setup();
@@ -102,88 +117,257 @@ void AudioOutputTDM_Slave::begin(void)
 	dma.attachInterrupt(isr);
 }
 
-static void memcpy_tdm_tx(uint32_t *dest, const uint32_t *src1, const uint32_t *src2)
+// One TCD per DMA buffer, each interrupting at completion and loading the
+// next, so the channel cycles through the whole buffer indefinitely.  With
+// several lanes each minor loop steps the destination across TDR0..n and
+// the minor loop offset brings it back to TDR0.
+TDM_SLAVE_TEMPLATE
+void TDM_SLAVE::config_dma_ring(volatile void *tdr)
+{
+	for (unsigned int i=0; i < dma_buffers; i++) {
+		DMASetting &s = dma_ring[i];
+		s.TCD->SADDR = tdm_tx_buffer + i * segment_words;
+		s.TCD->SOFF = 4;
+		s.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+		if (Lanes == 1) {
+			s.TCD->NBYTES_MLNO = 4;
+			s.TCD->DOFF = 0;
+		} else {
+			s.TCD->NBYTES_MLOFFYES = DMA_TCD_NBYTES_DMLOE |
+				DMA_TCD_NBYTES_MLOFFYES_MLOFF(-4 * (int32_t)Lanes) |
+				DMA_TCD_NBYTES_MLOFFYES_NBYTES(4 * Lanes);
+			s.TCD->DOFF = 4;
+		}
+		s.TCD->SLAST = 0;
+		s.TCD->DADDR = tdr;
+		s.TCD->CITER_ELINKNO = segment_words / Lanes;
+		s.TCD->BITER_ELINKNO = segment_words / Lanes;
+		s.TCD->CSR = 0;
+		s.replaceSettingsOnCompletion(dma_ring[(i + 1) % dma_buffers]);
+		s.interruptAtCompletion();
+	}
+	dma = dma_ring[0];
+}
+
+// Silence one word column of a DMA buffer.
+template <unsigned int Stride>
+static void memset_tdm_tx_column(uint32_t *dest)
 {
-	uint32_t i, in1, in2, out1, out2;
+	uint32_t i;
 
 	for (i=0; i < AUDIO_BLOCK_SAMPLES/4; i++) {
+		*dest = 0;
+		*(dest + Stride) = 0;
+		*(dest + Stride*2) = 0;
+		*(dest + Stride*3) = 0;
+		dest += Stride*4;
+	}
+}
 
-		in1 = *src1++;
-		in2 = *src2++;
-		out1 = (in1 << 16) | (in2 & 0xFFFF);
-		out2 = (in1 & 0xFFFF0000) | (in2 >> 16);
-		*dest = out1;
-		*(dest + 8) = out2;
-
-		in1 = *src1++;
-		in2 = *src2++;
-		out1 = (in1 << 16) | (in2 & 0xFFFF);
-		out2 = (in1 & 0xFFFF0000) | (in2 >> 16);
-		*(dest + 16)= out1;
-		*(dest + 24) = out2;
-
-		dest += 32;
+TDM_SLAVE_TEMPLATE
+const tdm_passthrough_t * TDM_SLAVE::passthroughTarget(unsigned int first, unsigned int count,
+	unsigned int upstream_lanes)
+{
+	tdm_passthrough_t *t = &passthrough_target;
+	uint32_t slots, columns = 0;
+	unsigned int n;
+
+	first += slot_offset;
+	if ((first & 1) || (count & 1) || count == 0) return nullptr;
+	if (count > TDM_PASSTHROUGH_MAX_CHANNELS || first + count > Slots) return nullptr;
+	if (upstream_lanes > TDM_PASSTHROUGH_MAX_RELAY_LANES) return nullptr;
+	t->buffer = tdm_tx_buffer;
+	t->frames = dma_buffers * AUDIO_BLOCK_SAMPLES;
+	t->stride = words_per_sample;
+	t->wide = (SlotBits == 32);
+	slots = ((1u << count) - 1) << first;
+	for (unsigned int i=0; i < count; i++) {
+		t->column[i] = column(first + i);
+		columns |= 1u << t->column[i];
+	}
+	// the slots below the offset come word for word from the same lane
+	// and word of the upstream board's frame
+	for (unsigned int lane=0; lane < TDM_PASSTHROUGH_MAX_RELAY_LANES; lane++) {
+		for (unsigned int w=0; w < 2; w++) {
+			n = lane * slots_per_lane + (SlotBits == 16 ? w * 2 : w);
+			if (lane >= upstream_lanes || lane >= Lanes || words_per_frame != 2
+			  || n >= slot_offset) {
+				t->relay_column[lane][w] = TDM_PASSTHROUGH_NONE;
+				continue;
+			}
+			t->relay_column[lane][w] = column(n);
+			columns |= 1u << column(n);
+			slots |= (SlotBits == 16 ? 3u : 1u) << n;
+		}
 	}
+	t->position = passthrough_position;
+	__disable_irq();
+	passthrough_slots = slots;
+	passthrough_columns = columns;
+	__enable_irq();
+	return t;
+}
+
+// The frame the DMA reads next.  The writer stays ahead of it; anything
+// behind may already be in the FIFO.
+TDM_SLAVE_TEMPLATE
+unsigned int TDM_SLAVE::passthrough_position(void)
+{
+	uintptr_t saddr = (uintptr_t)(dma.TCD->SADDR);
+	unsigned int frame = (saddr - (uintptr_t)tdm_tx_buffer) / (words_per_sample * 4);
+
+	return (frame < dma_buffers * AUDIO_BLOCK_SAMPLES) ? frame : 0;
 }
 
-void AudioOutputTDM_Slave::isr(void)
+// Blocks waiting in a slot's ring.
+TDM_SLAVE_TEMPLATE
+unsigned int TDM_SLAVE::queued(unsigned int slot)
 {
+	unsigned int head = queue_head[slot];
+	unsigned int tail = queue_tail[slot];
+
+	return (head >= tail) ? head - tail : head + queue_size - tail;
+}
+
+TDM_SLAVE_TEMPLATE
+void TDM_SLAVE::isr(void)
+{
+	audio_block_t *block[Slots];
 	uint32_t *dest;
 	const uint32_t *src1, *src2;
-	uint32_t i, saddr;
+	uint32_t i, c, t, n, bit, current, segment, live, columns, stale, touched;
+	uint32_t status = status_slot;
+	uintptr_t saddr;
+	AudioProfileScope profile(&audio_profile_tdm_isr);
 
 #if defined(KINETISK) || defined(__IMXRT1062__)
-	saddr = (uint32_t)(dma.TCD->SADDR);
+	saddr = (uintptr_t)(dma.TCD->SADDR);
 #endif
 	dma.clearInterrupt();
-	if (saddr < (uint32_t)tdm_tx_buffer + sizeof(tdm_tx_buffer) / 2) {
-		dest = tdm_tx_buffer + AUDIO_BLOCK_SAMPLES*8;
-	} else {
-		dest = tdm_tx_buffer;
-	}
+	// the DMA has just moved on to buffer 'current'; refill the one it
+	// left, which is now the furthest ahead of it
+	current = (saddr - (uintptr_t)tdm_tx_buffer) / (segment_words * 4);
+	if (current >= dma_buffers) current = 0;
+	segment = (current == 0 ? dma_buffers : current) - 1;
+	dest = tdm_tx_buffer + segment * segment_words;
 	if (update_responsibility) AudioStream::update_all();
 
-	#if IMXRT_CACHE_ENABLED >= 2
-	uint32_t *dc = dest;
-	#endif
-
-	for (i=0; i < 16; i += 2) {
-		src1 = block_input[i] ? (uint32_t *)(block_input[i]->data) : zeros;
-		src2 = block_input[i+1] ? (uint32_t *)(block_input[i+1]->data) : zeros;
-		memcpy_tdm_tx(dest, src1, src2);
-		dest++;
+	// take this period's block from each primed input, and note the word
+	// columns holding live audio and the columns of this buffer that still
+	// hold audio from an earlier one.  block[] and live are indexed by
+	// slot, the queues by input (slot - slot_offset)
+	live = 0;
+	columns = 0;
+	for (i=0; i < Slots; i++) {
+		block[i] = nullptr;
+	}
+	if (status < Slots && !(passthrough_slots & (1u << status))) {
+		tdm_status_fill(status_block.data, status_sequence++,
+			underrun_count, overrun_count, latency_samples);
+		block[status] = &status_block;
+		live |= 1u << status;
+		columns |= 1u << column(status);
+	}
+	for (i=0; i < Slots - slot_offset; i++) {
+		n = i + slot_offset;
+		bit = 1u << i;
+		if ((passthrough_slots & (1u << n)) || n == status) {
+			// drop anything queued before the slot was handed over to a
+			// pass-through writer or the status packet
+			primed_slots &= ~bit;
+			for (t = queue_tail[i]; t != queue_head[i]; queue_tail[i] = t) {
+				if (++t >= queue_size) t = 0;
+				release(queue[i][t]);
+			}
+			continue;
+		}
+		if (!(primed_slots & bit)) {
+			if (queued(i) < QueueDepth) continue;
+			primed_slots |= bit;
+		}
+		t = queue_tail[i];
+		if (t == queue_head[i]) {
+			underrun_count++;
+			primed_slots &= ~bit;
+			continue;
+		}
+		if (++t >= queue_size) t = 0;
+		// update() never writes the entry at the tail, so the block stays
+		// valid until it is released below
+		block[n] = queue[i][t];
+		queue_tail[i] = t;
+		live |= 1u << n;
+		columns |= 1u << column(n);
+	}
+	active_slots = live;
+	stale = written_columns[segment] & ~columns & ~passthrough_columns;
+	written_columns[segment] = columns;
+	touched = columns | stale;
+
+	while (columns) {
+		i = __builtin_ctz(columns);
+		columns &= columns - 1;
+		c = first_channel(i);
+		if (SlotBits == 16) {
+			src1 = block[c] ? (uint32_t *)(block[c]->data) : zeros;
+			src2 = block[c+1] ? (uint32_t *)(block[c+1]->data) : zeros;
+			tdm_pack_pair<words_per_sample>(dest + i, src1, src2);
+		} else {
+			src1 = (uint32_t *)(block[c]->data);
+			tdm_pack_single<words_per_sample>(dest + i, src1);
+		}
+	}
+	while (stale) {
+		i = __builtin_ctz(stale);
+		stale &= stale - 1;
+		memset_tdm_tx_column<words_per_sample>(dest + i);
 	}
 
 	#if IMXRT_CACHE_ENABLED >= 2
-	arm_dcache_flush_delete(dc, sizeof(tdm_tx_buffer) / 2 );
+	if (touched) audio_dma_flush_delete(dest, segment_words * 4);
 	#endif
 
-	for (i=0; i < 16; i++) {
-		if (block_input[i]) {
-			release(block_input[i]);
-			block_input[i] = nullptr;
-		}
+	for (i=0; i < Slots; i++) {
+		if (block[i] && block[i] != &status_block) release(block[i]);
 	}
 }
 
-void AudioOutputTDM_Slave::update(void)
+TDM_SLAVE_TEMPLATE
+void TDM_SLAVE::update(void)
 {
-	audio_block_t *prev[16];
-	unsigned int i;
-
-	__disable_irq();
-	for (i=0; i < 16; i++) {
-		prev[i] = block_input[i];
-		block_input[i] = receiveReadOnly(i);
-	}
-	__enable_irq();
-	for (i=0; i < 16; i++) {
-		if (prev[i]) release(prev[i]);
+	audio_block_t *block;
+	unsigned int i, n, h;
+
+	for (i=0; i < Slots; i++) {
+		block = receiveReadOnly(i);
+		if (!block) continue;
+		n = i + slot_offset;
+		if (n >= Slots || n == status_slot || (passthrough_slots & (1u << n))) {
+			release(block);
+			continue;
+		}
+		h = queue_head[i] + 1;
+		if (h >= queue_size) h = 0;
+		if (h == queue_tail[i]) {
+			overrun_count++;
+			release(block);
+			continue;
+		}
+		// the entry is stored before the head moves, so the ISR never
+		// sees a slot it cannot read
+		queue[i][h] = block;
+		queue_head[i] = h;
 	}
 }
 
-void AudioOutputTDM_Slave::config_tdm_slave(void)
+// A two word frame is I2S framing from a master that also clocks I2S
+// microphones on the same BCLK (AudioInputI2SQuadTDM): LRCLK low starts
+// the frame, so the sync is active low.
+TDM_SLAVE_TEMPLATE
+void TDM_SLAVE::config_tdm_slave(void)
 {
+	const uint32_t fsp = (words_per_frame == 2) ? I2S_TCR4_FSP : 0;
+
 #if defined(KINETISK)
 	SIM_SCGC6 |= SIM_SCGC6_I2S;
 	SIM_SCGC7 |= SIM_SCGC7_DMA;
@@ -196,14 +380,14 @@ void AudioOutputTDM_Slave::config_tdm_slave(void)
 	I2S0_TCR1 = I2S_TCR1_TFW(4);
 	I2S0_TCR2 = I2S_TCR2_SYNC(0) | I2S_TCR2_BCP;
 	I2S0_TCR3 = I2S_TCR3_TCE;
-	I2S0_TCR4 = I2S_TCR4_FRSZ(15) | I2S_TCR4_SYWD(31) | I2S_TCR4_MF | I2S_TCR4_FSE;
+	I2S0_TCR4 = I2S_TCR4_FRSZ(words_per_frame-1) | I2S_TCR4_SYWD(31) | I2S_TCR4_MF | I2S_TCR4_FSE | fsp;
 	I2S0_TCR5 = I2S_TCR5_WNW(31) | I2S_TCR5_W0W(31) | I2S_TCR5_FBT(31);
 
 	I2S0_RMR = 0;
 	I2S0_RCR1 = I2S_RCR1_RFW(4);
 	I2S0_RCR2 = I2S_RCR2_SYNC(1) | I2S_TCR2_BCP;
 	I2S0_RCR3 = I2S_RCR3_RCE;
-	I2S0_RCR4 = I2S_RCR4_FRSZ(15) | I2S_RCR4_SYWD(31) | I2S_RCR4_MF | I2S_RCR4_FSE;
+	I2S0_RCR4 = I2S_RCR4_FRSZ(words_per_frame-1) | I2S_RCR4_SYWD(31) | I2S_RCR4_MF | I2S_RCR4_FSE | fsp;
 	I2S0_RCR5 = I2S_RCR5_WNW(31) | I2S_RCR5_W0W(31) | I2S_RCR5_FBT(31);
 
 #elif defined(__IMXRT1062__)
@@ -212,18 +396,19 @@ void AudioOutputTDM_Slave::config_tdm_slave(void)
 	if (I2S1_TCSR & I2S_TCSR_TE) return;
 	if (I2S1_RCSR & I2S_RCSR_RE) return;
 
+	// the master's clocks arrive on the receiver's pins (21, 20), so the
+	// receiver runs from them and the transmitter is synchronous to it
 	I2S1_TMR = 0;
 	I2S1_TCR1 = I2S_TCR1_RFW(4);
-	I2S1_TCR2 = I2S_TCR2_SYNC(0) | I2S_TCR2_BCP;
-	I2S1_TCR3 = I2S_TCR3_TCE;
-	I2S1_TCR4 = I2S_TCR4_FRSZ(15) | I2S_TCR4_SYWD(31) | I2S_TCR4_MF | I2S_TCR4_FSE;
+	I2S1_TCR2 = I2S_TCR2_SYNC(1) | I2S_TCR2_BCP;
+	I2S1_TCR4 = I2S_TCR4_FRSZ(words_per_frame-1) | I2S_TCR4_SYWD(31) | I2S_TCR4_MF | I2S_TCR4_FSE | fsp;
 	I2S1_TCR5 = I2S_TCR5_WNW(31) | I2S_TCR5_W0W(31) | I2S_TCR5_FBT(31);
 
 	I2S1_RMR = 0;
 	I2S1_RCR1 = I2S_RCR1_RFW(4);
-	I2S1_RCR2 = I2S_RCR2_SYNC(1) | I2S_TCR2_BCP;
+	I2S1_RCR2 = I2S_RCR2_SYNC(0) | I2S_TCR2_BCP;
 	I2S1_RCR3 = I2S_RCR3_RCE;
-	I2S1_RCR4 = I2S_RCR4_FRSZ(15) | I2S_RCR4_SYWD(31) | I2S_RCR4_MF | I2S_RCR4_FSE;
+	I2S1_RCR4 = I2S_RCR4_FRSZ(words_per_frame-1) | I2S_RCR4_SYWD(31) | I2S_RCR4_MF | I2S_RCR4_FSE | fsp;
 	I2S1_RCR5 = I2S_RCR5_WNW(31) | I2S_RCR5_W0W(31) | I2S_RCR5_FBT(31);
 
 	CORE_PIN21_CONFIG = 3;
@@ -231,4 +416,27 @@ void AudioOutputTDM_Slave::config_tdm_slave(void)
 #endif
 }
 
-#endif
\ No newline at end of file
+// Each layout gets its own DMA buffer.  These are explicit specializations
+// rather than part of the template because GCC drops the DMAMEM section
+// attribute from implicitly instantiated static members.
+#define TDM_SLAVE_INSTANTIATE(S, B, D, L) \
+	template <> AUDIO_DMA_MEM __attribute__((aligned(32))) \
+	uint32_t AudioOutputTDM_SlaveT<S, B, D, L>::tdm_tx_buffer[AudioOutputTDM_SlaveT<S, B, D, L>::buffer_words] = {}; \
+	template class AudioOutputTDM_SlaveT<S, B, D, L>;
+
+TDM_SLAVE_INSTANTIATE(16, 16, 1, 1)
+TDM_SLAVE_INSTANTIATE(16, 16, 2, 1)
+TDM_SLAVE_INSTANTIATE(16, 16, 4, 1)
+TDM_SLAVE_INSTANTIATE(16, 32, 2, 1)
+TDM_SLAVE_INSTANTIATE(8, 32, 2, 1)
+TDM_SLAVE_INSTANTIATE(8, 16, 2, 1)
+TDM_SLAVE_INSTANTIATE(4, 16, 2, 1)
+#if defined(__IMXRT1062__)
+TDM_SLAVE_INSTANTIATE(16, 32, 2, 2)
+TDM_SLAVE_INSTANTIATE(8, 16, 2, 2)
+TDM_SLAVE_INSTANTIATE(4, 32, 2, 2)
+TDM_SLAVE_INSTANTIATE(16, 32, 2, 4)
+TDM_SLAVE_INSTANTIATE(24, 32, 2, 4)
+#endif
+
+#endif
@@ -31,21 +31,176 @@
 #include <Arduino.h>
 #include <AudioStream.h>
 #include <DMAChannel.h>
+#include <audio_memory.h>
+#include "tdm_passthrough.h"
 
-class AudioOutputTDM_Slave : public AudioStream
+// Number of DMA buffers, each one audio block of frames, chained as a
+// scatter/gather ring.  Each one the DMA leaves is refilled straight away,
+// so the ISR has TDM_SLAVE_DMA_BUFFERS-1 block periods of slack, at the cost
+// of as many blocks of latency.
+#ifndef TDM_SLAVE_DMA_BUFFERS
+#define TDM_SLAVE_DMA_BUFFERS 2
+#endif
+
+// TDM transmitter clocked by an external BCLK/LRCLK.  Slots is the number
+// of channels (AudioStream inputs) in each frame and SlotBits their width
+// on the wire.  16-bit slots are packed in pairs into 32-bit SAI words,
+// which is bit-identical on the wire to two 16-bit slots; 32-bit slots
+// carry the sample in the upper half.  The SAI frame size, DMA buffer and
+// packing loop all follow from the two parameters.
+//
+// Lanes spreads the slots over that many SAI1 transmit data pins (TXD0-3
+// on pins 7, 32, 9 and 6): channel n goes out on lane n / (Slots/Lanes),
+// and each lane carries a frame 1/Lanes as long, so the master's BCLK
+// drops by the same factor.  The DMA writes one word to every lane's FIFO
+// per minor loop, so the buffer interleaves the lanes word by word.
+//
+// Only slots that delivered a block are packed each period; a slot that
+// stops receiving blocks has its column zeroed once per DMA buffer and is
+// then skipped, so ISR cost follows the number of connected channels.
+//
+// Blocks pass from update() to the DMA ISR through a single-producer,
+// single-consumer ring per slot, so neither side masks interrupts.  A slot
+// starts playing once QueueDepth blocks are queued, which adds QueueDepth-1
+// blocks of latency and lets the ISR ride out an update() that finishes
+// after the next DMA interrupt.  The ring has one spare entry, so the
+// catch-up update() that follows is queued rather than dropped.  A slot
+// whose ring runs dry counts an underrun and primes again; a block arriving
+// at a full ring is released and counts an overrun.
+//
+// statusSlot() gives one otherwise unused slot over to an in-band status
+// packet (tdm_status.h): a per-block sequence number, the queue counters
+// and the transmit latency, which the master checks with
+// AudioAnalyzeTDMStatus.
+//
+// passthroughTarget() reserves a run of slots for an input on the same
+// SAI1 that writes its DMA data straight into the transmit buffer a few
+// frames ahead of the DMA (tdm_passthrough.h).  The ISR leaves those
+// columns alone and update() releases blocks sent to them.
+//
+// Slaves can be daisy-chained, each passing on the frame of the one
+// before it with its own channels added.  The constructor's slot_offset
+// moves this board's channels up: input n (and pass-through channel n)
+// goes out in slot slot_offset + n.  The slots below the offset are
+// relayed word for word from upstream lanes, received with
+// AudioInputI2SSlaveT's Upstream lanes: lane k of the upstream board's
+// frame arrives on one of them and leaves on lane k here, a few frames
+// later.  Only two word (I2S) frames can be relayed, as the receiver
+// shares SAI1 with the microphones; the offset must be even with 16-bit
+// slots and is ignored otherwise.  statusSlot() is not offset.
+//
+// Layouts are explicitly instantiated in AudioOutputTDM_Slave.cpp, each
+// with its own DMAMEM buffer; add a line there to use another one.
+template <unsigned int Slots, unsigned int SlotBits, unsigned int QueueDepth = 2, unsigned int Lanes = 1>
+class AudioOutputTDM_SlaveT : public AudioStream, public AudioMemoryUser
 {
+	static_assert(SlotBits == 16 || SlotBits == 32, "TDM slots must be 16 or 32 bits");
+	static_assert(Slots >= 2 && Slots <= 32 && (Slots % 2) == 0, "TDM slot count must be even, 2 to 32");
+	static_assert(Lanes >= 1 && Lanes <= 4 && (Slots % (Lanes * 2)) == 0, "TDM lanes must be 1 to 4, each with an even slot count");
+	static_assert(Slots * SlotBits <= Lanes * 32 * 32, "SAI frames are limited to 32 words");
+#if defined(KINETISK)
+	static_assert(Lanes == 1, "multi-lane TDM is only supported on Teensy 4");
+#endif
+	static_assert(QueueDepth >= 1 && QueueDepth <= 16, "TDM queue depth must be 1 to 16 blocks");
+	static_assert(TDM_SLAVE_DMA_BUFFERS >= 2 && TDM_SLAVE_DMA_BUFFERS <= 16, "TDM_SLAVE_DMA_BUFFERS must be 2 to 16");
 public:
-	AudioOutputTDM_Slave(void) : AudioStream(16, inputQueueArray) { begin(); }
+	static const unsigned int slots = Slots;
+	static const unsigned int slot_bits = SlotBits;
+	static const unsigned int queue_depth = QueueDepth;
+	static const unsigned int lanes = Lanes;
+	static const unsigned int slots_per_lane = Slots / Lanes;
+	// SAI frame length on each lane, and buffer words per sample period
+	static const unsigned int words_per_frame = slots_per_lane * SlotBits / 32;
+	static const unsigned int words_per_sample = words_per_frame * Lanes;
+	static const unsigned int dma_buffers = TDM_SLAVE_DMA_BUFFERS;
+	static const unsigned int segment_words = AUDIO_BLOCK_SAMPLES * words_per_sample;
+	static const unsigned int buffer_words = segment_words * dma_buffers;
+
+	AudioOutputTDM_SlaveT(unsigned int offset = 0) : AudioStream(Slots, inputQueueArray) {
+		slot_offset = (offset < Slots && (SlotBits == 32 || !(offset & 1))) ? offset : 0;
+		begin();
+	}
 	virtual void update(void);
 	void begin(void);
+	// bit n set when slot n carried audio in the most recent period
+	static uint32_t activeSlots(void) { return active_slots; }
+	// periods in which a playing slot had no block queued, and blocks
+	// dropped because a slot's ring was full, summed over all slots
+	static uint32_t underruns(void) { return underrun_count; }
+	static uint32_t overruns(void) { return overrun_count; }
+	// carry the status packet in this slot instead of audio; -1 disables
+	static void statusSlot(int slot) { status_slot = (slot >= 0 && slot < (int)Slots) ? slot : NO_STATUS_SLOT; }
+	// samples from update() until the block reaches the wire
+	static const unsigned int latency_samples = (QueueDepth + dma_buffers) * AUDIO_BLOCK_SAMPLES;
+	// hand channels first to first+count-1 (after the slot offset) to a
+	// pass-through writer, along with the slots relayed from its first
+	// upstream_lanes lanes; first and count must be even.  nullptr if they
+	// do not fit
+	static const tdm_passthrough_t *passthroughTarget(unsigned int first, unsigned int count,
+		unsigned int upstream_lanes = 0);
+	static unsigned int slotOffset(void) { return slot_offset; }
+	// each connected slot's ring, full, plus the block the ISR is reading
+	virtual unsigned int memoryBlocks(void) { return numConnections * (queue_size - 1); }
 protected:
+	static const unsigned int queue_size = QueueDepth + 2;
+	static const uint8_t NO_STATUS_SLOT = 0xFF;
+	// buffer word column carrying channel n (both channels of a pair)
+	static unsigned int column(unsigned int n) {
+		unsigned int slot = n % slots_per_lane;
+		return (SlotBits == 16 ? slot >> 1 : slot) * Lanes + n / slots_per_lane;
+	}
+	// first channel carried by a buffer word column
+	static unsigned int first_channel(unsigned int col) {
+		unsigned int word = col / Lanes;
+		return (col % Lanes) * slots_per_lane + (SlotBits == 16 ? word << 1 : word);
+	}
 	static void config_tdm_slave(void);
-	static audio_block_t *block_input[16];
+	static unsigned int queued(unsigned int slot);
+	// queue[][] and queue_head[] belong to update(), queue_tail[],
+	// primed_slots and underrun_count to the ISR
+	static audio_block_t * volatile queue[Slots][queue_size];
+	static volatile uint8_t queue_head[Slots];
+	static volatile uint8_t queue_tail[Slots];
+	static uint32_t primed_slots;
+	static volatile uint32_t underrun_count;
+	static volatile uint32_t overrun_count;
+	static uint32_t active_slots;
+	static volatile uint8_t status_slot;
+	static uint32_t status_sequence;
+	static audio_block_t status_block;
+	static uint32_t written_columns[dma_buffers];
+	static uint8_t slot_offset;
+	static uint32_t passthrough_slots;
+	static uint32_t passthrough_columns;
+	static tdm_passthrough_t passthrough_target;
+	static unsigned int passthrough_position(void);
 	static bool update_responsibility;
 	static DMAChannel dma;
+	static DMASetting dma_ring[dma_buffers];
+	static void config_dma_ring(volatile void *tdr);
+	static uint32_t tdm_tx_buffer[buffer_words];
 	static void isr(void);
 private:
-	audio_block_t *inputQueueArray[16];
+	audio_block_t *inputQueueArray[Slots];
 };
 
-#endif
\ No newline at end of file
+extern template class AudioOutputTDM_SlaveT<16, 16, 1>;
+extern template class AudioOutputTDM_SlaveT<16, 16, 2>;
+extern template class AudioOutputTDM_SlaveT<16, 16, 4>;
+extern template class AudioOutputTDM_SlaveT<16, 32, 2>;
+extern template class AudioOutputTDM_SlaveT<8, 32, 2>;
+extern template class AudioOutputTDM_SlaveT<8, 16, 2>;
+extern template class AudioOutputTDM_SlaveT<4, 16, 2>;
+#if defined(__IMXRT1062__)
+extern template class AudioOutputTDM_SlaveT<16, 32, 2, 2>;
+extern template class AudioOutputTDM_SlaveT<8, 16, 2, 2>;
+extern template class AudioOutputTDM_SlaveT<4, 32, 2, 2>;
+extern template class AudioOutputTDM_SlaveT<16, 32, 2, 4>;
+extern template class AudioOutputTDM_SlaveT<24, 32, 2, 4>;
+#endif
+
+// Stock layout: 16 channels of 16 bits in a 256-bit frame, the format
+// AudioInputTDM on the master deinterleaves, with a two block queue.
+typedef AudioOutputTDM_SlaveT<16, 16> AudioOutputTDM_Slave;
+
+#endif
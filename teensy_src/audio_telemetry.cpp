@@ -0,0 +1,117 @@
+/* Binary status telemetry, queued in a ring and drained without blocking
+ * See audio_telemetry.h for the frame format.
+ */
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <audio_memory.h>
+#include "audio_telemetry.h"
+
+void AudioTelemetry::put(const void *data, unsigned int n)
+{
+	const uint8_t *p = (const uint8_t *)data;
+
+	while (n--) ring[head++ % TELEMETRY_RING_BYTES] = *p++;
+}
+
+bool AudioTelemetry::frame(uint8_t type, const void *payload, unsigned int length)
+{
+	if (length > TELEMETRY_MAX_PAYLOAD ||
+	  TELEMETRY_RING_BYTES - pending() < length + TELEMETRY_OVERHEAD) {
+		drops++;
+		return false;
+	}
+	uint8_t h[TELEMETRY_HEADER] = {
+		TELEMETRY_SYNC0, TELEMETRY_SYNC1, type, (uint8_t)length, board, sequence++
+	};
+	uint16_t crc = telemetry_crc16(0xFFFF, h + 2, TELEMETRY_HEADER - 2);
+	crc = telemetry_crc16(crc, (const uint8_t *)payload, length);
+	uint8_t c[2] = { (uint8_t)crc, (uint8_t)(crc >> 8) };
+	put(h, sizeof(h));
+	put(payload, length);
+	put(c, sizeof(c));
+	return true;
+}
+
+unsigned int AudioTelemetry::drain(Print &out)
+{
+	unsigned int total = 0;
+
+	// a frame at a time, in two writes where it wraps the ring
+	while (pending()) {
+		int room = out.availableForWrite();
+		if (partial == 0) {
+			// start a frame only if all of it fits, so the port
+			// is never left part way through one
+			unsigned int size = ring[(tail + 3) % TELEMETRY_RING_BYTES] + TELEMETRY_OVERHEAD;
+			if (room < (int)size) break;
+			partial = size;
+		}
+		if (room <= 0) break;
+		unsigned int offset = tail % TELEMETRY_RING_BYTES;
+		unsigned int n = TELEMETRY_RING_BYTES - offset;
+		if (n > partial) n = partial;
+		if (n > (unsigned int)room) n = room;
+		n = out.write(ring + offset, n);
+		if (n == 0) break;
+		tail += n;
+		partial -= n;
+		total += n;
+	}
+	return total;
+}
+
+bool AudioTelemetry::system(void)
+{
+	telemetry_system_t r;
+
+	r.millis = millis();
+	r.cpu = AudioProcessorUsage() * 100.0f + 0.5f;
+	r.cpu_max = AudioProcessorUsageMax() * 100.0f + 0.5f;
+	r.memory = AudioMemoryUsage();
+	r.memory_max = AudioMemoryUsageMax();
+	r.dropped = drops;
+	r.memory_reserved = AudioMemoryReserved();
+	return send(r);
+}
+
+bool AudioTelemetry::profile(uint8_t id, const audio_profile_t *p)
+{
+	audio_profile_t s;
+	telemetry_profile_t r;
+
+	audio_profile_snapshot(p, &s);
+	r.id = id;
+	memset(r.reserved, 0, sizeof(r.reserved));
+	r.count = s.count;
+	r.min = s.count ? s.min : 0;
+	r.mean = audio_profile_mean(&s);
+	r.max = s.max;
+	return send(r);
+}
+
+bool AudioTelemetry::link(AudioAnalyzeTDMStatus &status)
+{
+	telemetry_link_t r;
+
+	r.synced = status.synced();
+	r.reserved = 0;
+	r.underruns = status.slaveUnderruns();
+	r.overruns = status.slaveOverruns();
+	r.latency = status.slaveLatency();
+	r.phase = status.phase();
+	r.reserved2 = 0;
+	r.sequence = status.sequence();
+	r.lost = status.lostBlocks();
+	r.resets = status.resets();
+	r.errors = status.errors();
+	return send(r);
+}
+
+bool AudioTelemetry::passthrough(uint32_t slips)
+{
+	telemetry_passthrough_t r;
+
+	r.slips = slips;
+	return send(r);
+}
@@ -0,0 +1,247 @@
+/* Binary status telemetry, queued in a ring and drained without blocking
+ *
+ * Status records (levels, CPU and memory, ISR profiles, link counters,
+ * slave channel liveness, the USB transmit queue) are framed into a byte
+ * ring from loop(), and drain() writes only the whole frames the port can
+ * take right now (availableForWrite()), so a host that is not reading
+ * never stalls loop(), and text printed to the port between drains falls
+ * between frames.  When the ring is full a new frame is dropped whole and
+ * counted; frames already queued are never cut.
+ *
+ * Frame layout, multi-byte fields little-endian:
+ *
+ *   0, 1   TELEMETRY_SYNC0, TELEMETRY_SYNC1
+ *   2      record type, TELEMETRY_*
+ *   3      payload length n, 0-255
+ *   4      board id, so frames from several arrays can share a decoder
+ *   5      frame sequence: +1 per queued frame, so a gap is a frame lost
+ *          after the ring (dropped() counts those lost before it)
+ *   6      payload, one of the telemetry_*_t records below
+ *   6+n    CRC-16/CCITT (poly 0x1021, init 0xFFFF) of bytes 2 to 5+n
+ *
+ * Records only ever grow at the end; a decoder reads the fields it knows
+ * and skips the rest of the payload.  host_src/telemetry.py is the host
+ * side.  Not for use from interrupts.
+ */
+
+#ifndef audio_telemetry_h_
+#define audio_telemetry_h_
+
+#include <Arduino.h>
+#include <audio_profile.h>
+#include "AudioAnalyzeMeter.h"
+#include "AudioAnalyzeTDMStatus.h"
+#include "AudioEffectLiveness.h"
+
+#define TELEMETRY_SYNC0		0xA5
+#define TELEMETRY_SYNC1		0x5A
+#define TELEMETRY_HEADER	6
+#define TELEMETRY_OVERHEAD	(TELEMETRY_HEADER + 2)
+#define TELEMETRY_MAX_PAYLOAD	255
+
+#ifndef TELEMETRY_RING_BYTES
+#define TELEMETRY_RING_BYTES	1024
+#endif
+
+// record types
+#define TELEMETRY_SYSTEM	1
+#define TELEMETRY_LEVELS	2
+#define TELEMETRY_PROFILE	3
+#define TELEMETRY_LINK		4
+#define TELEMETRY_PASSTHROUGH	5
+#define TELEMETRY_LIVENESS	6
+#define TELEMETRY_USB		7
+
+// telemetry_profile_t ids
+#define TELEMETRY_PROFILE_UPDATE_ALL	0
+#define TELEMETRY_PROFILE_TDM_RX	1
+#define TELEMETRY_PROFILE_USB_TX	2
+#define TELEMETRY_PROFILE_USB_RX	3
+#define TELEMETRY_PROFILE_TDM_ISR	4
+#define TELEMETRY_PROFILE_I2S_RX	5
+
+struct __attribute__((packed)) telemetry_system_t {
+	static const uint8_t type = TELEMETRY_SYSTEM;
+	uint32_t millis;
+	uint16_t cpu;			// AudioProcessorUsage() x 100
+	uint16_t cpu_max;
+	uint16_t memory;		// audio blocks in use
+	uint16_t memory_max;
+	uint32_t dropped;		// frames the ring had no room for
+	uint16_t memory_reserved;	// AudioMemoryReserved(), the pool size
+};
+
+struct __attribute__((packed)) telemetry_level_t {
+	uint16_t peak;			// 0-32768
+	uint16_t rms;			// 0-32768
+	uint16_t clips;			// saturates at 65535
+};
+
+// a meter window, followed by 'count' telemetry_level_t
+struct __attribute__((packed)) telemetry_levels_t {
+	static const uint8_t type = TELEMETRY_LEVELS;
+	uint32_t window;		// audio_meter_snapshot_t::sequence
+	uint32_t samples;
+	uint8_t first;			// channel number of the first level
+	uint8_t count;
+};
+
+struct __attribute__((packed)) telemetry_profile_t {
+	static const uint8_t type = TELEMETRY_PROFILE;
+	uint8_t id;			// TELEMETRY_PROFILE_*
+	uint8_t reserved[3];
+	uint32_t count;			// cycles, as audio_profile_print
+	uint32_t min;
+	uint32_t mean;
+	uint32_t max;
+};
+
+// the master's view of the slave, AudioAnalyzeTDMStatus
+struct __attribute__((packed)) telemetry_link_t {
+	static const uint8_t type = TELEMETRY_LINK;
+	uint8_t synced;
+	uint8_t reserved;
+	uint16_t underruns;
+	uint16_t overruns;
+	uint16_t latency;
+	int16_t phase;
+	uint16_t reserved2;
+	uint32_t sequence;
+	uint32_t lost;
+	uint32_t resets;
+	uint32_t errors;
+};
+
+struct __attribute__((packed)) telemetry_passthrough_t {
+	static const uint8_t type = TELEMETRY_PASSTHROUGH;
+	uint32_t slips;
+};
+
+// AudioEffectLivenessT: bit n of dead is channel first + n
+struct __attribute__((packed)) telemetry_liveness_t {
+	static const uint8_t type = TELEMETRY_LIVENESS;
+	uint8_t first;
+	uint8_t count;
+	uint16_t reserved;
+	uint32_t dead;
+	uint32_t dropouts;
+	uint32_t recoveries;
+};
+
+// AudioOutputUSB's transmit rate controller, in samples queued
+struct __attribute__((packed)) telemetry_usb_t {
+	static const uint8_t type = TELEMETRY_USB;
+	uint16_t fill;			// averaged
+	uint16_t fill_min;		// since the last record
+	uint16_t fill_max;
+	uint16_t target;
+	int32_t correction;		// audio clock against the host's, ppm
+	uint32_t underruns;
+	uint32_t overruns;		// blocks dropped from a full queue
+};
+
+static inline uint16_t telemetry_crc16(uint16_t crc, const uint8_t *p, unsigned int n) __attribute__((unused));
+static inline uint16_t telemetry_crc16(uint16_t crc, const uint8_t *p, unsigned int n)
+{
+	while (n--) {
+		crc ^= (uint16_t)*p++ << 8;
+		for (int i=0; i < 8; i++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+class AudioTelemetry
+{
+public:
+	AudioTelemetry(uint8_t board = 0) : board(board), sequence(0),
+		head(0), tail(0), partial(0), drops(0) { }
+	// queue one frame; false, counted in dropped(), if the ring is full
+	bool frame(uint8_t type, const void *payload, unsigned int length);
+	template <class Record>
+	bool send(const Record &r) { return frame(Record::type, &r, sizeof(r)); }
+	// records filled from the audio library and the objects in teensy_src
+	bool system(void);
+	template <unsigned int N>
+	bool levels(const audio_meter_snapshot_t<N> &s, unsigned int first = 0);
+	bool profile(uint8_t id, const audio_profile_t *p);
+	bool link(AudioAnalyzeTDMStatus &status);
+	bool passthrough(uint32_t slips);
+	template <unsigned int N>
+	bool liveness(AudioEffectLivenessT<N> &check, unsigned int first = 0);
+	// AudioOutputUSB, a template so this header does not need usb_audio.h
+	template <class Output>
+	bool usb(Output &out);
+	// write the whole frames 'out' accepts without blocking; bytes written
+	unsigned int drain(Print &out);
+	unsigned int pending(void) { return head - tail; }
+	uint32_t dropped(void) { return drops; }
+private:
+	void put(const void *data, unsigned int n);
+	const uint8_t board;
+	uint8_t sequence;
+	// free-running byte counts, ring[count % TELEMETRY_RING_BYTES]
+	uint32_t head;
+	uint32_t tail;
+	// bytes left of the frame at tail after a short write, else 0
+	uint16_t partial;
+	uint32_t drops;
+	uint8_t ring[TELEMETRY_RING_BYTES];
+};
+
+template <unsigned int N>
+bool AudioTelemetry::levels(const audio_meter_snapshot_t<N> &s, unsigned int first)
+{
+	static_assert(sizeof(telemetry_levels_t) + N * sizeof(telemetry_level_t) <= TELEMETRY_MAX_PAYLOAD,
+		"too many channels for one frame");
+	uint8_t payload[sizeof(telemetry_levels_t) + N * sizeof(telemetry_level_t)];
+	telemetry_levels_t h;
+	telemetry_level_t l;
+
+	h.window = s.sequence;
+	h.samples = s.samples;
+	h.first = first;
+	h.count = N;
+	memcpy(payload, &h, sizeof(h));
+	for (unsigned int ch=0; ch < N; ch++) {
+		l.peak = s.channel[ch].peak;
+		l.rms = s.rms(ch) * 32767.0f + 0.5f;
+		l.clips = s.channel[ch].clips < 0xFFFF ? s.channel[ch].clips : 0xFFFF;
+		memcpy(payload + sizeof(h) + ch * sizeof(l), &l, sizeof(l));
+	}
+	return frame(TELEMETRY_LEVELS, payload, sizeof(payload));
+}
+
+template <unsigned int N>
+bool AudioTelemetry::liveness(AudioEffectLivenessT<N> &check, unsigned int first)
+{
+	telemetry_liveness_t r;
+
+	r.first = first;
+	r.count = N;
+	r.reserved = 0;
+	r.dead = check.dead();
+	r.dropouts = check.dropouts();
+	r.recoveries = check.recoveries();
+	return send(r);
+}
+
+template <class Output>
+bool AudioTelemetry::usb(Output &out)
+{
+	telemetry_usb_t r;
+	unsigned int min, max;
+
+	out.fillRange(&min, &max);
+	r.fill = out.fill();
+	r.fill_min = min;
+	r.fill_max = max;
+	r.target = out.fillTarget();
+	r.correction = out.correction();
+	r.underruns = out.underruns();
+	r.overruns = out.overruns();
+	return send(r);
+}
+
+#endif
@@ -0,0 +1,63 @@
+/* Placement of audio DMA buffers
+ *
+ * By default DMA buffers live in DMAMEM (OCRAM, write-back cached) and
+ * every DMA handoff needs arm_dcache_* maintenance.  Build with
+ * AUDIO_DMA_DTCM=1 to place them in DTCM instead: the M7 never caches
+ * DTCM and the eDMA and USB controllers reach it through the TCM slave
+ * port, so the maintenance calls are compiled out.  This costs DTCM, which
+ * is shared with stack and ordinary variables.
+ *
+ * Compare the ISR cost of both builds with the 'p' profile dump.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef AUDIO_DMA_DTCM
+#define AUDIO_DMA_DTCM 0
+#endif
+
+#if AUDIO_DMA_DTCM
+#define AUDIO_DMA_MEM
+#else
+#define AUDIO_DMA_MEM DMAMEM
+#endif
+
+// only the cached OCRAM placement on Teensy 4 needs maintenance
+#if defined(__IMXRT1062__) && !AUDIO_DMA_DTCM
+#define AUDIO_DMA_CACHED 1
+#else
+#define AUDIO_DMA_CACHED 0
+#endif
+
+// Cache maintenance for buffers declared AUDIO_DMA_MEM.
+static inline void audio_dma_flush(void *addr, uint32_t size) __attribute__((always_inline, unused));
+static inline void audio_dma_flush(void *addr, uint32_t size)
+{
+#if AUDIO_DMA_CACHED
+	arm_dcache_flush(addr, size);
+#else
+	(void)addr; (void)size;
+#endif
+}
+
+static inline void audio_dma_delete(void *addr, uint32_t size) __attribute__((always_inline, unused));
+static inline void audio_dma_delete(void *addr, uint32_t size)
+{
+#if AUDIO_DMA_CACHED
+	arm_dcache_delete(addr, size);
+#else
+	(void)addr; (void)size;
+#endif
+}
+
+static inline void audio_dma_flush_delete(void *addr, uint32_t size) __attribute__((always_inline, unused));
+static inline void audio_dma_flush_delete(void *addr, uint32_t size)
+{
+#if AUDIO_DMA_CACHED
+	arm_dcache_flush_delete(addr, size);
+#else
+	(void)addr; (void)size;
+#endif
+}
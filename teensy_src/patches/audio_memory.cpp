@@ -0,0 +1,53 @@
+/* Audio block pool sized from the objects that are actually instantiated
+ * See audio_memory.h.
+ */
+
+#include <Arduino.h>
+#include "audio_memory.h"
+
+AudioMemoryUser *AudioMemoryUser::first = NULL;
+
+static unsigned int reserved = 0;
+
+AudioMemoryUser::AudioMemoryUser() : next(first)
+{
+	first = this;
+}
+
+AudioMemoryUser::~AudioMemoryUser()
+{
+	for (AudioMemoryUser **p = &first; *p; p = &(*p)->next) {
+		if (*p == this) {
+			*p = next;
+			break;
+		}
+	}
+}
+
+unsigned int AudioMemoryUser::blocksNeeded(void)
+{
+	unsigned int blocks = 0;
+
+	for (AudioMemoryUser *p = first; p; p = p->next) {
+		blocks += p->memoryBlocks();
+	}
+	return blocks;
+}
+
+unsigned int AudioMemoryAuto(unsigned int margin)
+{
+	unsigned int num = AudioMemoryUser::blocksNeeded() + margin;
+	audio_block_t *data;
+
+	if (reserved) return reserved;
+	data = (audio_block_t *)malloc(num * sizeof(audio_block_t));
+	if (!data) return 0;
+	AudioStream::initialize_memory(data, num);
+	reserved = num;
+	return num;
+}
+
+unsigned int AudioMemoryReserved(void)
+{
+	return reserved;
+}
@@ -0,0 +1,47 @@
+/* Audio block pool sized from the objects that are actually instantiated
+ *
+ * Objects that allocate or keep audio blocks derive from AudioMemoryUser
+ * and report their worst case: the blocks they hold at once (incoming
+ * blocks, queues, copies made by receiveWritable()), plus one block in
+ * flight for each outgoing connection (numConnections), since a block
+ * transmitted to several inputs may be copied by each of them.  Objects
+ * construct before setup() and connections link them, so by the time
+ * setup() runs the list is the whole graph.
+ *
+ * AudioMemoryAuto() replaces AudioMemory(n): it sums that demand, adds a
+ * margin for library objects that do not report (a stock object keeps at
+ * most a block per output between updates), and gives AudioStream a pool
+ * of exactly that many blocks from the heap.  On Teensy 4 the heap is in
+ * RAM2 (OCRAM), so the pool takes no RAM1 at all.  Call it once, before
+ * the audio objects start to allocate.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <AudioStream.h>
+
+#ifndef AUDIO_MEMORY_MARGIN
+#define AUDIO_MEMORY_MARGIN 4
+#endif
+
+class AudioMemoryUser
+{
+public:
+	AudioMemoryUser();
+	virtual ~AudioMemoryUser();
+	// worst-case blocks this object has allocated at once, counting one
+	// per outgoing connection
+	virtual unsigned int memoryBlocks(void) = 0;
+	// sum over every object, as the graph stands now
+	static unsigned int blocksNeeded(void);
+private:
+	static AudioMemoryUser *first;
+	AudioMemoryUser *next;
+};
+
+// Allocate and install a pool of AudioMemoryUser::blocksNeeded() + margin
+// blocks.  Returns the pool size, 0 if the heap could not supply it.
+unsigned int AudioMemoryAuto(unsigned int margin = AUDIO_MEMORY_MARGIN);
+// the pool size AudioMemoryAuto() installed, 0 before
+unsigned int AudioMemoryReserved(void);
@@ -0,0 +1,46 @@
+/* Halfword merges for the sample packing kernels
+ *
+ * Shared by the TDM slot kernels (../tdm_pack.h) and the USB interleave
+ * kernels (usb_audio_pack.h).  On Cortex-M7 each is a single PKHBT/PKHTB
+ * instruction; the plain C++ versions are bit-exact and used everywhere
+ * else, including the host simulation in ../sim/.
+ */
+
+#ifndef audio_pack_dsp_h_
+#define audio_pack_dsp_h_
+
+#include <stdint.h>
+
+#if defined(__ARM_ARCH_7EM__)
+#define AUDIO_PACK_DSP 1
+#else
+#define AUDIO_PACK_DSP 0
+#endif
+
+// (a[15:0] << 16) | b[15:0]
+static inline uint32_t audio_pack_bb(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline uint32_t audio_pack_bb(uint32_t a, uint32_t b)
+{
+#if AUDIO_PACK_DSP
+	uint32_t out;
+	asm ("pkhbt %0, %1, %2, lsl #16" : "=r" (out) : "r" (b), "r" (a));
+	return out;
+#else
+	return (a << 16) | (b & 0xFFFF);
+#endif
+}
+
+// a[31:16] << 16 | b[31:16]
+static inline uint32_t audio_pack_tt(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline uint32_t audio_pack_tt(uint32_t a, uint32_t b)
+{
+#if AUDIO_PACK_DSP
+	uint32_t out;
+	asm ("pkhtb %0, %1, %2, asr #16" : "=r" (out) : "r" (a), "r" (b));
+	return out;
+#else
+	return (a & 0xFFFF0000) | (b >> 16);
+#endif
+}
+
+#endif
@@ -0,0 +1,110 @@
+/* Cycle-accurate profiling of the audio interrupt paths
+ * See audio_profile.h for the concurrency rules.
+ */
+
+#include <Arduino.h>
+#include "audio_profile.h"
+
+audio_profile_t audio_profile_tdm_isr;
+audio_profile_t audio_profile_tdm_rx;
+audio_profile_t audio_profile_i2s_rx;
+audio_profile_t audio_profile_update_all;
+audio_profile_t audio_profile_usb_tx;
+audio_profile_t audio_profile_usb_rx;
+
+static void (*software_isr_chain)(void) = NULL;
+
+static void software_isr_profiled(void)
+{
+	uint32_t start = ARM_DWT_CYCCNT;
+	software_isr_chain();
+	audio_profile_record(&audio_profile_update_all, ARM_DWT_CYCCNT - start);
+}
+
+void audio_profile_begin(void)
+{
+	ARM_DEMCR |= ARM_DEMCR_TRCENA;
+	ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#if AUDIO_PROFILE
+	void (*vector)(void) = _VectorsRam[IRQ_SOFTWARE + 16];
+	if (vector != software_isr_profiled) {
+		software_isr_chain = vector;
+		attachInterruptVector(IRQ_SOFTWARE, software_isr_profiled);
+	}
+#endif
+}
+
+static void clear(audio_profile_t *p)
+{
+	p->count = 0;
+	p->min = 0xFFFFFFFF;
+	p->max = 0;
+	p->total = 0;
+	for (int i=0; i < AUDIO_PROFILE_BUCKETS; i++) p->histogram[i] = 0;
+	p->reset_request = 0;
+}
+
+void audio_profile_record(audio_profile_t *p, uint32_t cycles)
+{
+	p->seq++;
+	if (p->reset_request || p->count == 0) clear(p);
+	p->count++;
+	if (cycles < p->min) p->min = cycles;
+	if (cycles > p->max) p->max = cycles;
+	p->total += cycles;
+	p->histogram[31 - __builtin_clz(cycles | 1)]++;
+	p->seq++;
+}
+
+void audio_profile_reset(audio_profile_t *p)
+{
+	p->reset_request = 1;
+}
+
+void audio_profile_snapshot(const audio_profile_t *p, audio_profile_t *out)
+{
+	uint32_t seq;
+
+	do {
+		seq = p->seq;
+		out->count = p->count;
+		out->min = p->min;
+		out->max = p->max;
+		out->total = p->total;
+		for (int i=0; i < AUDIO_PROFILE_BUCKETS; i++) out->histogram[i] = p->histogram[i];
+		out->reset_request = p->reset_request;
+	} while ((seq & 1) || seq != p->seq);
+	out->seq = seq;
+	// a pending reset reads as empty
+	if (out->reset_request) clear(out);
+}
+
+uint32_t audio_profile_mean(const audio_profile_t *p)
+{
+	return p->count ? (uint32_t)(p->total / p->count) : 0;
+}
+
+void audio_profile_print(Print &out, const char *name, const audio_profile_t *p)
+{
+	audio_profile_t s;
+#if defined(__IMXRT1062__)
+	float cycles_per_us = F_CPU_ACTUAL / 1000000.0f;
+#else
+	float cycles_per_us = F_CPU / 1000000.0f;
+#endif
+
+	audio_profile_snapshot(p, &s);
+	if (s.count == 0) {
+		out.printf("%-12s no samples\n", name);
+		return;
+	}
+	uint32_t mean = audio_profile_mean(&s);
+	out.printf("%-12s n=%lu  min %lu  mean %lu  max %lu cycles  (%.2f / %.2f / %.2f us)\n",
+		name, (unsigned long)s.count, (unsigned long)s.min,
+		(unsigned long)mean, (unsigned long)s.max,
+		s.min / cycles_per_us, mean / cycles_per_us, s.max / cycles_per_us);
+	for (int i=0; i < AUDIO_PROFILE_BUCKETS; i++) {
+		if (s.histogram[i] == 0) continue;
+		out.printf("    [2^%-2d, 2^%-2d) %lu\n", i, i + 1, (unsigned long)s.histogram[i]);
+	}
+}
@@ -0,0 +1,79 @@
+/* Cycle-accurate profiling of the audio interrupt paths
+ *
+ * Each audio_profile_t is written by exactly one interrupt context and
+ * read from loop().  The writer brackets its update with a sequence
+ * counter (odd while updating); readers copy the block and retry if the
+ * counter moved, so neither side ever masks interrupts or waits.  A reset
+ * requested from loop() is carried out by the writer on its next sample.
+ *
+ * Timing comes from the DWT cycle counter (CPU clock cycles).  The
+ * histogram is log2-scaled: bucket n counts samples of [2^n, 2^(n+1))
+ * cycles, with 0 and 1 both landing in bucket 0.
+ *
+ * Define AUDIO_PROFILE=0 to compile every probe out.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef AUDIO_PROFILE
+#define AUDIO_PROFILE 1
+#endif
+
+#define AUDIO_PROFILE_BUCKETS 32
+
+typedef struct audio_profile_struct {
+	volatile uint32_t seq;
+	volatile uint32_t count;
+	volatile uint32_t min;
+	volatile uint32_t max;
+	volatile uint64_t total;
+	volatile uint32_t histogram[AUDIO_PROFILE_BUCKETS];
+	volatile uint8_t reset_request;
+} audio_profile_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// one block per instrumented path
+extern audio_profile_t audio_profile_tdm_isr;		// AudioOutputTDM_Slave DMA ISR
+extern audio_profile_t audio_profile_tdm_rx;		// master SAI1 receive DMA ISR
+extern audio_profile_t audio_profile_i2s_rx;		// AudioInputI2SSlaveT DMA ISR
+extern audio_profile_t audio_profile_update_all;	// AudioStream::update_all software ISR
+extern audio_profile_t audio_profile_usb_tx;		// usb_audio_transmit_callback
+extern audio_profile_t audio_profile_usb_rx;		// usb_audio_receive_callback
+
+// Enable the cycle counter and wrap the AudioStream software interrupt.
+// Call from setup() after the audio objects exist (update_setup() installs
+// the vector being wrapped).
+void audio_profile_begin(void);
+void audio_profile_record(audio_profile_t *p, uint32_t cycles);
+void audio_profile_reset(audio_profile_t *p);
+void audio_profile_snapshot(const audio_profile_t *p, audio_profile_t *out);
+uint32_t audio_profile_mean(const audio_profile_t *p);
+
+#ifdef __cplusplus
+}
+
+class Print;
+// Human-readable dump of one block: counts, min/mean/max in cycles and
+// microseconds, and the non-empty histogram buckets.
+void audio_profile_print(Print &out, const char *name, const audio_profile_t *p);
+
+// Records the cycles between construction and destruction.
+class AudioProfileScope
+{
+public:
+#if AUDIO_PROFILE
+	AudioProfileScope(audio_profile_t *p) : profile(p), start(ARM_DWT_CYCCNT) { }
+	~AudioProfileScope() { audio_profile_record(profile, ARM_DWT_CYCCNT - start); }
+private:
+	audio_profile_t *profile;
+	uint32_t start;
+#else
+	AudioProfileScope(audio_profile_t *p) { (void)p; }
+#endif
+};
+#endif
@@ -31,19 +31,18 @@
 #include <Arduino.h>
 #include "usb_dev.h"
 #include "usb_audio.h"
+#include "usb_audio_pack.h"
+#include "audio_profile.h"
+#include "audio_dma_mem.h"
 #include "debug/printf.h"
 
 #ifdef AUDIO_INTERFACE
 
 bool AudioInputUSB::update_responsibility;
-audio_block_t * AudioInputUSB::incoming_left;
-audio_block_t * AudioInputUSB::incoming_right;
-audio_block_t * AudioInputUSB::incoming_left2;
-audio_block_t * AudioInputUSB::incoming_right2;
-audio_block_t * AudioInputUSB::ready_left;
-audio_block_t * AudioInputUSB::ready_right;
-audio_block_t * AudioInputUSB::ready_left2;
-audio_block_t * AudioInputUSB::ready_right2;
+audio_block_t * AudioInputUSB::incoming[AUDIO_CHANNELS];
+audio_block_t * AudioInputUSB::ready[USB_AUDIO_QUEUE_BLOCKS][AUDIO_CHANNELS];
+uint8_t AudioInputUSB::ready_head;
+uint8_t AudioInputUSB::ready_count;
 uint16_t AudioInputUSB::incoming_count;
 uint8_t AudioInputUSB::receive_flag;
 
@@ -52,13 +51,19 @@ struct usb_audio_features_struct AudioInputUSB::features = {0,0,FEATURE_MAX_VOLU
 extern volatile uint8_t usb_high_speed;
 static void rx_event(transfer_t *t);
 static void tx_event(transfer_t *t);
+static void tx_rate_reset(void);
+
+// packet buffers, for the larger of the two speeds' packets
+#define USB_AUDIO_RX_BUFFER_SIZE \
+	(AUDIO_RX_SIZE_12 > AUDIO_RX_SIZE_480 ? AUDIO_RX_SIZE_12 : AUDIO_RX_SIZE_480)
+#define USB_AUDIO_TX_BUFFER_SIZE \
+	(AUDIO_TX_SIZE_12 > AUDIO_TX_SIZE_480 ? AUDIO_TX_SIZE_12 : AUDIO_TX_SIZE_480)
 
 /*static*/ transfer_t rx_transfer __attribute__ ((used, aligned(32)));
 /*static*/ transfer_t sync_transfer __attribute__ ((used, aligned(32)));
 /*static*/ transfer_t tx_transfer __attribute__ ((used, aligned(32)));
-DMAMEM static uint8_t rx_buffer[AUDIO_RX_SIZE] __attribute__ ((aligned(32)));
-DMAMEM static uint8_t tx_buffer[AUDIO_RX_SIZE] __attribute__ ((aligned(32)));
-DMAMEM uint32_t usb_audio_sync_feedback __attribute__ ((aligned(32)));
+AUDIO_DMA_MEM static uint8_t rx_buffer[USB_AUDIO_RX_BUFFER_SIZE] __attribute__ ((aligned(32)));
+AUDIO_DMA_MEM uint32_t usb_audio_sync_feedback __attribute__ ((aligned(32)));
 
 uint8_t usb_audio_receive_setting=0;
 uint8_t usb_audio_transmit_setting=0;
@@ -70,16 +75,25 @@ uint32_t feedback_accumulator;
 volatile uint32_t usb_audio_underrun_count;
 volatile uint32_t usb_audio_overrun_count;
 
+// Bytes of one sample on the wire, all channels
+#define USB_AUDIO_FRAME_BYTES (AUDIO_CHANNELS * 2)
+
+// log2 of the packets each way per 1 ms frame: 3 with USB_AUDIO_MICROFRAMES
+// at high speed, a packet every micro-frame, otherwise 0
+static uint8_t usb_audio_packet_shift;
+// the audio endpoints' packets at this speed; 0 when they are zero bandwidth
+static uint16_t usb_audio_rx_size;
+static uint16_t usb_audio_tx_size;
 
 static void rx_event(transfer_t *t)
 {
 	if (t) {
-		int len = AUDIO_RX_SIZE - ((rx_transfer.status >> 16) & 0x7FFF);
+		int len = usb_audio_rx_size - ((rx_transfer.status >> 16) & 0x7FFF);
 		printf("rx %u\n", len);
 		usb_audio_receive_callback(len);
 	}
-	usb_prepare_transfer(&rx_transfer, rx_buffer, AUDIO_RX_SIZE, 0);
-	arm_dcache_delete(&rx_buffer, AUDIO_RX_SIZE);
+	usb_prepare_transfer(&rx_transfer, rx_buffer, usb_audio_rx_size, 0);
+	audio_dma_delete(&rx_buffer, usb_audio_rx_size);
 	usb_receive(AUDIO_RX_ENDPOINT, &rx_transfer);
 }
 
@@ -89,7 +103,7 @@ static void sync_event(transfer_t *t)
 	//printf("sync %x\n", sync_transfer.status); // too slow, can't print this much
 	usb_audio_sync_feedback = feedback_accumulator >> usb_audio_sync_rshift;
 	usb_prepare_transfer(&sync_transfer, &usb_audio_sync_feedback, usb_audio_sync_nbytes, 0);
-	arm_dcache_flush(&usb_audio_sync_feedback, usb_audio_sync_nbytes);
+	audio_dma_flush(&usb_audio_sync_feedback, usb_audio_sync_nbytes);
 	usb_transmit(AUDIO_SYNC_ENDPOINT, &sync_transfer);
 }
 
@@ -99,35 +113,44 @@ void usb_audio_configure(void)
 	usb_audio_underrun_count = 0;
 	usb_audio_overrun_count = 0;
 	feedback_accumulator = 739875226; // 44.1 * 2^24
+	usb_audio_packet_shift = 0;
+	usb_audio_rx_size = AUDIO_RX_SIZE_12;
+	usb_audio_tx_size = AUDIO_TX_SIZE_12;
 	if (usb_high_speed) {
+#ifdef USB_AUDIO_MICROFRAMES
+		usb_audio_packet_shift = 3;
+#endif
+		usb_audio_rx_size = AUDIO_RX_SIZE_480;
+		usb_audio_tx_size = AUDIO_TX_SIZE_480;
+		// samples per packet interval, so per micro-frame for those
 		usb_audio_sync_nbytes = 4;
-		usb_audio_sync_rshift = 8;
+		usb_audio_sync_rshift = 8 + usb_audio_packet_shift;
 	} else {
 		usb_audio_sync_nbytes = 3;
 		usb_audio_sync_rshift = 10;
 	}
+	tx_rate_reset();
+	// too many channels for a full speed packet: nothing streams
+	if (usb_audio_tx_size == 0) return;
 	memset(&rx_transfer, 0, sizeof(rx_transfer));
-	usb_config_rx_iso(AUDIO_RX_ENDPOINT, AUDIO_RX_SIZE, 1, rx_event);
+	usb_config_rx_iso(AUDIO_RX_ENDPOINT, usb_audio_rx_size, 1, rx_event);
 	rx_event(NULL);
 	memset(&sync_transfer, 0, sizeof(sync_transfer));
 	usb_config_tx_iso(AUDIO_SYNC_ENDPOINT, usb_audio_sync_nbytes, 1, sync_event);
 	sync_event(NULL);
 	memset(&tx_transfer, 0, sizeof(tx_transfer));
-	usb_config_tx_iso(AUDIO_TX_ENDPOINT, AUDIO_TX_SIZE, 1, tx_event);
+	usb_config_tx_iso(AUDIO_TX_ENDPOINT, usb_audio_tx_size, 1, tx_event);
 	tx_event(NULL);
 }
 
 void AudioInputUSB::begin(void)
 {
 	incoming_count = 0;
-	incoming_left = NULL;
-	incoming_right = NULL;
-	incoming_left2 = NULL;
-	incoming_right2 = NULL;
-	ready_left = NULL;
-	ready_right = NULL;
-	ready_left2 = NULL;
-	ready_right2 = NULL;
+	for (unsigned int ch=0; ch < AUDIO_CHANNELS; ch++) {
+		incoming[ch] = NULL;
+	}
+	ready_head = 0;
+	ready_count = 0;
 	receive_flag = 0;
 	// update_responsibility = update_setup();
 	// TODO: update responsibility is tough, partly because the USB
@@ -137,143 +160,69 @@ void AudioInputUSB::begin(void)
 	update_responsibility = false;
 }
 
-static void copy_to_buffers_4ch(const uint32_t *src, int16_t *left1, int16_t *right1,
-                                 int16_t *left2, int16_t *right2, unsigned int len)
-{
-	// 4-channel data format: L1, R1, L2, R2 (16-bit each)
-	// Two 32-bit words contain all 4 channels
-	while (len > 0) {
-		uint32_t n1 = *src++;  // L1, R1
-		uint32_t n2 = *src++;  // L2, R2
-		*left1++ = n1 & 0xFFFF;
-		*right1++ = n1 >> 16;
-		*left2++ = n2 & 0xFFFF;
-		*right2++ = n2 >> 16;
-		len--;
-	}
-}
-
 // Called from the USB interrupt when an isochronous packet arrives
 // we must completely remove it from the receive buffer before returning
 //
 #if 1
 void usb_audio_receive_callback(unsigned int len)
 {
-	unsigned int count, avail;
-	audio_block_t *left1, *right1, *left2, *right2;
+	unsigned int count, avail, ch;
+	audio_block_t **in = AudioInputUSB::incoming;
+	int16_t *dst[AUDIO_CHANNELS];
 	const uint32_t *data;
+	AudioProfileScope profile(&audio_profile_usb_rx);
 
 	AudioInputUSB::receive_flag = 1;
-	len >>= 3; // 1 sample = 8 bytes: 4 channels x 2 bytes each
+	len /= USB_AUDIO_FRAME_BYTES;
 	data = (const uint32_t *)rx_buffer;
 
 	count = AudioInputUSB::incoming_count;
-	left1 = AudioInputUSB::incoming_left;
-	right1 = AudioInputUSB::incoming_right;
-	left2 = AudioInputUSB::incoming_left2;
-	right2 = AudioInputUSB::incoming_right2;
-
-	if (left1 == NULL) {
-		left1 = AudioStream::allocate();
-		if (left1 == NULL) return;
-		AudioInputUSB::incoming_left = left1;
-	}
-	if (right1 == NULL) {
-		right1 = AudioStream::allocate();
-		if (right1 == NULL) return;
-		AudioInputUSB::incoming_right = right1;
-	}
-	if (left2 == NULL) {
-		left2 = AudioStream::allocate();
-		if (left2 == NULL) return;
-		AudioInputUSB::incoming_left2 = left2;
-	}
-	if (right2 == NULL) {
-		right2 = AudioStream::allocate();
-		if (right2 == NULL) return;
-		AudioInputUSB::incoming_right2 = right2;
-	}
-
 	while (len > 0) {
-		avail = AUDIO_BLOCK_SAMPLES - count;
-		if (len < avail) {
-			copy_to_buffers_4ch(data, left1->data + count, right1->data + count,
-			                    left2->data + count, right2->data + count, len);
-			AudioInputUSB::incoming_count = count + len;
-			return;
-		} else if (avail > 0) {
-			copy_to_buffers_4ch(data, left1->data + count, right1->data + count,
-			                    left2->data + count, right2->data + count, avail);
-			data += avail * 2;  // 2 words per sample for 4 channels
-			len -= avail;
-			if (AudioInputUSB::ready_left || AudioInputUSB::ready_right ||
-			    AudioInputUSB::ready_left2 || AudioInputUSB::ready_right2) {
-				// buffer overrun, PC sending too fast
-				AudioInputUSB::incoming_count = count + avail;
-				if (len > 0) {
-					usb_audio_overrun_count++;
-					printf("!");
+		if (in[0] == NULL) {
+			// all channels or none
+			for (ch=0; ch < AUDIO_CHANNELS; ch++) {
+				in[ch] = AudioStream::allocate();
+				if (in[ch] == NULL) {
+					while (ch > 0) {
+						ch--;
+						AudioStream::release(in[ch]);
+						in[ch] = NULL;
+					}
+					AudioInputUSB::incoming_count = 0;
+					return;
 				}
-				return;
 			}
-			send:
-			AudioInputUSB::ready_left = left1;
-			AudioInputUSB::ready_right = right1;
-			AudioInputUSB::ready_left2 = left2;
-			AudioInputUSB::ready_right2 = right2;
-
-			left1 = AudioStream::allocate();
-			if (left1 == NULL) {
-				AudioInputUSB::incoming_left = NULL;
-				AudioInputUSB::incoming_right = NULL;
-				AudioInputUSB::incoming_left2 = NULL;
-				AudioInputUSB::incoming_right2 = NULL;
-				AudioInputUSB::incoming_count = 0;
-				return;
-			}
-			right1 = AudioStream::allocate();
-			if (right1 == NULL) {
-				AudioStream::release(left1);
-				AudioInputUSB::incoming_left = NULL;
-				AudioInputUSB::incoming_right = NULL;
-				AudioInputUSB::incoming_left2 = NULL;
-				AudioInputUSB::incoming_right2 = NULL;
-				AudioInputUSB::incoming_count = 0;
-				return;
-			}
-			left2 = AudioStream::allocate();
-			if (left2 == NULL) {
-				AudioStream::release(left1);
-				AudioStream::release(right1);
-				AudioInputUSB::incoming_left = NULL;
-				AudioInputUSB::incoming_right = NULL;
-				AudioInputUSB::incoming_left2 = NULL;
-				AudioInputUSB::incoming_right2 = NULL;
-				AudioInputUSB::incoming_count = 0;
-				return;
-			}
-			right2 = AudioStream::allocate();
-			if (right2 == NULL) {
-				AudioStream::release(left1);
-				AudioStream::release(right1);
-				AudioStream::release(left2);
-				AudioInputUSB::incoming_left = NULL;
-				AudioInputUSB::incoming_right = NULL;
-				AudioInputUSB::incoming_left2 = NULL;
-				AudioInputUSB::incoming_right2 = NULL;
-				AudioInputUSB::incoming_count = 0;
-				return;
-			}
-			AudioInputUSB::incoming_left = left1;
-			AudioInputUSB::incoming_right = right1;
-			AudioInputUSB::incoming_left2 = left2;
-			AudioInputUSB::incoming_right2 = right2;
 			count = 0;
-		} else {
-			if (AudioInputUSB::ready_left || AudioInputUSB::ready_right ||
-			    AudioInputUSB::ready_left2 || AudioInputUSB::ready_right2) return;
-			goto send; // recover from buffer overrun
 		}
+		for (ch=0; ch < AUDIO_CHANNELS; ch++) {
+			dst[ch] = in[ch]->data;
+		}
+		avail = AUDIO_BLOCK_SAMPLES - count;
+		if (len < avail) {
+			usb_audio_deinterleave<AUDIO_CHANNELS>(dst, count, data, len);
+			count += len;
+			break;
+		}
+		usb_audio_deinterleave<AUDIO_CHANNELS>(dst, count, data, avail);
+		data += avail * (AUDIO_CHANNELS / 2);
+		len -= avail;
+		count = AUDIO_BLOCK_SAMPLES;
+		if (AudioInputUSB::ready_count >= USB_AUDIO_QUEUE_BLOCKS) {
+			// buffer overrun, PC sending too fast; the full block
+			// is queued when there is room again
+			if (len > 0) {
+				usb_audio_overrun_count++;
+				printf("!");
+			}
+			break;
+		}
+		unsigned int tail = (AudioInputUSB::ready_head + AudioInputUSB::ready_count) %
+			USB_AUDIO_QUEUE_BLOCKS;
+		for (ch=0; ch < AUDIO_CHANNELS; ch++) {
+			AudioInputUSB::ready[tail][ch] = in[ch];
+			in[ch] = NULL;
+		}
+		AudioInputUSB::ready_count++;
 	}
 	AudioInputUSB::incoming_count = count;
 }
@@ -281,23 +230,23 @@ void usb_audio_receive_callback(unsigned int len)
 
 void AudioInputUSB::update(void)
 {
-	audio_block_t *left1, *right1, *left2, *right2;
+	audio_block_t *out[AUDIO_CHANNELS];
 
+	out[0] = NULL;
 	__disable_irq();
-	left1 = ready_left;
-	ready_left = NULL;
-	right1 = ready_right;
-	ready_right = NULL;
-	left2 = ready_left2;
-	ready_left2 = NULL;
-	right2 = ready_right2;
-	ready_right2 = NULL;
-	uint16_t c = incoming_count;
+	if (ready_count) {
+		for (unsigned int ch=0; ch < AUDIO_CHANNELS; ch++) {
+			out[ch] = ready[ready_head][ch];
+		}
+		ready_head = (ready_head + 1) % USB_AUDIO_QUEUE_BLOCKS;
+		ready_count--;
+	}
+	unsigned int c = incoming_count + ready_count * AUDIO_BLOCK_SAMPLES;
 	uint8_t f = receive_flag;
 	receive_flag = 0;
 	__enable_irq();
 	if (f) {
-		int diff = AUDIO_BLOCK_SAMPLES/2 - (int)c;
+		int diff = USB_AUDIO_RX_TARGET - (int)c;
 		feedback_accumulator += diff * 1;
 		//uint32_t feedback = (feedback_accumulator >> 8) + diff * 100;
 		//usb_audio_sync_feedback = feedback;
@@ -306,26 +255,15 @@ void AudioInputUSB::update(void)
 	}
 	//serial_phex(c);
 	//serial_print(".");
-	if (!left1 || !right1 || !left2 || !right2) {
+	if (!out[0]) {
 		usb_audio_underrun_count++;
 		//printf("#"); // buffer underrun - PC sending too slow
 		if (f) feedback_accumulator += 3500;
+		return;
 	}
-	if (left1) {
-		transmit(left1, 0);  // Channel 0 - Left 1
-		release(left1);
-	}
-	if (right1) {
-		transmit(right1, 1); // Channel 1 - Right 1
-		release(right1);
-	}
-	if (left2) {
-		transmit(left2, 2);  // Channel 2 - Left 2
-		release(left2);
-	}
-	if (right2) {
-		transmit(right2, 3); // Channel 3 - Right 2
-		release(right2);
+	for (unsigned int ch=0; ch < AUDIO_CHANNELS; ch++) {
+		transmit(out[ch], ch);
+		release(out[ch]);
 	}
 }
 
@@ -347,17 +285,51 @@ void AudioInputUSB::update(void)
 
 #if 1
 bool AudioOutputUSB::update_responsibility;
-audio_block_t * AudioOutputUSB::left_1st;
-audio_block_t * AudioOutputUSB::left_2nd;
-audio_block_t * AudioOutputUSB::right_1st;
-audio_block_t * AudioOutputUSB::right_2nd;
-audio_block_t * AudioOutputUSB::left2_1st;
-audio_block_t * AudioOutputUSB::left2_2nd;
-audio_block_t * AudioOutputUSB::right2_1st;
-audio_block_t * AudioOutputUSB::right2_2nd;
+audio_block_t * AudioOutputUSB::queue[USB_AUDIO_TX_QUEUE_BLOCKS][AUDIO_CHANNELS];
+uint8_t AudioOutputUSB::queue_head;
+uint8_t AudioOutputUSB::queue_count;
 uint16_t AudioOutputUSB::offset_1st;
 
-/*DMAMEM*/ uint16_t usb_audio_transmit_buffer[AUDIO_TX_SIZE/2] __attribute__ ((used, aligned(32)));
+// left in DTCM in both builds, as the stock core has it
+/*DMAMEM*/ uint16_t usb_audio_transmit_buffer[USB_AUDIO_TX_BUFFER_SIZE/2] __attribute__ ((used, aligned(32)));
+
+// Transmit rate control.  The host's frames and the audio clock never
+// quite agree, so a fixed 44/45 pattern drifts into underruns or dropped
+// blocks.  Each packet's size is instead the nominal rate plus a PI
+// correction on how far the queue is from USB_AUDIO_TX_TARGET, in samples
+// per packet x 65536, with the fraction carried to the next packet.
+// Critically damped, settling in about a quarter second.  The constants
+// are per 1 ms frame; with a packet every micro-frame each term is scaled
+// by usb_audio_packet_shift so the loop keeps the same response in time.
+#define TX_RATE_NOMINAL		((int32_t)(AUDIO_SAMPLE_RATE_EXACT * 65.536f + 0.5f))
+#define TX_RATE_KP		512	// 1/128 sample per frame per sample off
+#define TX_RATE_LIMIT		65536	// learned correction, at most 1 sample per frame
+static uint32_t tx_phase;
+// x 2^usb_audio_packet_shift against a frame's correction
+static int32_t tx_integral;
+static uint16_t tx_packet_max;
+static uint16_t tx_target;
+// nothing is sent until the queue first reaches the target, so the
+// controller starts centered; again after an underrun
+static bool tx_primed;
+static uint32_t tx_fill_avg;		// x 16
+static uint16_t tx_fill_min;
+static uint16_t tx_fill_max;
+static volatile uint32_t tx_underruns;
+static volatile uint32_t tx_overruns;
+
+static void tx_rate_reset(void)
+{
+	tx_phase = 0;
+	tx_integral = 0;
+	tx_packet_max = usb_audio_packet_shift ?
+		USB_AUDIO_MAX_MICROFRAME_SAMPLES : USB_AUDIO_MAX_PACKET_SAMPLES;
+	tx_target = USB_AUDIO_TX_TARGET(tx_packet_max);
+	tx_primed = false;
+	tx_fill_avg = 0;
+	tx_fill_min = 0xFFFF;
+	tx_fill_max = 0;
+}
 
 
 static void tx_event(transfer_t *t)
@@ -365,7 +337,7 @@ static void tx_event(transfer_t *t)
 	int len = usb_audio_transmit_callback();
 	usb_audio_sync_feedback = feedback_accumulator >> usb_audio_sync_rshift;
 	usb_prepare_transfer(&tx_transfer, usb_audio_transmit_buffer, len, 0);
-	arm_dcache_flush_delete(usb_audio_transmit_buffer, len);
+	audio_dma_flush_delete(usb_audio_transmit_buffer, len);
 	usb_transmit(AUDIO_TX_ENDPOINT, &tx_transfer);
 }
 
@@ -373,115 +345,109 @@ static void tx_event(transfer_t *t)
 void AudioOutputUSB::begin(void)
 {
 	update_responsibility = false;
-	left_1st = NULL;
-	right_1st = NULL;
-	left2_1st = NULL;
-	right2_1st = NULL;
-	left_2nd = NULL;
-	right_2nd = NULL;
-	left2_2nd = NULL;
-	right2_2nd = NULL;
+	queue_head = 0;
+	queue_count = 0;
 	offset_1st = 0;
+	tx_rate_reset();
+	tx_underruns = 0;
+	tx_overruns = 0;
 }
 
-static void copy_from_buffers_4ch(uint32_t *dst, int16_t *left1, int16_t *right1,
-                                   int16_t *left2, int16_t *right2, unsigned int len)
+unsigned int AudioOutputUSB::fill(void)
 {
-	// Pack 4 channels: L1, R1, L2, R2
-	while (len > 0) {
-		*dst++ = (*right1++ << 16) | (*left1++ & 0xFFFF);  // L1, R1
-		*dst++ = (*right2++ << 16) | (*left2++ & 0xFFFF);  // L2, R2
-		len--;
-	}
+	return tx_fill_avg >> 4;
+}
+
+unsigned int AudioOutputUSB::fillTarget(void)
+{
+	return tx_target;
+}
+
+unsigned int AudioOutputUSB::packetsPerFrame(void)
+{
+	return 1 << usb_audio_packet_shift;
 }
 
+void AudioOutputUSB::fillRange(unsigned int *min, unsigned int *max)
+{
+	__disable_irq();
+	*min = tx_fill_min <= tx_fill_max ? tx_fill_min : 0;
+	*max = tx_fill_max;
+	tx_fill_min = 0xFFFF;
+	tx_fill_max = 0;
+	__enable_irq();
+}
+
+int AudioOutputUSB::correction(void)
+{
+	return (int64_t)tx_integral * 1000000 / ((int64_t)TX_RATE_NOMINAL << usb_audio_packet_shift);
+}
+
+uint32_t AudioOutputUSB::underruns(void)
+{
+	return tx_underruns;
+}
+
+uint32_t AudioOutputUSB::overruns(void)
+{
+	return tx_overruns;
+}
+
+// sent for a channel with no block; word aligned like a block's data
+static const int16_t usb_audio_silence[AUDIO_BLOCK_SAMPLES] __attribute__ ((aligned(4))) = {0};
+
 void AudioOutputUSB::update(void)
 {
-	audio_block_t *left1, *right1, *left2, *right2;
-
-	// Get audio from all 4 input channels
-	left1 = receiveWritable(0);  // input 0 = channel 1 (L1)
-	right1 = receiveWritable(1); // input 1 = channel 2 (R1)
-	left2 = receiveWritable(2);  // input 2 = channel 3 (L2)
-	right2 = receiveWritable(3); // input 3 = channel 4 (R2)
-
-	if (usb_audio_transmit_setting == 0) {
-		if (left1) release(left1);
-		if (right1) release(right1);
-		if (left2) release(left2);
-		if (right2) release(right2);
-		if (left_1st) { release(left_1st); left_1st = NULL; }
-		if (left_2nd) { release(left_2nd); left_2nd = NULL; }
-		if (right_1st) { release(right_1st); right_1st = NULL; }
-		if (right_2nd) { release(right_2nd); right_2nd = NULL; }
-		if (left2_1st) { release(left2_1st); left2_1st = NULL; }
-		if (left2_2nd) { release(left2_2nd); left2_2nd = NULL; }
-		if (right2_1st) { release(right2_1st); right2_1st = NULL; }
-		if (right2_2nd) { release(right2_2nd); right2_2nd = NULL; }
-		offset_1st = 0;
-		return;
-	}
+	audio_block_t *in[AUDIO_CHANNELS], *discard[AUDIO_CHANNELS];
+	unsigned int ch;
+	bool overrun = false;
 
-	// Create silence for any missing channel
-	if (left1 == NULL) {
-		left1 = allocate();
-		if (left1) memset(left1->data, 0, sizeof(left1->data));
-	}
-	if (right1 == NULL) {
-		right1 = allocate();
-		if (right1) memset(right1->data, 0, sizeof(right1->data));
-	}
-	if (left2 == NULL) {
-		left2 = allocate();
-		if (left2) memset(left2->data, 0, sizeof(left2->data));
-	}
-	if (right2 == NULL) {
-		right2 = allocate();
-		if (right2) memset(right2->data, 0, sizeof(right2->data));
+	for (ch=0; ch < AUDIO_CHANNELS; ch++) {
+		in[ch] = receiveReadOnly(ch);
 	}
 
-	// If any allocation failed, release all and return
-	if (!left1 || !right1 || !left2 || !right2) {
-		if (left1) release(left1);
-		if (right1) release(right1);
-		if (left2) release(left2);
-		if (right2) release(right2);
+	if (usb_audio_transmit_setting == 0 || usb_audio_tx_size == 0) {
+		for (ch=0; ch < AUDIO_CHANNELS; ch++) {
+			if (in[ch]) release(in[ch]);
+		}
+		__disable_irq();
+		while (queue_count) {
+			for (ch=0; ch < AUDIO_CHANNELS; ch++) {
+				if (queue[queue_head][ch]) release(queue[queue_head][ch]);
+			}
+			queue_head = (queue_head + 1) % USB_AUDIO_TX_QUEUE_BLOCKS;
+			queue_count--;
+		}
+		offset_1st = 0;
+		tx_rate_reset();
+		__enable_irq();
 		return;
 	}
 
+	// a channel with no block is sent as silence
 	__disable_irq();
-	if (left_1st == NULL) {
-		left_1st = left1;
-		right_1st = right1;
-		left2_1st = left2;
-		right2_1st = right2;
-		offset_1st = 0;
-	} else if (left_2nd == NULL) {
-		left_2nd = left1;
-		right_2nd = right1;
-		left2_2nd = left2;
-		right2_2nd = right2;
-	} else {
+	if (queue_count >= USB_AUDIO_TX_QUEUE_BLOCKS) {
 		// buffer overrun - PC is consuming too slowly
-		audio_block_t *discard1 = left_1st;
-		audio_block_t *discard2 = right_1st;
-		audio_block_t *discard3 = left2_1st;
-		audio_block_t *discard4 = right2_1st;
-		left_1st = left_2nd;
-		right_1st = right_2nd;
-		left2_1st = left2_2nd;
-		right2_1st = right2_2nd;
-		left_2nd = left1;
-		right_2nd = right1;
-		left2_2nd = left2;
-		right2_2nd = right2;
+		for (ch=0; ch < AUDIO_CHANNELS; ch++) {
+			discard[ch] = queue[queue_head][ch];
+		}
+		queue_head = (queue_head + 1) % USB_AUDIO_TX_QUEUE_BLOCKS;
+		queue_count--;
 		offset_1st = 0;
-		release(discard1);
-		release(discard2);
-		release(discard3);
-		release(discard4);
+		overrun = true;
+		tx_overruns++;
+	}
+	unsigned int tail = (queue_head + queue_count) % USB_AUDIO_TX_QUEUE_BLOCKS;
+	for (ch=0; ch < AUDIO_CHANNELS; ch++) {
+		queue[tail][ch] = in[ch];
 	}
+	queue_count++;
 	__enable_irq();
+	if (overrun) {
+		for (ch=0; ch < AUDIO_CHANNELS; ch++) {
+			if (discard[ch]) release(discard[ch]);
+		}
+	}
 }
 
 
@@ -491,56 +457,72 @@ void AudioOutputUSB::update(void)
 // no data to transmit
 unsigned int usb_audio_transmit_callback(void)
 {
-	static uint32_t count=5;
 	uint32_t avail, num, target, offset, len=0;
-	audio_block_t *left1, *right1, *left2, *right2;
-
-	if (++count < 10) {   // TODO: dynamic adjust to match USB rate
-		target = 44;
-	} else {
-		count = 0;
-		target = 45;
+	audio_block_t **blocks;
+	const int16_t *src[AUDIO_CHANNELS];
+	AudioProfileScope profile(&audio_profile_usb_tx);
+
+	int fill = AudioOutputUSB::queue_count * AUDIO_BLOCK_SAMPLES - AudioOutputUSB::offset_1st;
+	int error = fill - tx_target;
+	unsigned int shift = usb_audio_packet_shift;
+	int32_t limit = TX_RATE_LIMIT << shift;
+	// 2^shift packets per frame, each integrating the error
+	tx_phase += (TX_RATE_NOMINAL >> shift) + (tx_integral >> (shift * 2)) +
+		((error * TX_RATE_KP) >> shift);
+	target = tx_phase >> 16;
+	tx_phase &= 0xFFFF;
+	if (target < tx_packet_max - 2u) {
+		target = tx_packet_max - 2u;
+	} else if (target > tx_packet_max) {
+		target = tx_packet_max;
+	} else if (tx_primed) {
+		// learn only while the size is not clamped, so the
+		// correction does not wind up past what it can apply
+		tx_integral += error;
+		if (tx_integral > limit) tx_integral = limit;
+		if (tx_integral < -limit) tx_integral = -limit;
 	}
+	tx_fill_avg += fill - (tx_fill_avg >> 4);
+	if (fill < tx_fill_min) tx_fill_min = fill;
+	if (fill > tx_fill_max) tx_fill_max = fill;
+	if (!tx_primed && fill >= tx_target) tx_primed = true;
+
 	while (len < target) {
 		num = target - len;
-		left1 = AudioOutputUSB::left_1st;
-		if (left1 == NULL) {
+		if (AudioOutputUSB::queue_count == 0 || !tx_primed) {
 			// buffer underrun - PC is consuming too quickly
-			memset(usb_audio_transmit_buffer + len*2, 0, num * 8);  // 4 channels * 2 bytes
+			if (tx_primed) {
+				tx_underruns++;
+				tx_primed = false;
+			}
+			memset((uint8_t *)usb_audio_transmit_buffer + len * USB_AUDIO_FRAME_BYTES, 0,
+				num * USB_AUDIO_FRAME_BYTES);
 			break;
 		}
-		right1 = AudioOutputUSB::right_1st;
-		left2 = AudioOutputUSB::left2_1st;
-		right2 = AudioOutputUSB::right2_1st;
+		blocks = AudioOutputUSB::queue[AudioOutputUSB::queue_head];
 		offset = AudioOutputUSB::offset_1st;
 
 		avail = AUDIO_BLOCK_SAMPLES - offset;
 		if (num > avail) num = avail;
 
-		copy_from_buffers_4ch((uint32_t *)usb_audio_transmit_buffer + len*2,
-			left1->data + offset, right1->data + offset,
-			left2->data + offset, right2->data + offset, num);
+		for (unsigned int ch=0; ch < AUDIO_CHANNELS; ch++) {
+			src[ch] = blocks[ch] ? blocks[ch]->data : usb_audio_silence;
+		}
+		usb_audio_interleave<AUDIO_CHANNELS>((uint32_t *)usb_audio_transmit_buffer +
+			len * (AUDIO_CHANNELS / 2), src, offset, num);
 		len += num;
 		offset += num;
 		if (offset >= AUDIO_BLOCK_SAMPLES) {
-			AudioStream::release(left1);
-			AudioStream::release(right1);
-			AudioStream::release(left2);
-			AudioStream::release(right2);
-			AudioOutputUSB::left_1st = AudioOutputUSB::left_2nd;
-			AudioOutputUSB::left_2nd = NULL;
-			AudioOutputUSB::right_1st = AudioOutputUSB::right_2nd;
-			AudioOutputUSB::right_2nd = NULL;
-			AudioOutputUSB::left2_1st = AudioOutputUSB::left2_2nd;
-			AudioOutputUSB::left2_2nd = NULL;
-			AudioOutputUSB::right2_1st = AudioOutputUSB::right2_2nd;
-			AudioOutputUSB::right2_2nd = NULL;
-			AudioOutputUSB::offset_1st = 0;
-		} else {
-			AudioOutputUSB::offset_1st = offset;
+			for (unsigned int ch=0; ch < AUDIO_CHANNELS; ch++) {
+				if (blocks[ch]) AudioStream::release(blocks[ch]);
+			}
+			AudioOutputUSB::queue_head = (AudioOutputUSB::queue_head + 1) % USB_AUDIO_TX_QUEUE_BLOCKS;
+			AudioOutputUSB::queue_count--;
+			offset = 0;
 		}
+		AudioOutputUSB::offset_1st = offset;
 	}
-	return target * 8;  // 4 channels * 2 bytes per sample
+	return target * USB_AUDIO_FRAME_BYTES;
 }
 #endif
 
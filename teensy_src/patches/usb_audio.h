@@ -35,6 +35,39 @@
 
 #define FEATURE_MAX_VOLUME 0xFF  // volume accepted from 0 to 0xFF
 
+// Most samples in one isochronous packet, 44.1 per 1 ms frame
+#define USB_AUDIO_MAX_PACKET_SAMPLES 45
+// and with USB_AUDIO_MICROFRAMES at high speed, 5.5 per 125 us micro-frame
+#define USB_AUDIO_MAX_MICROFRAME_SAMPLES 7
+
+// Blocks queued per channel in each direction: a packet and 16 samples
+// of slack, rounded up, and the block arriving while it is sent.  That is
+// the stock pair at 64 and 128 samples, 3 blocks at 32 and 5 at 16
+#define USB_AUDIO_QUEUE_BLOCKS \
+	((USB_AUDIO_MAX_PACKET_SAMPLES + 16 + AUDIO_BLOCK_SAMPLES - 1) / AUDIO_BLOCK_SAMPLES + 1)
+
+// Blocks AudioOutputUSB queues per channel.  Deeper rides out longer gaps
+// in the host's polling without dropping blocks, at the cost of latency:
+// each block beyond USB_AUDIO_QUEUE_BLOCKS adds half a block, as the
+// queue is kept half full.
+#ifndef USB_AUDIO_TX_QUEUE_BLOCKS
+#define USB_AUDIO_TX_QUEUE_BLOCKS USB_AUDIO_QUEUE_BLOCKS
+#endif
+
+// Samples the transmit side keeps queued on average, for packets of at
+// most 'packet' samples: half the queue and half a packet, so a packet is
+// there just before a block arrives and the block still fits
+#define USB_AUDIO_TX_TARGET(packet) \
+	((USB_AUDIO_TX_QUEUE_BLOCKS * AUDIO_BLOCK_SAMPLES + (packet)) / 2)
+
+// Samples the receive side steers toward, counted in the partial block
+// and the queue just after update() takes a block: half a block with the
+// stock pair, as the stock core has it.  With smaller blocks a packet
+// spans several of them, and half the queue is kept instead
+#define USB_AUDIO_RX_TARGET \
+	(USB_AUDIO_QUEUE_BLOCKS == 2 ? AUDIO_BLOCK_SAMPLES / 2 : \
+	 USB_AUDIO_QUEUE_BLOCKS * AUDIO_BLOCK_SAMPLES / 2)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -61,11 +94,15 @@ struct usb_audio_features_struct {
 
 #ifdef __cplusplus
 #include "AudioStream.h"
+#include "audio_memory.h"
 
-class AudioInputUSB : public AudioStream
+// AUDIO_CHANNELS channels each way, set by the USB type in usb_desc.h;
+// the USB packets interleave them sample by sample, channel 0 first.
+class AudioInputUSB : public AudioStream, public AudioMemoryUser
 {
 public:
-	AudioInputUSB(void) : AudioStream(0, NULL) { begin(); }  // outputs 4 channels
+	static const unsigned int channels = AUDIO_CHANNELS;
+	AudioInputUSB(void) : AudioStream(0, NULL) { begin(); }  // outputs AUDIO_CHANNELS
 	virtual void update(void);
 	void begin(void);
 	friend void usb_audio_receive_callback(unsigned int len);
@@ -76,39 +113,62 @@ public:
 		if (features.mute) return 0.0;
 		return (float)(features.volume) * (1.0 / (float)FEATURE_MAX_VOLUME);
 	}
+	// the block being filled and a full queue, plus those transmitted
+	virtual unsigned int memoryBlocks(void) {
+		return (USB_AUDIO_QUEUE_BLOCKS + 1) * AUDIO_CHANNELS + numConnections;
+	}
 private:
 	static bool update_responsibility;
-	static audio_block_t *incoming_left;
-	static audio_block_t *incoming_right;
-	static audio_block_t *incoming_left2;
-	static audio_block_t *incoming_right2;
-	static audio_block_t *ready_left;
-	static audio_block_t *ready_right;
-	static audio_block_t *ready_left2;
-	static audio_block_t *ready_right2;
+	// the block being filled, then a queue of full ones, oldest at
+	// ready_head, one block per channel in each entry
+	static audio_block_t *incoming[AUDIO_CHANNELS];
+	static audio_block_t *ready[USB_AUDIO_QUEUE_BLOCKS][AUDIO_CHANNELS];
+	static uint8_t ready_head;
+	static uint8_t ready_count;
 	static uint16_t incoming_count;
 	static uint8_t receive_flag;
 };
 
-class AudioOutputUSB : public AudioStream
+class AudioOutputUSB : public AudioStream, public AudioMemoryUser
 {
+	static_assert(USB_AUDIO_TX_QUEUE_BLOCKS >= USB_AUDIO_QUEUE_BLOCKS &&
+		USB_AUDIO_TX_QUEUE_BLOCKS <= 64, "USB_AUDIO_TX_QUEUE_BLOCKS must be USB_AUDIO_QUEUE_BLOCKS to 64");
 public:
-	AudioOutputUSB(void) : AudioStream(4, inputQueueArray) { begin(); }  // 4 inputs
+	static const unsigned int channels = AUDIO_CHANNELS;
+	AudioOutputUSB(void) : AudioStream(AUDIO_CHANNELS, inputQueueArray) { begin(); }
 	virtual void update(void);
 	void begin(void);
 	friend unsigned int usb_audio_transmit_callback(void);
+	// The transmit rate controller: samples queued, averaged over the
+	// last 16 packets, and the level it steers them to, which is lower
+	// when packets go every micro-frame
+	static unsigned int fill(void);
+	static unsigned int fillTarget(void);
+	// packets per 1 ms frame: 1, or 8 with USB_AUDIO_MICROFRAMES at high speed
+	static unsigned int packetsPerFrame(void);
+	// lowest and highest samples queued before a packet since the last call
+	static void fillRange(unsigned int *min, unsigned int *max);
+	// how much faster the audio clock runs than the host's frames, ppm,
+	// as the controller has learned it
+	static int correction(void);
+	// packets padded with silence, each a gap in the stream
+	static uint32_t underruns(void);
+	// blocks dropped, oldest first, because the queue was full
+	static uint32_t overruns(void);
+	// a full queue, and the entry received while dropping its oldest;
+	// unconnected channels are sent as silence without a block
+	virtual unsigned int memoryBlocks(void) {
+		return (USB_AUDIO_TX_QUEUE_BLOCKS + 1) * numConnections;
+	}
 private:
 	static bool update_responsibility;
-	static audio_block_t *left_1st;
-	static audio_block_t *left_2nd;
-	static audio_block_t *right_1st;
-	static audio_block_t *right_2nd;
-	static audio_block_t *left2_1st;   // Channel 3
-	static audio_block_t *left2_2nd;
-	static audio_block_t *right2_1st;  // Channel 4
-	static audio_block_t *right2_2nd;
+	// blocks waiting for the transmit callback, oldest at queue_head,
+	// which is sent from offset_1st; NULL for a channel with no input
+	static audio_block_t *queue[USB_AUDIO_TX_QUEUE_BLOCKS][AUDIO_CHANNELS];
+	static uint8_t queue_head;
+	static uint8_t queue_count;
 	static uint16_t offset_1st;
-	audio_block_t *inputQueueArray[4];  // 4 channels
+	audio_block_t *inputQueueArray[AUDIO_CHANNELS];
 };
 #endif // __cplusplus
 
@@ -0,0 +1,128 @@
+/* USB audio interleave kernels
+ *
+ * A USB audio packet carries every channel's sample in turn, two 16-bit
+ * channels to a 32-bit word; the audio library keeps one block per
+ * channel.  These move between the two, for an even channel count known
+ * at compile time.  They run in the USB interrupt once per packet.
+ *
+ * The main loops take four samples of each channel at a time: two word
+ * loads per block, one per pair of samples, and for each pair of channels
+ * two halfword merges per two samples, shared with the TDM kernels in
+ * audio_pack_dsp.h.  Blocks are word aligned, so a run starting on an odd
+ * sample takes one sample alone first, and an odd length ends with one.
+ *
+ * The _ref kernels are the per-sample loops, kept for ../sim/usb_pack_bench.
+ */
+
+#ifndef usb_audio_pack_h_
+#define usb_audio_pack_h_
+
+#include <stdint.h>
+#include "audio_pack_dsp.h"
+
+// Reference kernels: one sample of every channel per step.
+template <unsigned int Channels>
+static void usb_audio_interleave_ref(uint32_t *dst, const int16_t *const *src,
+	unsigned int offset, unsigned int len)
+{
+	for (unsigned int i=offset; i < offset + len; i++) {
+		for (unsigned int ch=0; ch < Channels; ch += 2) {
+			*dst++ = ((uint32_t)src[ch + 1][i] << 16) | (uint16_t)src[ch][i];
+		}
+	}
+}
+
+template <unsigned int Channels>
+static void usb_audio_deinterleave_ref(int16_t *const *dst, unsigned int offset,
+	const uint32_t *src, unsigned int len)
+{
+	for (unsigned int i=offset; i < offset + len; i++) {
+		for (unsigned int ch=0; ch < Channels; ch += 2) {
+			uint32_t n = *src++;
+			dst[ch][i] = n & 0xFFFF;
+			dst[ch + 1][i] = n >> 16;
+		}
+	}
+}
+
+// Samples offset to offset + len - 1 of each block in src, interleaved
+// into dst: channel 0 in the low half of the first word of each sample.
+template <unsigned int Channels>
+static void usb_audio_interleave(uint32_t *dst, const int16_t *const *src,
+	unsigned int offset, unsigned int len)
+{
+	static_assert(Channels >= 2 && Channels % 2 == 0, "channels travel in pairs");
+	const unsigned int words = Channels / 2;
+	unsigned int i = offset, end = offset + len;
+
+	if ((i & 1) && i < end) {
+		usb_audio_interleave_ref<Channels>(dst, src, i, 1);
+		dst += words;
+		i++;
+	}
+	for (; i + 4 <= end; i += 4) {
+		for (unsigned int p=0; p < words; p++) {
+			const uint32_t *a = (const uint32_t *)(src[p*2] + i);
+			const uint32_t *b = (const uint32_t *)(src[p*2 + 1] + i);
+			uint32_t a0 = a[0], a1 = a[1], b0 = b[0], b1 = b[1];
+			dst[p] = audio_pack_bb(b0, a0);
+			dst[words + p] = audio_pack_tt(b0, a0);
+			dst[words*2 + p] = audio_pack_bb(b1, a1);
+			dst[words*3 + p] = audio_pack_tt(b1, a1);
+		}
+		dst += words * 4;
+	}
+	if (i + 2 <= end) {
+		for (unsigned int p=0; p < words; p++) {
+			uint32_t a0 = *(const uint32_t *)(src[p*2] + i);
+			uint32_t b0 = *(const uint32_t *)(src[p*2 + 1] + i);
+			dst[p] = audio_pack_bb(b0, a0);
+			dst[words + p] = audio_pack_tt(b0, a0);
+		}
+		dst += words * 2;
+		i += 2;
+	}
+	if (i < end) usb_audio_interleave_ref<Channels>(dst, src, i, 1);
+}
+
+// The reverse: len interleaved samples from src into samples offset to
+// offset + len - 1 of each block in dst.
+template <unsigned int Channels>
+static void usb_audio_deinterleave(int16_t *const *dst, unsigned int offset,
+	const uint32_t *src, unsigned int len)
+{
+	static_assert(Channels >= 2 && Channels % 2 == 0, "channels travel in pairs");
+	const unsigned int words = Channels / 2;
+	unsigned int i = offset, end = offset + len;
+
+	if ((i & 1) && i < end) {
+		usb_audio_deinterleave_ref<Channels>(dst, i, src, 1);
+		src += words;
+		i++;
+	}
+	for (; i + 4 <= end; i += 4) {
+		for (unsigned int p=0; p < words; p++) {
+			uint32_t w0 = src[p], w1 = src[words + p];
+			uint32_t w2 = src[words*2 + p], w3 = src[words*3 + p];
+			uint32_t *a = (uint32_t *)(dst[p*2] + i);
+			uint32_t *b = (uint32_t *)(dst[p*2 + 1] + i);
+			a[0] = audio_pack_bb(w1, w0);
+			a[1] = audio_pack_bb(w3, w2);
+			b[0] = audio_pack_tt(w1, w0);
+			b[1] = audio_pack_tt(w3, w2);
+		}
+		src += words * 4;
+	}
+	if (i + 2 <= end) {
+		for (unsigned int p=0; p < words; p++) {
+			uint32_t w0 = src[p], w1 = src[words + p];
+			*(uint32_t *)(dst[p*2] + i) = audio_pack_bb(w1, w0);
+			*(uint32_t *)(dst[p*2 + 1] + i) = audio_pack_tt(w1, w0);
+		}
+		src += words * 2;
+		i += 2;
+	}
+	if (i < end) usb_audio_deinterleave_ref<Channels>(dst, i, src, 1);
+}
+
+#endif
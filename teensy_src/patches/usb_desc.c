@@ -636,7 +636,47 @@ static uint8_t microsoft_os_compatible_id_desc[] = {
 
 #define AUDIO_INTERFACE_DESC_POS	KEYMEDIA_INTERFACE_DESC_POS+KEYMEDIA_INTERFACE_DESC_SIZE
 #ifdef  AUDIO_INTERFACE
-#define AUDIO_INTERFACE_DESC_SIZE	8 + 9+10+12+9+12+12+9 + 9+9+7+11+9+7 + 9+9+7+11+9+7+9
+#define AUDIO_INTERFACE_DESC_SIZE	8 + 9+10+12+9+12+AUDIO_FEATURE_DESC_SIZE+9 + 9+9+7+11+9+7 + 9+9+7+11+9+7+9
+// the feature unit has a control byte for the master and one per channel
+#define AUDIO_FEATURE_DESC_SIZE		(8 + AUDIO_CHANNELS)
+#define AUDIO_CONTROL_TOTAL_LENGTH	(10+12+9+12+AUDIO_FEATURE_DESC_SIZE+9)
+// wChannelConfig: stereo, quad, or channels with no spatial position
+#if AUDIO_CHANNELS == 2
+#define AUDIO_CHANNEL_CONFIG		0x0003
+#elif AUDIO_CHANNELS == 4
+#define AUDIO_CHANNEL_CONFIG		0x000F
+#else
+#define AUDIO_CHANNEL_CONFIG		0x0000
+#endif
+// bmaControls(1) to bmaControls(AUDIO_CHANNELS): volume
+#define AUDIO_VOLUME_2			0x02, 0x02
+#define AUDIO_VOLUME_4			AUDIO_VOLUME_2, AUDIO_VOLUME_2
+#define AUDIO_VOLUME_8			AUDIO_VOLUME_4, AUDIO_VOLUME_4
+#if AUDIO_CHANNELS == 2
+#define AUDIO_CHANNEL_CONTROLS		AUDIO_VOLUME_2
+#elif AUDIO_CHANNELS == 4
+#define AUDIO_CHANNEL_CONTROLS		AUDIO_VOLUME_4
+#elif AUDIO_CHANNELS == 6
+#define AUDIO_CHANNEL_CONTROLS		AUDIO_VOLUME_4, AUDIO_VOLUME_2
+#elif AUDIO_CHANNELS == 8
+#define AUDIO_CHANNEL_CONTROLS		AUDIO_VOLUME_8
+#elif AUDIO_CHANNELS == 10
+#define AUDIO_CHANNEL_CONTROLS		AUDIO_VOLUME_8, AUDIO_VOLUME_2
+#elif AUDIO_CHANNELS == 12
+#define AUDIO_CHANNEL_CONTROLS		AUDIO_VOLUME_8, AUDIO_VOLUME_4
+#elif AUDIO_CHANNELS == 14
+#define AUDIO_CHANNEL_CONTROLS		AUDIO_VOLUME_8, AUDIO_VOLUME_4, AUDIO_VOLUME_2
+#elif AUDIO_CHANNELS == 16
+#define AUDIO_CHANNEL_CONTROLS		AUDIO_VOLUME_8, AUDIO_VOLUME_8
+#else
+#error "AUDIO_CHANNELS must be even, 2 to 16"
+#endif
+// one packet per 1 ms frame of up to 45 samples, or per micro-frame of up
+// to 7; only the high speed packet must fit, as full speed falls back to
+// zero bandwidth (AUDIO_TX_SIZE_12)
+#if AUDIO_TX_SIZE_480 > 1023 || AUDIO_RX_SIZE_480 > 1023
+#error "an isochronous packet is at most 1023 bytes: 10 channels, or 16 with USB_AUDIO_MICROFRAMES"
+#endif
 #else
 #define AUDIO_INTERFACE_DESC_SIZE	0
 #endif
@@ -1430,7 +1470,7 @@ PROGMEM const uint8_t usb_config_descriptor_480[CONFIG_DESC_SIZE] = {
 	0x24,					// bDescriptorType, 0x24 = CS_INTERFACE
 	0x01,					// bDescriptorSubtype, 1 = HEADER
 	0x00, 0x01,				// bcdADC (version 1.0)
-	LSB(64), MSB(64),			// wTotalLength (increased for 4ch)
+	LSB(AUDIO_CONTROL_TOTAL_LENGTH), MSB(AUDIO_CONTROL_TOTAL_LENGTH), // wTotalLength
 	2,					// bInCollection
 	AUDIO_INTERFACE+1,			// baInterfaceNr(1) - Transmit to PC
 	AUDIO_INTERFACE+2,			// baInterfaceNr(2) - Receive from PC
@@ -1444,8 +1484,8 @@ PROGMEM const uint8_t usb_config_descriptor_480[CONFIG_DESC_SIZE] = {
 	//0x03, 0x06,				// wTerminalType, 0x0603 = Line Connector
 	0x02, 0x06,				// wTerminalType, 0x0602 = Digital Audio
 	0,					// bAssocTerminal, 0 = unidirectional
-	4,					// bNrChannels
-	0x0F, 0x00,				// wChannelConfig, 0x000F = L/R Front + L/R Back
+	AUDIO_CHANNELS,				// bNrChannels
+	LSB(AUDIO_CHANNEL_CONFIG), MSB(AUDIO_CHANNEL_CONFIG), // wChannelConfig
 	0,					// iChannelNames
 	0, 					// iTerminal
 	// Output Terminal Descriptor
@@ -1466,22 +1506,19 @@ PROGMEM const uint8_t usb_config_descriptor_480[CONFIG_DESC_SIZE] = {
 	3,					// bTerminalID
 	0x01, 0x01,				// wTerminalType, 0x0101 = USB_STREAMING
 	0,					// bAssocTerminal, 0 = unidirectional
-	4,					// bNrChannels
-	0x0F, 0x00,				// wChannelConfig, 0x000F = L/R Front + L/R Back
+	AUDIO_CHANNELS,				// bNrChannels
+	LSB(AUDIO_CHANNEL_CONFIG), MSB(AUDIO_CHANNEL_CONFIG), // wChannelConfig
 	0,					// iChannelNames
 	0, 					// iTerminal
 	// Volume feature descriptor
-	12,					// bLength (increased for 4 channels)
+	AUDIO_FEATURE_DESC_SIZE,		// bLength
 	0x24, 				// bDescriptorType = CS_INTERFACE
 	0x06, 				// bDescriptorSubType = FEATURE_UNIT
 	0x31, 				// bUnitID
 	0x03, 				// bSourceID (Input Terminal)
-	0x01, 				// bControlSize (each channel is 1 byte, 5 total: master + 4 ch)
+	0x01, 				// bControlSize, one byte each for the master and every channel
 	0x01, 				// bmaControls(0) Master: Mute
-	0x02, 				// bmaControls(1) L1: Volume
-	0x02, 				// bmaControls(2) R1: Volume
-	0x02, 				// bmaControls(3) L2: Volume
-	0x02, 				// bmaControls(4) R2: Volume
+	AUDIO_CHANNEL_CONTROLS,		// bmaControls(1-n): Volume
 	0x00,				// iFeature
 	// Output Terminal Descriptor
 	// USB DCD for Audio Devices 1.0, Table 4-4, page 40
@@ -1530,7 +1567,7 @@ PROGMEM const uint8_t usb_config_descriptor_480[CONFIG_DESC_SIZE] = {
 	0x24,					// bDescriptorType = CS_INTERFACE
 	2,					// bDescriptorSubtype = FORMAT_TYPE
 	1,					// bFormatType = FORMAT_TYPE_I
-	4,					// bNrChannels = 4
+	AUDIO_CHANNELS,				// bNrChannels
 	2,					// bSubFrameSize = 2 byte
 	16,					// bBitResolution = 16 bits
 	1,					// bSamFreqType = 1 frequency
@@ -1541,8 +1578,8 @@ PROGMEM const uint8_t usb_config_descriptor_480[CONFIG_DESC_SIZE] = {
 	5, 					// bDescriptorType, 5 = ENDPOINT_DESCRIPTOR
 	AUDIO_TX_ENDPOINT | 0x80,		// bEndpointAddress
 	0x09, 					// bmAttributes = isochronous, adaptive
-	LSB(AUDIO_TX_SIZE), MSB(AUDIO_TX_SIZE),	// wMaxPacketSize
-	4,			 		// bInterval, 4 = every 8 micro-frames
+	LSB(AUDIO_TX_SIZE_480), MSB(AUDIO_TX_SIZE_480), // wMaxPacketSize
+	AUDIO_INTERVAL_480,			// bInterval, 1 or 4 = every 1 or 8 micro-frames
 	0,					// bRefresh
 	0,					// bSynchAddress
 	// Class-Specific AS Isochronous Audio Data Endpoint Descriptor
@@ -1589,7 +1626,7 @@ PROGMEM const uint8_t usb_config_descriptor_480[CONFIG_DESC_SIZE] = {
 	0x24,					// bDescriptorType = CS_INTERFACE
 	2,					// bDescriptorSubtype = FORMAT_TYPE
 	1,					// bFormatType = FORMAT_TYPE_I
-	4,					// bNrChannels = 4
+	AUDIO_CHANNELS,				// bNrChannels
 	2,					// bSubFrameSize = 2 byte
 	16,					// bBitResolution = 16 bits
 	1,					// bSamFreqType = 1 frequency
@@ -1600,8 +1637,8 @@ PROGMEM const uint8_t usb_config_descriptor_480[CONFIG_DESC_SIZE] = {
 	5, 					// bDescriptorType, 5 = ENDPOINT_DESCRIPTOR
 	AUDIO_RX_ENDPOINT,			// bEndpointAddress
 	0x05, 					// bmAttributes = isochronous, asynchronous
-	LSB(AUDIO_RX_SIZE), MSB(AUDIO_RX_SIZE),	// wMaxPacketSize
-	4,			 		// bInterval, 4 = every 8 micro-frames
+	LSB(AUDIO_RX_SIZE_480), MSB(AUDIO_RX_SIZE_480), // wMaxPacketSize
+	AUDIO_INTERVAL_480,			// bInterval, 1 or 4 = every 1 or 8 micro-frames
 	0,					// bRefresh
 	AUDIO_SYNC_ENDPOINT | 0x80,		// bSynchAddress
 	// Class-Specific AS Isochronous Audio Data Endpoint Descriptor
@@ -2446,7 +2483,7 @@ PROGMEM const uint8_t usb_config_descriptor_12[CONFIG_DESC_SIZE] = {
 	0x24,					// bDescriptorType, 0x24 = CS_INTERFACE
 	0x01,					// bDescriptorSubtype, 1 = HEADER
 	0x00, 0x01,				// bcdADC (version 1.0)
-	LSB(64), MSB(64),			// wTotalLength (increased for 4ch)
+	LSB(AUDIO_CONTROL_TOTAL_LENGTH), MSB(AUDIO_CONTROL_TOTAL_LENGTH), // wTotalLength
 	2,					// bInCollection
 	AUDIO_INTERFACE+1,			// baInterfaceNr(1) - Transmit to PC
 	AUDIO_INTERFACE+2,			// baInterfaceNr(2) - Receive from PC
@@ -2460,8 +2497,8 @@ PROGMEM const uint8_t usb_config_descriptor_12[CONFIG_DESC_SIZE] = {
 	//0x03, 0x06,				// wTerminalType, 0x0603 = Line Connector
 	0x02, 0x06,				// wTerminalType, 0x0602 = Digital Audio
 	0,					// bAssocTerminal, 0 = unidirectional
-	4,					// bNrChannels
-	0x0F, 0x00,				// wChannelConfig, 0x000F = L/R Front + L/R Back
+	AUDIO_CHANNELS,				// bNrChannels
+	LSB(AUDIO_CHANNEL_CONFIG), MSB(AUDIO_CHANNEL_CONFIG), // wChannelConfig
 	0,					// iChannelNames
 	0, 					// iTerminal
 	// Output Terminal Descriptor
@@ -2482,22 +2519,19 @@ PROGMEM const uint8_t usb_config_descriptor_12[CONFIG_DESC_SIZE] = {
 	3,					// bTerminalID
 	0x01, 0x01,				// wTerminalType, 0x0101 = USB_STREAMING
 	0,					// bAssocTerminal, 0 = unidirectional
-	4,					// bNrChannels
-	0x0F, 0x00,				// wChannelConfig, 0x000F = L/R Front + L/R Back
+	AUDIO_CHANNELS,				// bNrChannels
+	LSB(AUDIO_CHANNEL_CONFIG), MSB(AUDIO_CHANNEL_CONFIG), // wChannelConfig
 	0,					// iChannelNames
 	0, 					// iTerminal
 	// Volume feature descriptor
-	12,					// bLength (increased for 4 channels)
+	AUDIO_FEATURE_DESC_SIZE,		// bLength
 	0x24, 				// bDescriptorType = CS_INTERFACE
 	0x06, 				// bDescriptorSubType = FEATURE_UNIT
 	0x31, 				// bUnitID
 	0x03, 				// bSourceID (Input Terminal)
-	0x01, 				// bControlSize (each channel is 1 byte, 5 total: master + 4 ch)
+	0x01, 				// bControlSize, one byte each for the master and every channel
 	0x01, 				// bmaControls(0) Master: Mute
-	0x02, 				// bmaControls(1) L1: Volume
-	0x02, 				// bmaControls(2) R1: Volume
-	0x02, 				// bmaControls(3) L2: Volume
-	0x02, 				// bmaControls(4) R2: Volume
+	AUDIO_CHANNEL_CONTROLS,		// bmaControls(1-n): Volume
 	0x00,				// iFeature
 	// Output Terminal Descriptor
 	// USB DCD for Audio Devices 1.0, Table 4-4, page 40
@@ -2546,7 +2580,7 @@ PROGMEM const uint8_t usb_config_descriptor_12[CONFIG_DESC_SIZE] = {
 	0x24,					// bDescriptorType = CS_INTERFACE
 	2,					// bDescriptorSubtype = FORMAT_TYPE
 	1,					// bFormatType = FORMAT_TYPE_I
-	4,					// bNrChannels = 4
+	AUDIO_CHANNELS,				// bNrChannels
 	2,					// bSubFrameSize = 2 byte
 	16,					// bBitResolution = 16 bits
 	1,					// bSamFreqType = 1 frequency
@@ -2557,7 +2591,7 @@ PROGMEM const uint8_t usb_config_descriptor_12[CONFIG_DESC_SIZE] = {
 	5, 					// bDescriptorType, 5 = ENDPOINT_DESCRIPTOR
 	AUDIO_TX_ENDPOINT | 0x80,		// bEndpointAddress
 	0x09, 					// bmAttributes = isochronous, adaptive
-	LSB(AUDIO_TX_SIZE), MSB(AUDIO_TX_SIZE),	// wMaxPacketSize
+	LSB(AUDIO_TX_SIZE_12), MSB(AUDIO_TX_SIZE_12), // wMaxPacketSize, 0 above 10 channels
 	1,			 		// bInterval, 1 = every frame
 	0,					// bRefresh
 	0,					// bSynchAddress
@@ -2605,7 +2639,7 @@ PROGMEM const uint8_t usb_config_descriptor_12[CONFIG_DESC_SIZE] = {
 	0x24,					// bDescriptorType = CS_INTERFACE
 	2,					// bDescriptorSubtype = FORMAT_TYPE
 	1,					// bFormatType = FORMAT_TYPE_I
-	4,					// bNrChannels = 4
+	AUDIO_CHANNELS,				// bNrChannels
 	2,					// bSubFrameSize = 2 byte
 	16,					// bBitResolution = 16 bits
 	1,					// bSamFreqType = 1 frequency
@@ -2616,7 +2650,7 @@ PROGMEM const uint8_t usb_config_descriptor_12[CONFIG_DESC_SIZE] = {
 	5, 					// bDescriptorType, 5 = ENDPOINT_DESCRIPTOR
 	AUDIO_RX_ENDPOINT,			// bEndpointAddress
 	0x05, 					// bmAttributes = isochronous, asynchronous
-	LSB(AUDIO_RX_SIZE), MSB(AUDIO_RX_SIZE),	// wMaxPacketSize
+	LSB(AUDIO_RX_SIZE_12), MSB(AUDIO_RX_SIZE_12), // wMaxPacketSize, 0 above 10 channels
 	1,			 		// bInterval, 1 = every frame
 	0,					// bRefresh
 	AUDIO_SYNC_ENDPOINT | 0x80,		// bSynchAddress
@@ -2634,7 +2668,7 @@ PROGMEM const uint8_t usb_config_descriptor_12[CONFIG_DESC_SIZE] = {
 	5, 					// bDescriptorType, 5 = ENDPOINT_DESCRIPTOR
 	AUDIO_SYNC_ENDPOINT | 0x80,		// bEndpointAddress
 	0x11, 					// bmAttributes = isochronous, feedback
-	3, 0,					// wMaxPacketSize, 3 bytes
+	AUDIO_SYNC_SIZE_12, 0,			// wMaxPacketSize, 3 bytes or 0
 	1,			 		// bInterval, 1 = every frame
 	5,					// bRefresh, 5 = 32ms
 	0,					// bSynchAddress
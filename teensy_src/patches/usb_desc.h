@@ -748,8 +748,16 @@ let me know?  http://forum.pjrc.com/forums/4-Suggestions-amp-Bug-Reports
   #define PRODUCT_ID		0x04D6  // 4-channel audio device
   #define MANUFACTURER_NAME	{'T','e','e','n','s','y','d','u','i','n','o'}
   #define MANUFACTURER_NAME_LEN	11
-  #define PRODUCT_NAME		{'T','e','e','n','s','y',' ','A','u','d','i','o',' ','4','C','H'}
+  #ifndef AUDIO_CHANNELS
+  #define AUDIO_CHANNELS        4    // or -DAUDIO_CHANNELS=n
+  #endif
+  #if AUDIO_CHANNELS >= 10
+  #define PRODUCT_NAME		{'T','e','e','n','s','y',' ','A','u','d','i','o',' ','0'+AUDIO_CHANNELS/10,'0'+AUDIO_CHANNELS%10,'C','H'}
+  #define PRODUCT_NAME_LEN	17
+  #else
+  #define PRODUCT_NAME		{'T','e','e','n','s','y',' ','A','u','d','i','o',' ','0'+AUDIO_CHANNELS,'C','H'}
   #define PRODUCT_NAME_LEN	16
+  #endif
   #define EP0_SIZE		64
   #define NUM_ENDPOINTS         4
   #define NUM_INTERFACE		4
@@ -762,9 +770,9 @@ let me know?  http://forum.pjrc.com/forums/4-Suggestions-amp-Bug-Reports
   #define SEREMU_RX_INTERVAL    2
   #define AUDIO_INTERFACE	1	// Audio (uses 3 consecutive interfaces)
   #define AUDIO_TX_ENDPOINT     3
-  #define AUDIO_TX_SIZE         360  // 4 channels
+  #define AUDIO_TX_SIZE         (AUDIO_CHANNELS * 90)
   #define AUDIO_RX_ENDPOINT     3
-  #define AUDIO_RX_SIZE         360
+  #define AUDIO_RX_SIZE         (AUDIO_CHANNELS * 90)
   #define AUDIO_SYNC_ENDPOINT	4
   #define ENDPOINT2_CONFIG	ENDPOINT_RECEIVE_INTERRUPT + ENDPOINT_TRANSMIT_INTERRUPT
   #define ENDPOINT3_CONFIG	ENDPOINT_RECEIVE_ISOCHRONOUS + ENDPOINT_TRANSMIT_ISOCHRONOUS
@@ -789,6 +797,7 @@ let me know?  http://forum.pjrc.com/forums/4-Suggestions-amp-Bug-Reports
   #define SEREMU_RX_INTERVAL    2
   #define AUDIO_INTERFACE	1	// Audio (uses 3 consecutive interfaces)
   #define AUDIO_TX_ENDPOINT     3
+  #define AUDIO_CHANNELS        8
   #define AUDIO_TX_SIZE         720  // 8 channels (8 * 90 = 720)
   #define AUDIO_RX_ENDPOINT     3
   #define AUDIO_RX_SIZE         720
@@ -978,6 +987,42 @@ let me know?  http://forum.pjrc.com/forums/4-Suggestions-amp-Bug-Reports
 
 #endif
 
+// Audio channels in each direction, 16 bits each; a packet carries up to
+// 45 samples of every channel, so AUDIO_TX_SIZE and AUDIO_RX_SIZE are at
+// least 90 x AUDIO_CHANNELS
+#if defined(AUDIO_INTERFACE) && !defined(AUDIO_CHANNELS)
+#define AUDIO_CHANNELS		2
+#endif
+
+// With -DUSB_AUDIO_MICROFRAMES the audio endpoints of a high speed device
+// move a packet every 125 us micro-frame instead of every 1 ms frame, of
+// up to 7 samples (USB_AUDIO_MAX_MICROFRAME_SAMPLES); at full speed they
+// stay one packet per frame
+#ifdef AUDIO_INTERFACE
+#ifdef USB_AUDIO_MICROFRAMES
+#define AUDIO_INTERVAL_480	1	// bInterval, every micro-frame
+#define AUDIO_TX_SIZE_480	(AUDIO_CHANNELS * 14)
+#define AUDIO_RX_SIZE_480	(AUDIO_CHANNELS * 14)
+#else
+#define AUDIO_INTERVAL_480	4	// bInterval, every 8 micro-frames
+#define AUDIO_TX_SIZE_480	AUDIO_TX_SIZE
+#define AUDIO_RX_SIZE_480	AUDIO_RX_SIZE
+#endif
+// A full speed packet of every channel fits an isochronous endpoint's 1023
+// bytes up to 10 channels.  Above that the full speed configuration keeps
+// its streaming alternates at zero bandwidth, and audio only moves at high
+// speed, in micro-frames
+#if AUDIO_TX_SIZE > 1023 || AUDIO_RX_SIZE > 1023
+#define AUDIO_TX_SIZE_12	0
+#define AUDIO_RX_SIZE_12	0
+#define AUDIO_SYNC_SIZE_12	0
+#else
+#define AUDIO_TX_SIZE_12	AUDIO_TX_SIZE
+#define AUDIO_RX_SIZE_12	AUDIO_RX_SIZE
+#define AUDIO_SYNC_SIZE_12	3
+#endif
+#endif
+
 #ifdef USB_DESC_LIST_DEFINE
 #if defined(NUM_ENDPOINTS) && NUM_ENDPOINTS > 0
 // NUM_ENDPOINTS = number of non-zero endpoints (0 to 7)
@@ -0,0 +1,55 @@
+/* Host simulation stand-in for the Teensyduino Arduino.h
+ *
+ * Provides just enough of the core for the sources in teensy_src to build
+ * and run on a workstation: fixed-width types, memory attributes, interrupt
+ * masking, a stdout Print and the cache maintenance calls (which are
+ * counted, not executed).
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "imxrt_sim.h"
+#include "Print.h"
+
+#ifndef __IMXRT1062__
+#define __IMXRT1062__ 1
+#endif
+#ifndef TEENSY_SIM
+#define TEENSY_SIM 1
+#endif
+#ifndef IMXRT_CACHE_ENABLED
+#define IMXRT_CACHE_ENABLED 2
+#endif
+
+#define F_CPU_ACTUAL SIM_F_CPU
+
+#define DMAMEM
+#define FASTRUN
+#define PROGMEM
+
+// Interrupts never preempt in the simulation; the DMA engine calls ISRs
+// synchronously, so masking only needs to be tracked for assertions.
+extern volatile uint32_t sim_irq_disabled;
+static inline void __disable_irq(void) { sim_irq_disabled++; }
+static inline void __enable_irq(void) { if (sim_irq_disabled) sim_irq_disabled--; }
+
+static inline uint32_t millis(void) { return sim_nanos() / 1000000; }
+
+// Cache maintenance is a no-op on the host; the byte count is tallied so
+// buffer placement options can be compared.
+extern uint64_t sim_dcache_bytes;
+extern uint32_t sim_dcache_calls;
+static inline void arm_dcache_flush(void *addr, uint32_t size)
+	{ (void)addr; sim_dcache_bytes += size; sim_dcache_calls++; }
+static inline void arm_dcache_delete(void *addr, uint32_t size)
+	{ (void)addr; sim_dcache_bytes += size; sim_dcache_calls++; }
+static inline void arm_dcache_flush_delete(void *addr, uint32_t size)
+	{ (void)addr; sim_dcache_bytes += size; sim_dcache_calls++; }
+
+#endif
@@ -0,0 +1,100 @@
+/* Host simulation stand-in for the Teensy AudioStream.h
+ *
+ * Mirrors the public and protected interface of the Teensy 4 core closely
+ * enough that audio objects written against it compile unchanged: a
+ * reference-counted block pool, AudioConnection routing and update_all()
+ * scheduling.  update_all() only pends the software interrupt; the
+ * simulation runs it after the DMA ISR that requested it returns, just as
+ * NVIC would on hardware.
+ */
+
+#ifndef AudioStream_h
+#define AudioStream_h
+
+#include "Arduino.h"
+
+#ifndef AUDIO_BLOCK_SAMPLES
+#define AUDIO_BLOCK_SAMPLES  128
+#endif
+#ifndef AUDIO_SAMPLE_RATE_EXACT
+#define AUDIO_SAMPLE_RATE_EXACT 44100.0f
+#endif
+#define AUDIO_SAMPLE_RATE AUDIO_SAMPLE_RATE_EXACT
+
+class AudioStream;
+class AudioConnection;
+
+typedef struct audio_block_struct {
+	uint8_t  ref_count;
+	uint8_t  reserved1;
+	uint16_t memory_pool_index;
+	int16_t  data[AUDIO_BLOCK_SAMPLES];
+} audio_block_t;
+
+class AudioConnection
+{
+public:
+	AudioConnection(AudioStream &source, AudioStream &destination) :
+		AudioConnection(source, 0, destination, 0) { }
+	AudioConnection(AudioStream &source, unsigned char sourceOutput,
+		AudioStream &destination, unsigned char destinationInput);
+	friend class AudioStream;
+protected:
+	AudioStream &src;
+	AudioStream &dst;
+	unsigned char src_index;
+	unsigned char dest_index;
+	AudioConnection *next_dest;
+	bool isConnected;
+};
+
+#define AudioMemory(num) ({ \
+	static audio_block_t data[num]; \
+	AudioStream::initialize_memory(data, num); \
+})
+
+// The update cost is not scaled to an audio period on the host, so the
+// processor usage always reads zero.
+#define AudioMemoryUsage() (AudioStream::memory_used)
+#define AudioMemoryUsageMax() (AudioStream::memory_used_max)
+#define AudioProcessorUsage() (0.0f)
+#define AudioProcessorUsageMax() (0.0f)
+
+class AudioStream
+{
+public:
+	AudioStream(unsigned char ninput, audio_block_t **iqueue);
+	virtual ~AudioStream();
+	static void initialize_memory(audio_block_t *data, unsigned int num);
+	static uint16_t memory_used;
+	static uint16_t memory_used_max;
+	// simulation hooks
+	static void sim_reset(void);
+	static bool sim_run_pending(void);
+protected:
+	bool active;
+	unsigned char num_inputs;
+	static audio_block_t * allocate(void);
+	static void release(audio_block_t * block);
+	void transmit(audio_block_t *block, unsigned char index = 0);
+	audio_block_t * receiveReadOnly(unsigned int index = 0);
+	audio_block_t * receiveWritable(unsigned int index = 0);
+	static bool update_setup(void);
+	static void update_stop(void);
+	static void update_all(void) { update_pending = true; }
+	friend class AudioConnection;
+	uint8_t numConnections;
+private:
+	AudioConnection *destination_list;
+	audio_block_t **inputQueue;
+	static bool update_scheduled;
+	static bool update_pending;
+	virtual void update(void) = 0;
+	static void software_isr(void);
+	static AudioStream *first_update;
+	AudioStream *next_update;
+	static audio_block_t *memory_pool;
+	static unsigned int memory_pool_size;
+};
+
+#endif
@@ -0,0 +1,58 @@
+/* Host simulation stand-in for DMAChannel.h
+ *
+ * A DMAChannel owns one slot of the emulated eDMA engine.  The TCD fields
+ * are plain memory; the engine in sim_core.cpp interprets them when the
+ * SAI model raises a request for the channel's trigger source.  DMASetting
+ * holds a TCD in memory for scatter/gather chains.
+ */
+
+#ifndef DMAChannel_h_
+#define DMAChannel_h_
+
+#include "Arduino.h"
+
+class DMABaseClass {
+public:
+	TCD_t *TCD;
+	uint8_t channel;
+
+	void replaceSettingsOnCompletion(const DMABaseClass &settings) {
+		TCD->DLASTSGA = (intptr_t)settings.TCD;
+		TCD->CSR &= ~DMA_TCD_CSR_DREQ;
+		TCD->CSR |= DMA_TCD_CSR_ESG;
+	}
+	void interruptAtCompletion(void) { TCD->CSR |= DMA_TCD_CSR_INTMAJOR; }
+	void interruptAtHalf(void) { TCD->CSR |= DMA_TCD_CSR_INTHALF; }
+	void disableOnCompletion(void) { TCD->CSR |= DMA_TCD_CSR_DREQ; }
+};
+
+// A TCD in memory for scatter/gather chains.
+class DMASetting : public DMABaseClass {
+public:
+	DMASetting() { TCD = &tcddata; channel = SIM_DMA_CHANNELS; memset(&tcddata, 0, sizeof(tcddata)); }
+private:
+	TCD_t tcddata __attribute__((aligned(32)));
+};
+
+class DMAChannel : public DMABaseClass {
+public:
+	DMAChannel() { begin(); }
+	DMAChannel(bool allocate) {
+		TCD = nullptr;
+		channel = SIM_DMA_CHANNELS;
+		if (allocate) begin();
+	}
+	DMAChannel & operator = (const DMABaseClass &rhs) { *TCD = *rhs.TCD; return *this; }
+	void begin(bool force_initialization = false);
+	void release(void);
+	void enable(void) { sim_dma[channel].enabled = 1; }
+	void disable(void) { sim_dma[channel].enabled = 0; }
+	void triggerAtHardwareEvent(uint8_t source) { sim_dma[channel].source = source; }
+	void attachInterrupt(void (*isr)(void)) { sim_dma[channel].isr = isr; }
+	void attachInterrupt(void (*isr)(void), uint8_t prio) { (void)prio; attachInterrupt(isr); }
+	void clearInterrupt(void) { }
+	void clearComplete(void) { }
+	bool complete(void) { return false; }
+};
+
+#endif
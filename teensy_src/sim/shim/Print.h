@@ -0,0 +1,36 @@
+/* Host simulation stand-in for the Teensyduino Print class
+ *
+ * Only the formatted and raw output used by teensy_src diagnostics and
+ * telemetry; everything goes to stdout.
+ */
+
+#ifndef Print_h
+#define Print_h
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+class Print
+{
+public:
+	int printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+	{
+		va_list args;
+		va_start(args, format);
+		int n = vprintf(format, args);
+		va_end(args);
+		return n;
+	}
+	size_t print(const char *s) { return fputs(s, stdout) >= 0 ? strlen(s) : 0; }
+	size_t println(const char *s = "") { size_t n = print(s); putchar('\n'); return n + 1; }
+	virtual size_t write(const uint8_t *buffer, size_t size) { return fwrite(buffer, 1, size, stdout); }
+	// bytes that can be written without blocking; 0 as in the core's Print
+	virtual int availableForWrite(void) { return 0; }
+	virtual ~Print() { }
+};
+
+extern Print sim_stdout;
+
+#endif
@@ -0,0 +1,9 @@
+/* Host simulation stand-in for avr/pgmspace.h: flash and RAM are one
+ * address space on the host, as they are on Teensy 4. */
+
+#ifndef pgmspace_h_
+#define pgmspace_h_
+
+#define PROGMEM
+
+#endif
@@ -0,0 +1,21 @@
+/* Host simulation stand-in for the Teensy core's avr_functions.h: only
+ * ultoa(), which patches/usb_desc.c uses for the serial number. */
+
+#ifndef avr_functions_h_
+#define avr_functions_h_
+
+static inline char *ultoa(unsigned long val, char *buf, int radix)
+{
+	char tmp[33], *p = tmp;
+	int i = 0;
+	do {
+		unsigned int d = val % radix;
+		*p++ = d < 10 ? '0' + d : 'A' + d - 10;
+		val /= radix;
+	} while (val);
+	while (p > tmp) buf[i++] = *--p;
+	buf[i] = 0;
+	return buf;
+}
+
+#endif
@@ -0,0 +1,4 @@
+/* Host simulation stand-in for the Teensy core's debug/printf.h: debug
+ * printing compiled out, as in a release build of the core. */
+
+#define printf(...)
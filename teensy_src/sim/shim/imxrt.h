@@ -0,0 +1,12 @@
+/* Host simulation stand-in for the Teensy core's imxrt.h, for the C
+ * sources (patches/usb_desc.c): the modelled registers, and a fixed MAC
+ * fuse for the USB serial number. */
+
+#ifndef imxrt_h_
+#define imxrt_h_
+
+#include "imxrt_sim.h"
+
+#define HW_OCOTP_MAC0	0x00123456u
+
+#endif
@@ -0,0 +1,274 @@
+/* Host simulation of the i.MX RT1062 peripherals used by the audio objects
+ *
+ * Only the SAI1 registers, the eDMA transfer control descriptors and the
+ * handful of clock/pin registers touched by teensy_src are modelled.  The
+ * register names match imxrt.h so the real sources compile unmodified with
+ * -I sim/shim ahead of the Teensy core.
+ */
+
+#ifndef imxrt_sim_h_
+#define imxrt_sim_h_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ---------------------------------------------------------------------------
+// SAI (I2S) register block
+
+typedef struct {
+	volatile uint32_t TCSR;
+	volatile uint32_t TCR1;
+	volatile uint32_t TCR2;
+	volatile uint32_t TCR3;
+	volatile uint32_t TCR4;
+	volatile uint32_t TCR5;
+	volatile uint32_t TDR[4];
+	volatile uint32_t TMR;
+	volatile uint32_t RCSR;
+	volatile uint32_t RCR1;
+	volatile uint32_t RCR2;
+	volatile uint32_t RCR3;
+	volatile uint32_t RCR4;
+	volatile uint32_t RCR5;
+	volatile uint32_t RDR[4];
+	volatile uint32_t RMR;
+} sim_sai_regs_t;
+
+extern sim_sai_regs_t sim_sai1;
+
+#define I2S1_TCSR		(sim_sai1.TCSR)
+#define I2S1_TCR1		(sim_sai1.TCR1)
+#define I2S1_TCR2		(sim_sai1.TCR2)
+#define I2S1_TCR3		(sim_sai1.TCR3)
+#define I2S1_TCR4		(sim_sai1.TCR4)
+#define I2S1_TCR5		(sim_sai1.TCR5)
+#define I2S1_TDR0		(sim_sai1.TDR[0])
+#define I2S1_TDR1		(sim_sai1.TDR[1])
+#define I2S1_TDR2		(sim_sai1.TDR[2])
+#define I2S1_TDR3		(sim_sai1.TDR[3])
+#define I2S1_TMR		(sim_sai1.TMR)
+#define I2S1_RCSR		(sim_sai1.RCSR)
+#define I2S1_RCR1		(sim_sai1.RCR1)
+#define I2S1_RCR2		(sim_sai1.RCR2)
+#define I2S1_RCR3		(sim_sai1.RCR3)
+#define I2S1_RCR4		(sim_sai1.RCR4)
+#define I2S1_RCR5		(sim_sai1.RCR5)
+#define I2S1_RDR0		(sim_sai1.RDR[0])
+#define I2S1_RDR1		(sim_sai1.RDR[1])
+#define I2S1_RDR2		(sim_sai1.RDR[2])
+#define I2S1_RDR3		(sim_sai1.RDR[3])
+#define I2S1_RMR		(sim_sai1.RMR)
+
+#define I2S_TCSR_TE		((uint32_t)1<<31)
+#define I2S_TCSR_BCE		((uint32_t)1<<28)
+#define I2S_TCSR_FR		((uint32_t)1<<25)
+#define I2S_TCSR_SR		((uint32_t)1<<24)
+#define I2S_TCSR_FEF		((uint32_t)1<<18)
+#define I2S_TCSR_FRDE		((uint32_t)1<<0)
+#define I2S_RCSR_RE		((uint32_t)1<<31)
+#define I2S_RCSR_BCE		((uint32_t)1<<28)
+#define I2S_RCSR_FR		((uint32_t)1<<25)
+#define I2S_RCSR_SR		((uint32_t)1<<24)
+#define I2S_RCSR_FEF		((uint32_t)1<<18)
+#define I2S_RCSR_FRDE		((uint32_t)1<<0)
+
+#define I2S_TCR1_RFW(n)		((uint32_t)(n) & 0x1F)
+#define I2S_TCR2_SYNC(n)	(((uint32_t)(n) & 3) << 30)
+#define I2S_TCR2_BCP		((uint32_t)1<<25)
+#define I2S_TCR2_BCD		((uint32_t)1<<24)
+#define I2S_TCR2_MSEL(n)	(((uint32_t)(n) & 3) << 26)
+#define I2S_TCR2_DIV(n)		((uint32_t)(n) & 0xFF)
+#define I2S_TCR3_TCE		((uint32_t)0x10000)
+#define I2S_TCR3_TCE_2CH	((uint32_t)0x30000)
+#define I2S_TCR3_TCE_3CH	((uint32_t)0x70000)
+#define I2S_TCR3_TCE_4CH	((uint32_t)0xF0000)
+#define I2S_TCR4_FRSZ(n)	(((uint32_t)(n) & 0x1F) << 16)
+#define I2S_TCR4_SYWD(n)	(((uint32_t)(n) & 0x1F) << 8)
+#define I2S_TCR4_MF		((uint32_t)1<<4)
+#define I2S_TCR4_FSE		((uint32_t)1<<3)
+#define I2S_TCR4_FSP		((uint32_t)1<<1)
+#define I2S_TCR4_FSD		((uint32_t)1<<0)
+#define I2S_TCR5_WNW(n)		(((uint32_t)(n) & 0x1F) << 24)
+#define I2S_TCR5_W0W(n)		(((uint32_t)(n) & 0x1F) << 16)
+#define I2S_TCR5_FBT(n)		(((uint32_t)(n) & 0x1F) << 8)
+
+#define I2S_RCR1_RFW(n)		((uint32_t)(n) & 0x1F)
+#define I2S_RCR2_SYNC(n)	(((uint32_t)(n) & 3) << 30)
+#define I2S_RCR2_BCP		((uint32_t)1<<25)
+#define I2S_RCR2_BCD		((uint32_t)1<<24)
+#define I2S_RCR2_MSEL(n)	(((uint32_t)(n) & 3) << 26)
+#define I2S_RCR2_DIV(n)		((uint32_t)(n) & 0xFF)
+#define I2S_RCR3_RCE		((uint32_t)0x10000)
+#define I2S_RCR3_RCE_2CH	((uint32_t)0x30000)
+#define I2S_RCR3_RCE_3CH	((uint32_t)0x70000)
+#define I2S_RCR3_RCE_4CH	((uint32_t)0xF0000)
+#define I2S_RCR4_FRSZ(n)	(((uint32_t)(n) & 0x1F) << 16)
+#define I2S_RCR4_SYWD(n)	(((uint32_t)(n) & 0x1F) << 8)
+#define I2S_RCR4_MF		((uint32_t)1<<4)
+#define I2S_RCR4_FSE		((uint32_t)1<<3)
+#define I2S_RCR4_FSP		((uint32_t)1<<1)
+#define I2S_RCR4_FSD		((uint32_t)1<<0)
+#define I2S_RCR5_WNW(n)		(((uint32_t)(n) & 0x1F) << 24)
+#define I2S_RCR5_W0W(n)		(((uint32_t)(n) & 0x1F) << 16)
+#define I2S_RCR5_FBT(n)		(((uint32_t)(n) & 0x1F) << 8)
+
+// ---------------------------------------------------------------------------
+// Clock gating and pin mux (write-only sinks in the simulation)
+
+extern volatile uint32_t sim_ccm_ccgr5;
+extern volatile uint32_t sim_pin_config[64];
+
+#define CCM_CCGR5		sim_ccm_ccgr5
+#define CCM_CCGR5_SAI1(n)	((uint32_t)(((n) & 0x03) << 18))
+#define CCM_CCGR_ON		3
+
+extern volatile uint32_t sim_ccm_cscmr1;
+extern volatile uint32_t sim_ccm_cs1cdr;
+extern volatile uint32_t sim_iomuxc_gpr1;
+extern volatile uint32_t sim_sai1_rx_data_select[4];
+
+#define CCM_CSCMR1				sim_ccm_cscmr1
+#define CCM_CSCMR1_SAI1_CLK_SEL_MASK		((uint32_t)(0x03 << 10))
+#define CCM_CSCMR1_SAI1_CLK_SEL(n)		((uint32_t)(((n) & 0x03) << 10))
+#define CCM_CS1CDR				sim_ccm_cs1cdr
+#define CCM_CS1CDR_SAI1_CLK_PRED_MASK		((uint32_t)(0x07 << 6))
+#define CCM_CS1CDR_SAI1_CLK_PODF_MASK		((uint32_t)(0x3F << 0))
+#define CCM_CS1CDR_SAI1_CLK_PRED(n)		((uint32_t)(((n) & 0x07) << 6))
+#define CCM_CS1CDR_SAI1_CLK_PODF(n)		((uint32_t)(((n) & 0x3F) << 0))
+#define IOMUXC_GPR_GPR1				sim_iomuxc_gpr1
+#define IOMUXC_GPR_GPR1_SAI1_MCLK1_SEL_MASK	((uint32_t)(0x07 << 0))
+#define IOMUXC_GPR_GPR1_SAI1_MCLK1_SEL(n)	((uint32_t)(((n) & 0x07) << 0))
+#define IOMUXC_GPR_GPR1_SAI1_MCLK_DIR		((uint32_t)(1 << 19))
+#define IOMUXC_SAI1_RX_DATA0_SELECT_INPUT	(sim_sai1_rx_data_select[0])
+#define IOMUXC_SAI1_RX_DATA1_SELECT_INPUT	(sim_sai1_rx_data_select[1])
+#define IOMUXC_SAI1_RX_DATA2_SELECT_INPUT	(sim_sai1_rx_data_select[2])
+#define IOMUXC_SAI1_RX_DATA3_SELECT_INPUT	(sim_sai1_rx_data_select[3])
+
+#define CORE_PIN6_CONFIG	(sim_pin_config[6])
+#define CORE_PIN7_CONFIG	(sim_pin_config[7])
+#define CORE_PIN8_CONFIG	(sim_pin_config[8])
+#define CORE_PIN20_CONFIG	(sim_pin_config[20])
+#define CORE_PIN21_CONFIG	(sim_pin_config[21])
+#define CORE_PIN23_CONFIG	(sim_pin_config[23])
+#define CORE_PIN32_CONFIG	(sim_pin_config[32])
+#define CORE_PIN9_CONFIG	(sim_pin_config[9])
+
+// ---------------------------------------------------------------------------
+// eDMA transfer control descriptor, same field order as DMAChannel.h.
+// DLASTSGA is widened to hold a host pointer for scatter/gather.
+
+typedef struct {
+	volatile const void * volatile SADDR;
+	int16_t SOFF;
+	union { uint16_t ATTR;
+		struct { uint8_t ATTR_DST; uint8_t ATTR_SRC; }; };
+	union { uint32_t NBYTES; uint32_t NBYTES_MLNO;
+		uint32_t NBYTES_MLOFFNO; uint32_t NBYTES_MLOFFYES; };
+	int32_t SLAST;
+	volatile void * volatile DADDR;
+	int16_t DOFF;
+	union { volatile uint16_t CITER;
+		volatile uint16_t CITER_ELINKYES; volatile uint16_t CITER_ELINKNO; };
+	intptr_t DLASTSGA;
+	volatile uint16_t CSR;
+	union { volatile uint16_t BITER;
+		volatile uint16_t BITER_ELINKYES; volatile uint16_t BITER_ELINKNO; };
+} TCD_t;
+
+#define DMA_TCD_ATTR_SSIZE(n)		(((n) & 0x7) << 8)
+#define DMA_TCD_ATTR_DSIZE(n)		(((n) & 0x7) << 0)
+#define DMA_TCD_NBYTES_SMLOE		((uint32_t)1<<31)
+#define DMA_TCD_NBYTES_DMLOE		((uint32_t)1<<30)
+#define DMA_TCD_NBYTES_MLOFFYES_NBYTES(n)	((uint32_t)((n) & 0x3FF))
+#define DMA_TCD_NBYTES_MLOFFYES_MLOFF(n)	((uint32_t)(((n) & 0xFFFFF) << 10))
+#define DMA_TCD_CSR_START		0x0001
+#define DMA_TCD_CSR_INTMAJOR		0x0002
+#define DMA_TCD_CSR_INTHALF		0x0004
+#define DMA_TCD_CSR_DREQ		0x0008
+#define DMA_TCD_CSR_ESG			0x0010
+
+#define DMAMUX_SOURCE_SAI1_RX		19
+#define DMAMUX_SOURCE_SAI1_TX		20
+
+// ---------------------------------------------------------------------------
+// Simulation engine
+
+#define SIM_DMA_CHANNELS		32
+#define SIM_SAI_FIFO_DEPTH		32
+
+typedef struct {
+	TCD_t tcd;
+	uint8_t allocated;
+	uint8_t enabled;
+	uint8_t source;
+	void (*isr)(void);
+	uint32_t interrupts;
+	uint32_t minor_loops;
+	// per-ISR host cost, nanoseconds
+	uint64_t isr_ns_total;
+	uint64_t isr_ns_min;
+	uint64_t isr_ns_max;
+} sim_dma_channel_t;
+
+extern sim_dma_channel_t sim_dma[SIM_DMA_CHANNELS];
+
+// Wire capture of SAI1 transmit data, one entry per FIFO word per lane.
+typedef void (*sim_wire_sink_t)(unsigned int lane, uint32_t word, void *arg);
+void sim_sai1_set_tx_sink(sim_wire_sink_t sink, void *arg);
+
+// Clock one frame through SAI1 transmit: each enabled lane pulls
+// FRSZ+1 words from its FIFO, issuing DMA requests as the FIFO drains.
+void sim_sai1_tx_frame(void);
+unsigned int sim_sai1_tx_words_per_frame(void);
+unsigned int sim_sai1_tx_lanes(void);
+uint32_t sim_sai1_tx_underruns(void);
+
+// Wire source for SAI1 receive: returns the next word on a lane.
+typedef uint32_t (*sim_wire_source_t)(unsigned int lane, void *arg);
+void sim_sai1_set_rx_source(sim_wire_source_t source, void *arg);
+
+// Clock one frame through SAI1 receive: each enabled lane pushes FRSZ+1
+// words into its FIFO, and DMA requests are raised while every enabled
+// lane has a word waiting.
+void sim_sai1_rx_frame(void);
+unsigned int sim_sai1_rx_words_per_frame(void);
+unsigned int sim_sai1_rx_lanes(void);
+uint32_t sim_sai1_rx_overruns(void);
+
+// ---------------------------------------------------------------------------
+// Core: NVIC vector table and DWT cycle counter
+
+#define IRQ_SOFTWARE		70
+#define NVIC_NUM_INTERRUPTS	160
+extern void (* _VectorsRam[NVIC_NUM_INTERRUPTS + 16])(void);
+static inline void attachInterruptVector(int irq, void (*function)(void))
+	{ _VectorsRam[irq + 16] = function; }
+
+// The cycle counter runs from host time scaled to a 600 MHz core clock.
+#define SIM_F_CPU		600000000
+extern volatile uint32_t sim_demcr;
+extern volatile uint32_t sim_dwt_ctrl;
+#define ARM_DEMCR		sim_demcr
+#define ARM_DEMCR_TRCENA	(1 << 24)
+#define ARM_DWT_CTRL		sim_dwt_ctrl
+#define ARM_DWT_CTRL_CYCCNTENA	(1 << 0)
+#define ARM_DWT_CYCCNT		((uint32_t)(sim_nanos() * (SIM_F_CPU / 1000000) / 1000))
+
+// Cost of the software interrupt (AudioStream::update_all) that the
+// last ISR pended, nanoseconds.
+extern uint32_t sim_update_count;
+extern uint64_t sim_update_ns_total;
+extern uint64_t sim_update_ns_max;
+
+// When non-zero, every Nth software interrupt finishes late: its update
+// runs only after the next DMA ISR, immediately followed by the update that
+// ISR pended, as when one update_all overruns its period on hardware.
+extern uint32_t sim_update_late_every;
+
+// Reset every peripheral model and the audio scheduling state.
+void sim_reset(void);
+
+// Host monotonic time in nanoseconds.
+uint64_t sim_nanos(void);
+
+#endif
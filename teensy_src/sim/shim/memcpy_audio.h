@@ -0,0 +1,6 @@
+/* Host simulation stand-in for memcpy_audio.h (nothing in teensy_src
+ * uses the assembly helpers it declares). */
+
+#ifndef memcpy_audio_h_
+#define memcpy_audio_h_
+#endif
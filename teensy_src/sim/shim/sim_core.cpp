@@ -0,0 +1,530 @@
+/* Host simulation core: AudioStream scheduling, eDMA engine and SAI1 model
+ *
+ * The eDMA model executes one minor loop per hardware request, honouring
+ * SOFF/DOFF, transfer sizes, minor loop offsets, SLAST/DLASTSGA, scatter/
+ * gather and the half/major interrupt flags.  The SAI model clocks whole
+ * frames: every enabled transmit lane pulls FRSZ+1 words, and a request is
+ * raised whenever a lane's FIFO runs dry; every enabled receive lane pushes
+ * FRSZ+1 words, and requests are raised while they are waiting.  ISRs run
+ * synchronously on the host and are timed individually.
+ */
+
+#include <time.h>
+#include "Arduino.h"
+#include "AudioStream.h"
+#include "DMAChannel.h"
+
+sim_sai_regs_t sim_sai1;
+volatile uint32_t sim_ccm_ccgr5;
+volatile uint32_t sim_pin_config[64];
+volatile uint32_t sim_ccm_cscmr1;
+volatile uint32_t sim_ccm_cs1cdr;
+volatile uint32_t sim_iomuxc_gpr1;
+volatile uint32_t sim_sai1_rx_data_select[4];
+volatile uint32_t sim_irq_disabled;
+uint64_t sim_dcache_bytes;
+uint32_t sim_dcache_calls;
+sim_dma_channel_t sim_dma[SIM_DMA_CHANNELS];
+uint32_t sim_update_count;
+uint64_t sim_update_ns_total;
+uint64_t sim_update_ns_max;
+uint32_t sim_update_late_every;
+static uint32_t update_late_count;
+static bool update_late;
+void (* _VectorsRam[NVIC_NUM_INTERRUPTS + 16])(void);
+volatile uint32_t sim_demcr;
+volatile uint32_t sim_dwt_ctrl;
+Print sim_stdout;
+
+uint64_t sim_nanos(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+// AudioStream
+
+AudioStream * AudioStream::first_update = nullptr;
+bool AudioStream::update_scheduled = false;
+bool AudioStream::update_pending = false;
+audio_block_t * AudioStream::memory_pool = nullptr;
+unsigned int AudioStream::memory_pool_size = 0;
+uint16_t AudioStream::memory_used = 0;
+uint16_t AudioStream::memory_used_max = 0;
+static uint8_t *pool_in_use = nullptr;
+
+AudioStream::AudioStream(unsigned char ninput, audio_block_t **iqueue) :
+	active(false), num_inputs(ninput), numConnections(0),
+	destination_list(nullptr), inputQueue(iqueue), next_update(nullptr)
+{
+	for (int i=0; i < num_inputs; i++) inputQueue[i] = nullptr;
+	if (first_update == nullptr) {
+		first_update = this;
+	} else {
+		AudioStream *p = first_update;
+		while (p->next_update) p = p->next_update;
+		p->next_update = this;
+	}
+}
+
+AudioStream::~AudioStream()
+{
+	AudioStream **pp = &first_update;
+	while (*pp) {
+		if (*pp == this) {
+			*pp = next_update;
+			break;
+		}
+		pp = &(*pp)->next_update;
+	}
+}
+
+void AudioStream::initialize_memory(audio_block_t *data, unsigned int num)
+{
+	free(pool_in_use);
+	pool_in_use = (uint8_t *)calloc(num, 1);
+	memory_pool = data;
+	memory_pool_size = num;
+	memory_used = 0;
+	memory_used_max = 0;
+	for (unsigned int i=0; i < num; i++) {
+		data[i].memory_pool_index = i;
+	}
+}
+
+audio_block_t * AudioStream::allocate(void)
+{
+	for (unsigned int i=0; i < memory_pool_size; i++) {
+		if (!pool_in_use[i]) {
+			pool_in_use[i] = 1;
+			audio_block_t *block = memory_pool + i;
+			block->ref_count = 1;
+			if (++memory_used > memory_used_max) memory_used_max = memory_used;
+			return block;
+		}
+	}
+	return nullptr;
+}
+
+void AudioStream::release(audio_block_t *block)
+{
+	if (block->ref_count > 1) {
+		block->ref_count--;
+	} else {
+		pool_in_use[block->memory_pool_index] = 0;
+		block->ref_count = 0;
+		memory_used--;
+	}
+}
+
+void AudioStream::transmit(audio_block_t *block, unsigned char index)
+{
+	for (AudioConnection *c = destination_list; c != nullptr; c = c->next_dest) {
+		if (c->src_index == index && c->isConnected) {
+			if (c->dst.inputQueue[c->dest_index] == nullptr) {
+				c->dst.inputQueue[c->dest_index] = block;
+				block->ref_count++;
+			}
+		}
+	}
+}
+
+audio_block_t * AudioStream::receiveReadOnly(unsigned int index)
+{
+	if (index >= num_inputs) return nullptr;
+	audio_block_t *in = inputQueue[index];
+	inputQueue[index] = nullptr;
+	return in;
+}
+
+audio_block_t * AudioStream::receiveWritable(unsigned int index)
+{
+	audio_block_t *in = receiveReadOnly(index);
+	if (in && in->ref_count > 1) {
+		audio_block_t *p = allocate();
+		if (p) memcpy(p->data, in->data, sizeof(p->data));
+		in->ref_count--;
+		in = p;
+	}
+	return in;
+}
+
+bool AudioStream::update_setup(void)
+{
+	if (update_scheduled) return false;
+	attachInterruptVector(IRQ_SOFTWARE, software_isr);
+	update_scheduled = true;
+	return true;
+}
+
+void AudioStream::update_stop(void)
+{
+	update_scheduled = false;
+}
+
+void AudioStream::sim_reset(void)
+{
+	update_scheduled = false;
+	update_pending = false;
+	_VectorsRam[IRQ_SOFTWARE + 16] = nullptr;
+}
+
+void AudioStream::software_isr(void)
+{
+	uint64_t t0 = sim_nanos();
+	for (AudioStream *p = first_update; p; p = p->next_update) {
+		if (p->active) p->update();
+	}
+	uint64_t ns = sim_nanos() - t0;
+	sim_update_count++;
+	sim_update_ns_total += ns;
+	if (ns > sim_update_ns_max) sim_update_ns_max = ns;
+}
+
+// The pended software interrupt runs through the vector table, so anything
+// that wraps the vector (audio_profile_begin) sees it as on hardware.
+bool AudioStream::sim_run_pending(void)
+{
+	if (!update_pending) return false;
+	update_pending = false;
+	void (*vector)(void) = _VectorsRam[IRQ_SOFTWARE + 16];
+	if (!vector) return true;
+	if (update_late) {
+		update_late = false;
+		vector();
+	} else if (sim_update_late_every && ++update_late_count >= sim_update_late_every) {
+		update_late_count = 0;
+		update_late = true;
+		return true;
+	}
+	vector();
+	return true;
+}
+
+AudioConnection::AudioConnection(AudioStream &source, unsigned char sourceOutput,
+	AudioStream &destination, unsigned char destinationInput) :
+	src(source), dst(destination), src_index(sourceOutput),
+	dest_index(destinationInput), next_dest(nullptr), isConnected(false)
+{
+	if (dest_index >= dst.num_inputs) return;
+	AudioConnection **pp = &src.destination_list;
+	while (*pp) pp = &(*pp)->next_dest;
+	*pp = this;
+	src.numConnections++;
+	src.active = true;
+	dst.numConnections++;
+	dst.active = true;
+	isConnected = true;
+}
+
+// ---------------------------------------------------------------------------
+// DMAChannel
+
+void DMAChannel::begin(bool force_initialization)
+{
+	if (!force_initialization && TCD && channel < SIM_DMA_CHANNELS
+	  && sim_dma[channel].allocated) {
+		return;
+	}
+	for (unsigned int ch=0; ch < SIM_DMA_CHANNELS; ch++) {
+		if (!sim_dma[ch].allocated) {
+			memset(&sim_dma[ch], 0, sizeof(sim_dma[ch]));
+			sim_dma[ch].allocated = 1;
+			sim_dma[ch].isr_ns_min = ~0ull;
+			channel = ch;
+			TCD = &sim_dma[ch].tcd;
+			return;
+		}
+	}
+	TCD = nullptr;
+	channel = SIM_DMA_CHANNELS;
+}
+
+void DMAChannel::release(void)
+{
+	if (channel >= SIM_DMA_CHANNELS) return;
+	sim_dma[channel].allocated = 0;
+	sim_dma[channel].enabled = 0;
+	channel = SIM_DMA_CHANNELS;
+	TCD = nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// SAI1 FIFOs
+
+struct sim_fifo {
+	uint32_t data[SIM_SAI_FIFO_DEPTH];
+	unsigned int head, count;
+};
+
+static sim_fifo tx_fifo[4];
+static sim_wire_sink_t tx_sink;
+static void *tx_sink_arg;
+static uint32_t tx_underruns;
+static sim_fifo rx_fifo[4];
+static sim_wire_source_t rx_source;
+static void *rx_source_arg;
+static uint32_t rx_overruns;
+
+static bool fifo_push(sim_fifo *f, uint32_t word)
+{
+	if (f->count >= SIM_SAI_FIFO_DEPTH) return false;
+	f->data[(f->head + f->count) % SIM_SAI_FIFO_DEPTH] = word;
+	f->count++;
+	return true;
+}
+
+static bool fifo_pop(sim_fifo *f, uint32_t *word)
+{
+	if (f->count == 0) return false;
+	*word = f->data[f->head];
+	f->head = (f->head + 1) % SIM_SAI_FIFO_DEPTH;
+	f->count--;
+	return true;
+}
+
+// Bus accesses from the DMA engine: SAI data registers are routed to the
+// FIFOs (sub-word writes land in the addressed byte lanes), everything
+// else is ordinary memory.
+static uint32_t bus_read(uintptr_t addr, unsigned int size)
+{
+	uintptr_t rdr = (uintptr_t)&sim_sai1.RDR[0];
+	if (addr >= rdr && addr < rdr + sizeof(sim_sai1.RDR)) {
+		unsigned int lane = (addr - rdr) / 4;
+		unsigned int shift = ((addr - rdr) & 3) * 8;
+		uint32_t word = 0;
+		fifo_pop(&rx_fifo[lane], &word);
+		return word >> shift;
+	}
+	uint32_t v = 0;
+	memcpy(&v, (const void *)addr, size);
+	return v;
+}
+
+static void bus_write(uintptr_t addr, unsigned int size, uint32_t value)
+{
+	uintptr_t tdr = (uintptr_t)&sim_sai1.TDR[0];
+	if (addr >= tdr && addr < tdr + sizeof(sim_sai1.TDR)) {
+		unsigned int lane = (addr - tdr) / 4;
+		unsigned int shift = ((addr - tdr) & 3) * 8;
+		uint32_t mask = (size >= 4) ? 0xFFFFFFFF : ((1u << (size * 8)) - 1);
+		fifo_push(&tx_fifo[lane], (value & mask) << shift);
+		return;
+	}
+	memcpy((void *)addr, &value, size);
+}
+
+// ---------------------------------------------------------------------------
+// eDMA engine
+
+static void dma_call_isr(sim_dma_channel_t *ch)
+{
+	ch->interrupts++;
+	if (!ch->isr) return;
+	uint64_t t0 = sim_nanos();
+	ch->isr();
+	uint64_t ns = sim_nanos() - t0;
+	ch->isr_ns_total += ns;
+	if (ns < ch->isr_ns_min) ch->isr_ns_min = ns;
+	if (ns > ch->isr_ns_max) ch->isr_ns_max = ns;
+	// the software interrupt pended by update_all() runs on return
+	AudioStream::sim_run_pending();
+}
+
+static void dma_minor_loop(sim_dma_channel_t *ch)
+{
+	TCD_t *t = &ch->tcd;
+	unsigned int ssize = 1u << ((t->ATTR >> 8) & 7);
+	unsigned int dsize = 1u << (t->ATTR & 7);
+	unsigned int unit = ssize > dsize ? ssize : dsize;
+	uint32_t nbytes = t->NBYTES;
+	int32_t mloff = 0;
+	bool smloe = false, dmloe = false;
+
+	if (nbytes & (DMA_TCD_NBYTES_SMLOE | DMA_TCD_NBYTES_DMLOE)) {
+		smloe = nbytes & DMA_TCD_NBYTES_SMLOE;
+		dmloe = nbytes & DMA_TCD_NBYTES_DMLOE;
+		mloff = (int32_t)(nbytes << 2) >> 12;	// sign-extend bits 29:10
+		nbytes &= 0x3FF;
+	} else {
+		nbytes &= 0x3FFFFFFF;
+	}
+
+	uintptr_t src = (uintptr_t)t->SADDR;
+	uintptr_t dst = (uintptr_t)t->DADDR;
+	for (uint32_t n=0; n < nbytes; n += unit) {
+		uint32_t v = bus_read(src, ssize);
+		bus_write(dst, dsize, v);
+		src += t->SOFF;
+		dst += t->DOFF;
+	}
+	if (smloe) src += mloff;
+	if (dmloe) dst += mloff;
+	ch->minor_loops++;
+
+	uint16_t citer = t->CITER - 1;
+	uint16_t csr = t->CSR;
+	bool irq = false;
+	if (citer == 0) {
+		irq = (csr & DMA_TCD_CSR_INTMAJOR);
+		if (csr & DMA_TCD_CSR_ESG) {
+			memcpy((void *)t, (const void *)t->DLASTSGA, sizeof(TCD_t));
+		} else {
+			t->SADDR = (const void *)(src + t->SLAST);
+			t->DADDR = (void *)(dst + t->DLASTSGA);
+			t->CITER = t->BITER;
+		}
+		if (csr & DMA_TCD_CSR_DREQ) ch->enabled = 0;
+	} else {
+		t->SADDR = (const void *)src;
+		t->DADDR = (void *)dst;
+		t->CITER = citer;
+		irq = (csr & DMA_TCD_CSR_INTHALF) && citer == (t->BITER >> 1);
+	}
+	if (irq) dma_call_isr(ch);
+}
+
+static bool dma_request(uint8_t source)
+{
+	bool serviced = false;
+	for (unsigned int i=0; i < SIM_DMA_CHANNELS; i++) {
+		sim_dma_channel_t *ch = &sim_dma[i];
+		if (ch->allocated && ch->enabled && ch->source == source) {
+			dma_minor_loop(ch);
+			serviced = true;
+		}
+	}
+	return serviced;
+}
+
+// ---------------------------------------------------------------------------
+// SAI1 transmitter
+
+void sim_sai1_set_tx_sink(sim_wire_sink_t sink, void *arg)
+{
+	tx_sink = sink;
+	tx_sink_arg = arg;
+}
+
+unsigned int sim_sai1_tx_words_per_frame(void)
+{
+	return ((I2S1_TCR4 >> 16) & 0x1F) + 1;
+}
+
+unsigned int sim_sai1_tx_lanes(void)
+{
+	return (I2S1_TCR3 >> 16) & 0x0F;
+}
+
+uint32_t sim_sai1_tx_underruns(void)
+{
+	return tx_underruns;
+}
+
+void sim_sai1_tx_frame(void)
+{
+	if (!(I2S1_TCSR & I2S_TCSR_TE)) return;
+	unsigned int words = sim_sai1_tx_words_per_frame();
+	unsigned int lanes = sim_sai1_tx_lanes();
+
+	for (unsigned int w=0; w < words; w++) {
+		for (unsigned int lane=0; lane < 4; lane++) {
+			if (!(lanes & (1 << lane))) continue;
+			uint32_t word;
+			// a single request may feed several lanes, so keep asking
+			// only while this lane is dry and the DMA makes progress
+			for (int tries=0; tx_fifo[lane].count == 0 && tries < 4; tries++) {
+				if (!(I2S1_TCSR & I2S_TCSR_FRDE)) break;
+				if (!dma_request(DMAMUX_SOURCE_SAI1_TX)) break;
+			}
+			if (!fifo_pop(&tx_fifo[lane], &word)) {
+				word = 0;
+				tx_underruns++;
+				I2S1_TCSR |= I2S_TCSR_FEF;
+			}
+			if (tx_sink) tx_sink(lane, word, tx_sink_arg);
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+// SAI1 receiver
+
+void sim_sai1_set_rx_source(sim_wire_source_t source, void *arg)
+{
+	rx_source = source;
+	rx_source_arg = arg;
+}
+
+unsigned int sim_sai1_rx_words_per_frame(void)
+{
+	return ((I2S1_RCR4 >> 16) & 0x1F) + 1;
+}
+
+unsigned int sim_sai1_rx_lanes(void)
+{
+	return (I2S1_RCR3 >> 16) & 0x0F;
+}
+
+uint32_t sim_sai1_rx_overruns(void)
+{
+	return rx_overruns;
+}
+
+static bool rx_lanes_ready(unsigned int lanes)
+{
+	for (unsigned int lane=0; lane < 4; lane++) {
+		if ((lanes & (1 << lane)) && rx_fifo[lane].count == 0) return false;
+	}
+	return lanes != 0;
+}
+
+void sim_sai1_rx_frame(void)
+{
+	if (!(I2S1_RCSR & I2S_RCSR_RE)) return;
+	unsigned int words = sim_sai1_rx_words_per_frame();
+	unsigned int lanes = sim_sai1_rx_lanes();
+
+	for (unsigned int w=0; w < words; w++) {
+		for (unsigned int lane=0; lane < 4; lane++) {
+			if (!(lanes & (1 << lane))) continue;
+			uint32_t word = rx_source ? rx_source(lane, rx_source_arg) : 0;
+			if (!fifo_push(&rx_fifo[lane], word)) {
+				rx_overruns++;
+				I2S1_RCSR |= I2S_RCSR_FEF;
+			}
+		}
+		// a single request may drain several lanes
+		while (rx_lanes_ready(lanes)) {
+			if (!(I2S1_RCSR & I2S_RCSR_FRDE)) break;
+			if (!dma_request(DMAMUX_SOURCE_SAI1_RX)) break;
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+
+void sim_reset(void)
+{
+	memset((void *)&sim_sai1, 0, sizeof(sim_sai1));
+	memset(tx_fifo, 0, sizeof(tx_fifo));
+	memset(rx_fifo, 0, sizeof(rx_fifo));
+	memset(sim_dma, 0, sizeof(sim_dma));
+	tx_sink = nullptr;
+	tx_sink_arg = nullptr;
+	tx_underruns = 0;
+	rx_source = nullptr;
+	rx_source_arg = nullptr;
+	rx_overruns = 0;
+	sim_dcache_bytes = 0;
+	sim_dcache_calls = 0;
+	sim_update_count = 0;
+	sim_update_ns_total = 0;
+	sim_update_ns_max = 0;
+	sim_update_late_every = 0;
+	update_late_count = 0;
+	update_late = false;
+	AudioStream::sim_reset();
+}
@@ -0,0 +1,138 @@
+/* Host simulation of the USB device controller's isochronous endpoints
+ *
+ * One transfer may be queued per endpoint and direction.  sim_usb_frame()
+ * plays one USB frame: each IN transfer is passed to the sink and
+ * completed with nothing left over, each OUT transfer is filled from the
+ * source and completed with the unused length in its status, and the
+ * endpoint's callback runs as the completion interrupt would.
+ */
+
+#include <string.h>
+#include "usb_dev.h"
+
+#define SIM_USB_ENDPOINTS	8
+
+volatile uint8_t usb_high_speed;
+
+typedef struct {
+	void (*callback)(transfer_t *);
+	transfer_t *queued;
+	uint32_t size;
+} sim_usb_endpoint_t;
+
+// [endpoint][0] receive (OUT), [endpoint][1] transmit (IN)
+static sim_usb_endpoint_t endpoints[SIM_USB_ENDPOINTS][2];
+static sim_usb_sink_t sink;
+static void *sink_arg;
+static sim_usb_source_t source;
+static void *source_arg;
+static uint32_t missed;
+static unsigned int paused;
+
+void usb_prepare_transfer(transfer_t *transfer, const void *data, uint32_t len, uint32_t param)
+{
+	transfer->next = 1;
+	transfer->status = (len << 16) | (1 << 7);
+	transfer->pointer0 = (uint32_t)(uintptr_t)data;
+	transfer->callback_param = param;
+	transfer->sim_data = (void *)data;
+}
+
+void usb_transmit(int endpoint_number, transfer_t *transfer)
+{
+	endpoints[endpoint_number][1].queued = transfer;
+}
+
+void usb_receive(int endpoint_number, transfer_t *transfer)
+{
+	endpoints[endpoint_number][0].queued = transfer;
+}
+
+void usb_config_rx_iso(uint32_t ep, uint32_t packet_size, int mult, void (*callback)(transfer_t *))
+{
+	(void)mult;
+	endpoints[ep][0].callback = callback;
+	endpoints[ep][0].queued = nullptr;
+	endpoints[ep][0].size = packet_size;
+}
+
+void usb_config_tx_iso(uint32_t ep, uint32_t packet_size, int mult, void (*callback)(transfer_t *))
+{
+	(void)mult;
+	endpoints[ep][1].callback = callback;
+	endpoints[ep][1].queued = nullptr;
+	endpoints[ep][1].size = packet_size;
+}
+
+void sim_usb_reset(void)
+{
+	memset(endpoints, 0, sizeof(endpoints));
+	sink = nullptr;
+	sink_arg = nullptr;
+	source = nullptr;
+	source_arg = nullptr;
+	missed = 0;
+	paused = 0;
+	usb_high_speed = 0;
+}
+
+void sim_usb_set_sink(sim_usb_sink_t s, void *arg)
+{
+	sink = s;
+	sink_arg = arg;
+}
+
+void sim_usb_set_source(sim_usb_source_t s, void *arg)
+{
+	source = s;
+	source_arg = arg;
+}
+
+uint32_t sim_usb_missed(void)
+{
+	return missed;
+}
+
+uint32_t sim_usb_packet_size(int endpoint, int transmit)
+{
+	const sim_usb_endpoint_t *e = &endpoints[endpoint][transmit ? 1 : 0];
+	return e->callback ? e->size : 0;
+}
+
+void sim_usb_pause(unsigned int frames)
+{
+	paused = frames;
+}
+
+void sim_usb_frame(void)
+{
+	for (int ep=0; ep < SIM_USB_ENDPOINTS && !paused; ep++) {
+		sim_usb_endpoint_t *e = &endpoints[ep][1];
+		if (!e->callback) continue;
+		transfer_t *t = e->queued;
+		if (!t) {
+			missed++;
+			continue;
+		}
+		e->queued = nullptr;
+		unsigned int len = (t->status >> 16) & 0x7FFF;
+		if (sink) sink(ep, (const uint8_t *)t->sim_data, len, sink_arg);
+		t->status = 0;
+		e->callback(t);
+	}
+	for (int ep=0; ep < SIM_USB_ENDPOINTS; ep++) {
+		sim_usb_endpoint_t *e = &endpoints[ep][0];
+		if (!e->callback) continue;
+		transfer_t *t = e->queued;
+		if (!t) {
+			missed++;
+			continue;
+		}
+		e->queued = nullptr;
+		unsigned int size = (t->status >> 16) & 0x7FFF;
+		unsigned int len = source ? source(ep, (uint8_t *)t->sim_data, size, source_arg) : 0;
+		t->status = (size - len) << 16;
+		e->callback(t);
+	}
+	if (paused) paused--;
+}
@@ -0,0 +1,66 @@
+/* Host simulation stand-in for the Teensy 4 usb_dev.h
+ *
+ * Only the isochronous endpoint calls usb_audio.cpp makes.  Nothing moves
+ * until the simulation clocks a USB frame with sim_usb_frame(): the
+ * transfer queued on each IN endpoint is handed to the sink and completed,
+ * and the one queued on each OUT endpoint is filled from the source and
+ * completed, so the completion callbacks queue the next transfer as they
+ * do from the USB interrupt on hardware.
+ */
+
+#ifndef usb_dev_h_
+#define usb_dev_h_
+
+#include <stdint.h>
+
+typedef struct transfer_struct transfer_t;
+struct transfer_struct {
+	uint32_t next;
+	volatile uint32_t status;	// bytes left << 16, active bit 7
+	uint32_t pointer0;
+	uint32_t pointer1;
+	uint32_t pointer2;
+	uint32_t pointer3;
+	uint32_t pointer4;
+	uint32_t callback_param;
+	// the buffer, which does not fit pointer0 on a 64-bit host
+	void *sim_data;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void usb_prepare_transfer(transfer_t *transfer, const void *data, uint32_t len, uint32_t param);
+void usb_transmit(int endpoint_number, transfer_t *transfer);
+void usb_receive(int endpoint_number, transfer_t *transfer);
+void usb_config_rx_iso(uint32_t ep, uint32_t packet_size, int mult, void (*callback)(transfer_t *));
+void usb_config_tx_iso(uint32_t ep, uint32_t packet_size, int mult, void (*callback)(transfer_t *));
+extern volatile uint8_t usb_high_speed;
+#ifdef __cplusplus
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Simulation engine
+
+// An IN packet as the host receives it.
+typedef void (*sim_usb_sink_t)(int endpoint, const uint8_t *data, unsigned int len, void *arg);
+// An OUT packet from the host: fill at most 'size' bytes, return the length.
+typedef unsigned int (*sim_usb_source_t)(int endpoint, uint8_t *data, unsigned int size, void *arg);
+
+void sim_usb_reset(void);
+void sim_usb_set_sink(sim_usb_sink_t sink, void *arg);
+void sim_usb_set_source(sim_usb_source_t source, void *arg);
+// One USB frame, or micro-frame when the endpoints move a packet in each:
+// every IN endpoint, then every OUT endpoint.
+void sim_usb_frame(void);
+// transfers that were not queued when their frame came
+uint32_t sim_usb_missed(void);
+// the packet size an endpoint was configured with, 0 if it was not
+uint32_t sim_usb_packet_size(int endpoint, int transmit);
+// The host stops polling the IN endpoints for the next 'frames' calls to
+// sim_usb_frame(), as a busy host may; their queued transfers wait, and go
+// out afterwards.
+void sim_usb_pause(unsigned int frames);
+
+#endif
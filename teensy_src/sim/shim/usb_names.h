@@ -0,0 +1,15 @@
+/* Host simulation stand-in for the Teensy core's usb_names.h, for the
+ * string descriptors in patches/usb_desc.c. */
+
+#ifndef usb_names_h_
+#define usb_names_h_
+
+#include <stdint.h>
+
+struct usb_string_descriptor_struct {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint16_t wString[];
+};
+
+#endif
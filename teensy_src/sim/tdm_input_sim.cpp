@@ -0,0 +1,727 @@
+/* Host simulation of the SAI1 receivers
+ *
+ * Builds the real AudioInputTDM_Sparse.cpp, AudioInputI2SQuadTDM.cpp and
+ * AudioInputI2SQuadSlave.cpp against the shims in sim/shim and clocks a
+ * deterministic stream into the emulated SAI1 receiver: 16 TDM slots on
+ * one lane, I2S microphone words on two lanes plus the slave's slots on
+ * the others, or microphones alone on two or four lanes.  Every block an
+ * object transmits is compared bit-for-bit with the channel and frames it
+ * should hold, unmasked outputs must stay silent, and the audio block pool
+ * high-water mark and per-ISR cost are reported so the sparse masks can be
+ * compared with a full receive.
+ *
+ * The slave sketch's chain, microphones through AudioOutputTDM_SlaveT on
+ * the same SAI1, is run end to end with the objects begun in either order.
+ * The master's AudioAnalyzeMeterT is checked against a scalar reference fed
+ * the same blocks, and its AudioEffectLivenessT against a slave that stops,
+ * replays its DMA ring and sends garbage between stretches of live data.
+ *
+ * usage: tdm_input_sim [frames]
+ */
+
+#include <stdio.h>
+#include <vector>
+#include "Arduino.h"
+#include "AudioStream.h"
+#include "AudioInputTDM_Sparse.h"
+#include "AudioInputI2SQuadTDM.h"
+#include "AudioInputI2SQuadSlave.h"
+#include "AudioOutputTDM_Slave.h"
+#include "AudioAnalyzeMeter.h"
+#include "AudioAnalyzeTDMStatus.h"
+#include "AudioEffectLiveness.h"
+#include "audio_profile.h"
+#include "audio_memory.h"
+
+#define CHANNELS		16
+
+// Unique, never-zero sample for channel c at absolute sample index n.
+static int16_t pattern(unsigned int c, uint32_t n)
+{
+	uint32_t x = (n + 1) * 2654435761u ^ (c + 1) * 0x9E3779B9u;
+	x ^= x >> 15;
+	x *= 0x85EBCA6Bu;
+	x ^= x >> 13;
+	return (int16_t)(x | 1);
+}
+
+// What each receiver expects on the wire.  word() is the word on a lane
+// in frame n, and output c of the receiver must carry pattern(c, n).
+template <class Rx> struct Wire;
+
+// A microphone word: the sample in the upper half, then the low byte of
+// a 24-bit sample, which is noise the receiver must drop.
+static uint32_t mic_word(unsigned int c, uint32_t n)
+{
+	return ((uint32_t)(uint16_t)pattern(c, n) << 16) | ((uint16_t)pattern(100 + c, n) & 0xFF00);
+}
+
+// The stock TDM format: slot 2w in the upper half of word w, 2w+1 in the
+// lower half.
+template <> struct Wire<AudioInputTDM_Sparse> {
+	static const unsigned int lanes = 1;
+	static const unsigned int words = 8;
+	static audio_profile_t *profile(void) { return &audio_profile_tdm_rx; }
+	static uint32_t word(unsigned int lane, unsigned int w, uint32_t n) {
+		(void)lane;
+		return ((uint32_t)(uint16_t)pattern(w * 2, n) << 16) | (uint16_t)pattern(w * 2 + 1, n);
+	}
+};
+
+// I2S framing: microphones on the local lanes, the slave's lanes two
+// 16-bit slots per word.
+template <unsigned int R> struct Wire<AudioInputI2SQuadTDMT<R> > {
+	typedef AudioInputI2SQuadTDMT<R> Rx;
+	static const unsigned int lanes = Rx::lanes;
+	static const unsigned int words = Rx::words_per_frame;
+	static audio_profile_t *profile(void) { return &audio_profile_tdm_rx; }
+	static uint32_t word(unsigned int lane, unsigned int w, uint32_t n) {
+		if (lane < Rx::local_lanes) return mic_word(lane * 2 + w, n);
+		unsigned int c = Rx::local_channels + (lane - Rx::local_lanes) * 4 + w * 2;
+		return ((uint32_t)(uint16_t)pattern(c, n) << 16) | (uint16_t)pattern(c + 1, n);
+	}
+};
+
+// Channel numbers of an upstream board's slots on a chain board's wire.
+#define UPSTREAM		200
+
+// Microphones on the first L lanes, then an upstream board's frame: two
+// 16-bit slots per word, four per lane.
+template <unsigned int L, unsigned int U> struct Wire<AudioInputI2SSlaveT<L, U> > {
+	static const unsigned int lanes = L + U;
+	static const unsigned int words = AudioInputI2SSlaveT<L, U>::words_per_frame;
+	static audio_profile_t *profile(void) { return &audio_profile_i2s_rx; }
+	static uint32_t word(unsigned int lane, unsigned int w, uint32_t n) {
+		if (lane < L) return mic_word(lane * 2 + w, n);
+		unsigned int c = UPSTREAM + (lane - L) * 4 + w * 2;
+		return ((uint32_t)(uint16_t)pattern(c, n) << 16) | (uint16_t)pattern(c + 1, n);
+	}
+};
+
+// The SAI model asks for word 0 of every enabled lane, then word 1 and so
+// on, so the call count locates the frame and word.
+template <class Rx>
+static uint32_t wire_word(unsigned int lane, void *arg)
+{
+	uint32_t k = (*(uint32_t *)arg)++;
+	uint32_t frame = k / (Wire<Rx>::words * Wire<Rx>::lanes);
+	unsigned int w = (k / Wire<Rx>::lanes) % Wire<Rx>::words;
+	return Wire<Rx>::word(lane, w, frame);
+}
+
+// Checks each received block against the pattern.  The offset between the
+// sink's update count and the wire is locked on the first block seen and
+// must then hold for every channel.
+class SimCheckSink : public AudioStream
+{
+public:
+	SimCheckSink() : AudioStream(CHANNELS, inputQueueArray), period(0),
+		locked(false), base(0), errors(0), checked(0) {
+		for (int c=0; c < CHANNELS; c++) blocks[c] = 0;
+	}
+	virtual void update(void) {
+		for (unsigned int c=0; c < CHANNELS; c++) {
+			audio_block_t *block = receiveReadOnly(c);
+			if (!block) continue;
+			blocks[c]++;
+			if (!locked) lock(c, block);
+			uint32_t n = locked ? base + period * AUDIO_BLOCK_SAMPLES : 0;
+			for (unsigned int i=0; i < AUDIO_BLOCK_SAMPLES; i++) {
+				checked++;
+				if (locked && block->data[i] == pattern(c, n + i)) continue;
+				if (errors < 8) {
+					printf("  mismatch slot %u period %u sample %u: got %04X expected %04X\n",
+						c, period, i, (uint16_t)block->data[i], (uint16_t)pattern(c, n + i));
+				}
+				errors++;
+			}
+			release(block);
+		}
+		period++;
+	}
+	unsigned int period;
+	bool locked;
+	uint32_t base;
+	unsigned int errors;
+	unsigned int checked;
+	unsigned int blocks[CHANNELS];
+private:
+	void lock(unsigned int c, const audio_block_t *block) {
+		for (uint32_t n=0; n < 64 * AUDIO_BLOCK_SAMPLES; n++) {
+			if (block->data[0] == pattern(c, n) && block->data[1] == pattern(c, n + 1)) {
+				base = n - period * AUDIO_BLOCK_SAMPLES;
+				locked = true;
+				return;
+			}
+		}
+	}
+	audio_block_t *inputQueueArray[CHANNELS];
+};
+
+// Receive with 'mask', switching to 'next_mask' at runtime halfway through
+// when it differs.
+template <class Rx>
+static bool run_scenario(const char *name, uint32_t mask, unsigned int frames,
+	uint32_t next_mask, unsigned int *blocks_max = nullptr)
+{
+	const unsigned int channels = Rx::channels;
+
+	sim_reset();
+	AudioMemory(64);
+
+	uint32_t wire = 0;
+	sim_sai1_set_rx_source(wire_word<Rx>, &wire);
+
+	Rx rx(mask);
+	SimCheckSink sink;
+	AudioConnection *cords[CHANNELS];
+	for (unsigned int c=0; c < channels; c++) {
+		cords[c] = new AudioConnection(rx, c, sink, c);
+	}
+	audio_profile_begin();
+	audio_profile_reset(Wire<Rx>::profile());
+	// what AudioMemoryAuto() would reserve, before the margin, for either mask
+	unsigned int planned = AudioMemoryUser::blocksNeeded();
+
+	unsigned int sai_words = sim_sai1_rx_words_per_frame();
+	unsigned int sai_lanes = __builtin_popcount(sim_sai1_rx_lanes());
+	bool framed = sai_words == Wire<Rx>::words && sai_lanes == Wire<Rx>::lanes;
+	for (unsigned int f=0; framed && f < frames; f++) {
+		if (f == frames / 2) {
+			Rx::slots(next_mask);
+			if (AudioMemoryUser::blocksNeeded() > planned) planned = AudioMemoryUser::blocksNeeded();
+		}
+		sim_sai1_rx_frame();
+	}
+
+	// every wanted output delivers blocks, no other output ever transmits
+	bool routed = true;
+	uint32_t wanted = mask | next_mask;
+	for (unsigned int c=0; c < channels; c++) {
+		bool want = wanted & (1u << c);
+		if (want != (sink.blocks[c] != 0)) {
+			printf("  FAIL: slot %u delivered %u blocks\n", c, sink.blocks[c]);
+			routed = false;
+		}
+	}
+
+	const sim_dma_channel_t *ch = nullptr;
+	for (unsigned int i=0; i < SIM_DMA_CHANNELS; i++) {
+		if (sim_dma[i].allocated && sim_dma[i].source == DMAMUX_SOURCE_SAI1_RX) ch = &sim_dma[i];
+	}
+
+	if (mask != next_mask) {
+		printf("%s: outputs %04X then %04X, %u frames, %u samples checked\n",
+			name, mask, next_mask, frames, sink.checked);
+	} else {
+		printf("%s: outputs %04X, %u frames, %u samples checked\n",
+			name, mask, frames, sink.checked);
+	}
+	printf("  SAI frame: %u words x %u lane(s), FIFO overruns %u\n",
+		sai_words, sai_lanes, sim_sai1_rx_overruns());
+	if (ch && ch->interrupts) {
+		printf("  DMA ISR: %u calls, min %llu ns, mean %llu ns, max %llu ns\n",
+			ch->interrupts,
+			(unsigned long long)ch->isr_ns_min,
+			(unsigned long long)(ch->isr_ns_total / ch->interrupts),
+			(unsigned long long)ch->isr_ns_max);
+	}
+	audio_profile_print(sim_stdout, "  rx isr", Wire<Rx>::profile());
+	printf("  cache maintenance: %u calls, %llu bytes; audio blocks max %u of %u planned\n",
+		sim_dcache_calls, (unsigned long long)sim_dcache_bytes,
+		AudioStream::memory_used_max, planned);
+	if (blocks_max) *blocks_max = AudioStream::memory_used_max;
+
+	bool ok = framed && sink.locked && sink.errors == 0 && routed &&
+		sim_sai1_rx_overruns() == 0 && AudioStream::memory_used_max <= planned;
+	if (!framed) {
+		printf("  FAIL: SAI programmed for %u words x %u lanes, expected %u x %u\n",
+			sai_words, sai_lanes, Wire<Rx>::words, Wire<Rx>::lanes);
+	} else {
+		printf("  %u periods, %u mismatches: %s\n", sink.period, sink.errors, ok ? "ok" : "FAIL");
+	}
+	for (unsigned int c=0; c < channels; c++) delete cords[c];
+	return ok;
+}
+
+// Scalar peak, sum of squares and clip count over the same windows as
+// AudioAnalyzeMeterT, one snapshot per window.
+template <unsigned int N>
+class SimMeterRef : public AudioStream
+{
+public:
+	typedef audio_meter_snapshot_t<N> snapshot_t;
+	SimMeterRef(unsigned int window) : AudioStream(N, inputQueueArray),
+		window(window), blocks(0) { next = snapshot_t(); }
+	virtual void update(void) {
+		for (unsigned int c=0; c < N; c++) {
+			audio_block_t *block = receiveReadOnly(c);
+			if (!block) continue;
+			for (unsigned int i=0; i < AUDIO_BLOCK_SAMPLES; i++) {
+				int32_t s = block->data[i];
+				uint32_t a = s < 0 ? -s : s;
+				if (a > next.channel[c].peak) next.channel[c].peak = a;
+				if (a >= AUDIO_METER_CLIP) next.channel[c].clips++;
+				next.channel[c].sum_squares += (uint64_t)(s * s);
+			}
+			release(block);
+		}
+		if (++blocks < window) return;
+		next.sequence = windows.size() + 1;
+		next.samples = blocks * AUDIO_BLOCK_SAMPLES;
+		windows.push_back(next);
+		next = snapshot_t();
+		blocks = 0;
+	}
+	std::vector<snapshot_t> windows;
+private:
+	unsigned int window;
+	unsigned int blocks;
+	snapshot_t next;
+	audio_block_t *inputQueueArray[N];
+};
+
+// The meter with its update() timed through the on-target profiler.
+template <unsigned int N>
+class SimTimedMeter : public AudioAnalyzeMeterT<N>
+{
+public:
+	SimTimedMeter(unsigned int window) : AudioAnalyzeMeterT<N>(window), profile() { }
+	virtual void update(void) {
+		uint32_t start = ARM_DWT_CYCCNT;
+		AudioAnalyzeMeterT<N>::update();
+		audio_profile_record(&profile, ARM_DWT_CYCCNT - start);
+	}
+	audio_profile_t profile;
+};
+
+// The master sketch's meter on the first N outputs of Rx.  loop() is
+// modelled by reading the meter every 'poll' frames, so some windows are
+// skipped; every window read must match the reference exactly.
+template <class Rx, unsigned int N>
+static bool run_meter(const char *name, uint32_t mask, unsigned int frames,
+	uint32_t next_mask, unsigned int window, unsigned int poll)
+{
+	sim_reset();
+	AudioMemory(64);
+
+	uint32_t wire = 0;
+	sim_sai1_set_rx_source(wire_word<Rx>, &wire);
+
+	Rx rx(mask);
+	SimTimedMeter<N> meter(window);
+	SimMeterRef<N> ref(window);
+	AudioConnection *cords[2 * N];
+	for (unsigned int c=0; c < N; c++) {
+		cords[c] = new AudioConnection(rx, c, meter, c);
+		cords[N + c] = new AudioConnection(rx, c, ref, c);
+	}
+	audio_profile_begin();
+
+	typename AudioAnalyzeMeterT<N>::snapshot_t s;
+	bool early = meter.read(s);
+	unsigned int reads = 0, errors = 0;
+	uint32_t last = 0, clips = 0;
+	for (unsigned int f=0; f < frames; f++) {
+		if (f == frames / 2) Rx::slots(next_mask);
+		sim_sai1_rx_frame();
+		if (f % poll || !meter.available()) continue;
+		if (!meter.read(s) || s.sequence <= last || s.sequence > ref.windows.size()) {
+			printf("  FAIL: read window %u after %u, %u published\n",
+				(unsigned int)s.sequence, (unsigned int)last, (unsigned int)ref.windows.size());
+			errors++;
+			continue;
+		}
+		last = s.sequence;
+		reads++;
+		const typename SimMeterRef<N>::snapshot_t &r = ref.windows[s.sequence - 1];
+		bool same = s.samples == r.samples;
+		for (unsigned int c=0; c < N; c++) {
+			same &= s.channel[c].peak == r.channel[c].peak &&
+				s.channel[c].clips == r.channel[c].clips &&
+				s.channel[c].sum_squares == r.channel[c].sum_squares;
+			clips += r.channel[c].clips;
+		}
+		if (!same && errors++ < 4) {
+			printf("  mismatch in window %u\n", (unsigned int)s.sequence);
+		}
+	}
+	// the last window is always there to read, once
+	bool latest = meter.read(s) && s.sequence == ref.windows.size();
+	bool drained = latest && !meter.available();
+
+	printf("%s: outputs %04X then %04X, window %u blocks, %u frames\n",
+		name, mask, next_mask, window, frames);
+	printf("  %u windows published, %u read, %u clipped samples seen\n",
+		(unsigned int)ref.windows.size(), reads, (unsigned int)clips);
+	audio_profile_print(sim_stdout, "  meter", &meter.profile);
+	bool ok = !early && drained && reads > 0 && errors == 0;
+	printf("  %u mismatches: %s\n", errors, ok ? "ok" : "FAIL");
+	for (unsigned int c=0; c < 2 * N; c++) delete cords[c];
+	return ok;
+}
+
+// The master's slave lanes through the phases of a failing slave, each a
+// whole number of blocks: live data with a status packet in slot 7, then
+// the phase below, then live again.
+enum { SLAVE_LIVE, SLAVE_STOPPED, SLAVE_REPLAY, SLAVE_GARBAGE };
+#define LIVENESS_PHASE_BLOCKS	24
+#define LIVENESS_BAD_BLOCKS	10
+
+typedef AudioInputI2SQuadTDMT<2> LiveRx;
+
+struct SimSlaveWire {
+	uint32_t calls;
+	uint32_t noise;
+};
+
+static int slave_phase(uint32_t n, uint32_t *start)
+{
+	const uint32_t period = (LIVENESS_PHASE_BLOCKS + LIVENESS_BAD_BLOCKS) * AUDIO_BLOCK_SAMPLES;
+	uint32_t k = n / period, f = n % period;
+	*start = k * period;
+	if (k == 0 || k > 3 || f < LIVENESS_PHASE_BLOCKS * AUDIO_BLOCK_SAMPLES) return SLAVE_LIVE;
+	*start += LIVENESS_PHASE_BLOCKS * AUDIO_BLOCK_SAMPLES;
+	return k;
+}
+
+static uint16_t status_sample(uint32_t n)
+{
+	int16_t packet[TDM_STATUS_WORDS];
+	if (n % AUDIO_BLOCK_SAMPLES >= TDM_STATUS_WORDS) return 0;
+	tdm_status_fill(packet, n / AUDIO_BLOCK_SAMPLES, 0, 0, 512);
+	return packet[n % AUDIO_BLOCK_SAMPLES];
+}
+
+static uint32_t slave_live_word(unsigned int lane, unsigned int w, uint32_t n)
+{
+	if (lane == LiveRx::local_lanes + 1 && w == 1) {
+		// slot 7 is the status packet
+		return ((uint32_t)(uint16_t)pattern(LiveRx::local_channels + 6, n) << 16) | status_sample(n);
+	}
+	return Wire<LiveRx>::word(lane, w, n);
+}
+
+static uint32_t slave_wire_word(unsigned int lane, void *arg)
+{
+	SimSlaveWire *s = (SimSlaveWire *)arg;
+	uint32_t k = s->calls++;
+	uint32_t n = k / (LiveRx::words_per_frame * LiveRx::lanes);
+	unsigned int w = (k / LiveRx::lanes) % LiveRx::words_per_frame;
+	uint32_t start;
+	if (lane < LiveRx::local_lanes) return Wire<LiveRx>::word(lane, w, n);
+	switch (slave_phase(n, &start)) {
+	case SLAVE_STOPPED:
+		return 0;
+	case SLAVE_REPLAY:
+		// a two-block DMA ring going round without its CPU
+		return slave_live_word(lane, w, start - 2 * AUDIO_BLOCK_SAMPLES +
+			(n - start) % (2 * AUDIO_BLOCK_SAMPLES));
+	case SLAVE_GARBAGE:
+		s->noise = s->noise * 1664525u + 1013904223u;
+		return s->noise;
+	}
+	return slave_live_word(lane, w, n);
+}
+
+// Behind the liveness check: locks on the wire frame of its blocks in the
+// first live stretch, then checks each block against the phase it came
+// from.  A block wholly from a bad phase must be flagged dead in the same
+// update (garbage once the status packet has had two blocks to go), and
+// be the marker if that is on; a live one, once the channel has had its
+// recovery blocks, must be live and exact.
+class SimLivenessSink : public AudioStream
+{
+public:
+	SimLivenessSink(AudioEffectLiveness4 &check, bool marker) : AudioStream(4, inputQueueArray),
+		check(check), marker(marker), period(0), locked(false), base(0), flagged(0),
+		missed(0), false_alarms(0), errors(0), checked(0) { }
+	virtual void update(void) {
+		uint32_t dead = check.dead();
+		for (unsigned int c=0; c < 4; c++) {
+			audio_block_t *block = receiveReadOnly(c);
+			if (!block) continue;
+			unsigned int ch = LiveRx::local_channels + c;
+			if (!locked) {
+				for (uint32_t n=0; n < 64 * AUDIO_BLOCK_SAMPLES; n++) {
+					if (block->data[0] == pattern(ch, n) && block->data[1] == pattern(ch, n + 1)) {
+						base = n - period * AUDIO_BLOCK_SAMPLES;
+						locked = true;
+						break;
+					}
+				}
+			}
+			if (locked) judge(c, ch, block, dead);
+			release(block);
+		}
+		period++;
+	}
+	AudioEffectLiveness4 &check;
+	bool marker;
+	unsigned int period;
+	bool locked;
+	uint32_t base;
+	unsigned int flagged;		// bad blocks flagged in their own update
+	unsigned int missed;		// bad blocks passed as live
+	unsigned int false_alarms;	// live blocks flagged dead
+	unsigned int errors;		// blocks with the wrong samples
+	unsigned int checked;
+private:
+	void judge(unsigned int c, unsigned int ch, const audio_block_t *block, uint32_t dead) {
+		uint32_t n = base + period * AUDIO_BLOCK_SAMPLES, first, last;
+		int phase = slave_phase(n, &first);
+		if (slave_phase(n + AUDIO_BLOCK_SAMPLES - 1, &last) != phase || last != first) return;
+		bool is_dead = dead & (1u << c);
+		checked++;
+		if (phase != SLAVE_LIVE) {
+			if (phase == SLAVE_GARBAGE && n < first + 3 * AUDIO_BLOCK_SAMPLES) return;
+			if (is_dead) flagged++;
+			else missed++;
+			for (unsigned int i=0; is_dead && marker && i < AUDIO_BLOCK_SAMPLES; i++) {
+				if (block->data[i] != AUDIO_LIVENESS_MARKER) {
+					errors++;
+					break;
+				}
+			}
+			return;
+		}
+		// recovery blocks, and one for the block straddling the change
+		if (first && n < first + 6 * AUDIO_BLOCK_SAMPLES) return;
+		if (is_dead) false_alarms++;
+		for (unsigned int i=0; i < AUDIO_BLOCK_SAMPLES; i++) {
+			if (block->data[i] != pattern(ch, n + i)) {
+				errors++;
+				break;
+			}
+		}
+	}
+	audio_block_t *inputQueueArray[4];
+};
+
+// The master sketch's slave channels through AudioEffectLivenessT, the
+// status analyzer watched, while the slave fails in each of three ways.
+static bool run_liveness(const char *name, bool marker)
+{
+	const unsigned int blocks = 5 * (LIVENESS_PHASE_BLOCKS + LIVENESS_BAD_BLOCKS);
+
+	sim_reset();
+	AudioMemory(64);
+
+	SimSlaveWire wire = SimSlaveWire();
+	sim_sai1_set_rx_source(slave_wire_word, &wire);
+
+	LiveRx rx(0x08FF);
+	AudioAnalyzeTDMStatus status;
+	AudioEffectLiveness4 check;
+	SimLivenessSink sink(check, marker);
+	AudioConnection *cords[9];
+	cords[0] = new AudioConnection(rx, LiveRx::local_channels + 7, status, 0);
+	for (unsigned int c=0; c < 4; c++) {
+		cords[1 + c] = new AudioConnection(rx, LiveRx::local_channels + c, check, c);
+		cords[5 + c] = new AudioConnection(check, c, sink, c);
+	}
+	check.watch(status);
+	check.marker(marker);
+	unsigned int planned = AudioMemoryUser::blocksNeeded();
+
+	for (unsigned int f=0; f < blocks * AUDIO_BLOCK_SAMPLES; f++) sim_sai1_rx_frame();
+
+	printf("%s: %u blocks, %u judged\n", name, sink.period, sink.checked);
+	printf("  bad blocks: %u flagged in their own update, %u missed; %u live blocks flagged\n",
+		sink.flagged, sink.missed, sink.false_alarms);
+	printf("  dropouts %u, recoveries %u, dead now %X; status errors %u, resets %u\n",
+		(unsigned int)check.dropouts(), (unsigned int)check.recoveries(),
+		(unsigned int)check.dead(), (unsigned int)status.errors(), (unsigned int)status.resets());
+	// each channel goes dead once per bad phase and comes back after it
+	bool ok = sink.locked && sink.flagged > 0 && sink.missed == 0 && sink.false_alarms == 0 &&
+		sink.errors == 0 && check.dropouts() == 3 * 4 && check.recoveries() == 3 * 4 &&
+		check.dead() == 0 && AudioStream::memory_used_max <= planned;
+	printf("  audio blocks max %u of %u planned, %u wrong blocks: %s\n",
+		AudioStream::memory_used_max, planned, sink.errors, ok ? "ok" : "FAIL");
+	for (unsigned int i=0; i < 9; i++) delete cords[i];
+	return ok;
+}
+
+static void capture(unsigned int lane, uint32_t word, void *arg)
+{
+	(void)lane;
+	((std::vector<uint32_t> *)arg)->push_back(word);
+}
+
+// The slave sketch: four microphones on RXD0/RXD1 into slots 0-3 of a
+// two-lane slave output (8x16 in the sketch), both objects on SAI1.
+// Whichever begins second finds SAI1 running and must still get its own
+// data lanes.  With passthrough the microphones skip the graph and are
+// tapped into a checking sink instead, which must stay bit-exact.
+//
+// A chain board (Mics with upstream lanes) puts its microphones at the
+// slot offset and relays the slots below it from the upstream wire, which
+// carries pattern(UPSTREAM + n) in slot n; both must reach the wire at the
+// same pass-through latency.
+template <class Tdm, class Mics = AudioInputI2SQuadSlave>
+static bool run_slave_chain(const char *name, bool output_first, unsigned int frames,
+	bool passthrough = false, unsigned int offset = 0)
+{
+	sim_reset();
+	AudioMemory(64);
+
+	uint32_t wire_in = 0;
+	sim_sai1_set_rx_source(wire_word<Mics>, &wire_in);
+	std::vector<uint32_t> wire;
+	wire.reserve((size_t)frames * Tdm::words_per_sample);
+	sim_sai1_set_tx_sink(capture, &wire);
+
+	Tdm *tdm = nullptr;
+	Mics *mics = nullptr;
+	if (output_first) tdm = new Tdm(offset);
+	mics = new Mics;
+	if (!output_first) tdm = new Tdm(offset);
+	SimCheckSink tap;
+	AudioConnection *cords[Mics::channels];
+	for (unsigned int c=0; c < Mics::channels; c++) {
+		if (passthrough) cords[c] = new AudioConnection(*mics, c, tap, c);
+		else cords[c] = new AudioConnection(*mics, c, *tdm, c);
+	}
+	// switch over with the receive DMA already running, as from setup()
+	for (unsigned int f=0; passthrough && f < 100; f++) {
+		sim_sai1_rx_frame();
+		sim_sai1_tx_frame();
+	}
+	wire.clear();
+	if (passthrough && !mics->passthrough(*tdm, 0)) {
+		printf("%s: FAIL: passthrough target refused\n", name);
+		return false;
+	}
+	unsigned int planned = AudioMemoryUser::blocksNeeded();
+
+	bool framed = sim_sai1_rx_lanes() == (1u << Mics::rx_lanes) - 1 &&
+		sim_sai1_tx_lanes() == (1u << Tdm::lanes) - 1 &&
+		sim_sai1_rx_words_per_frame() == 2 && sim_sai1_tx_words_per_frame() == 2;
+	while (framed && wire.size() < (size_t)frames * Tdm::words_per_sample) {
+		sim_sai1_rx_frame();
+		sim_sai1_tx_frame();
+	}
+
+	// 16-bit channels go out in pairs, upper half first, 32-bit ones with
+	// the sample in the upper half
+	auto slot = [&](unsigned int f, unsigned int n) -> int16_t {
+		unsigned int lane = n / Tdm::slots_per_lane, k = n % Tdm::slots_per_lane;
+		unsigned int w = (Tdm::slot_bits == 16) ? k >> 1 : k;
+		uint32_t word = wire[f * Tdm::words_per_sample + w * Tdm::lanes + lane];
+		return (Tdm::slot_bits == 16 && (n & 1)) ? (int16_t)word : (int16_t)(word >> 16);
+	};
+	// the wire capture starts late when passing through
+	uint32_t skipped = passthrough ? 100 : 0;
+	// lock a latency on the first non-zero sample of a slot
+	auto lock = [&](unsigned int n, unsigned int c, unsigned int *start, unsigned int *latency) {
+		*start = 0;
+		while (*start + 1 < frames && slot(*start, n) == 0) (*start)++;
+		for (uint32_t k=0; k <= *start + skipped; k++) {
+			if (slot(*start, n) == pattern(c, k) && slot(*start + 1, n) == pattern(c, k + 1)) {
+				*latency = *start + skipped - k;
+				return true;
+			}
+		}
+		return false;
+	};
+	unsigned int start = 0, latency = 0, relay_start = 0, relay_latency = 0;
+	bool locked = framed && lock(offset, 0, &start, &latency);
+	bool relaying = Mics::upstream_lanes && offset;
+	bool relay_locked = !relaying || (framed && lock(0, UPSTREAM, &relay_start, &relay_latency));
+	unsigned int errors = 0, checked = 0;
+	for (unsigned int f=start; locked && f < frames; f++) {
+		for (unsigned int c=0; c < Mics::channels; c++) {
+			checked++;
+			if (slot(f, offset + c) != pattern(c, f + skipped - latency)) errors++;
+		}
+	}
+	for (unsigned int f=relay_start; relaying && relay_locked && f < frames; f++) {
+		for (unsigned int n=0; n < offset; n++) {
+			checked++;
+			if (slot(f, n) != pattern(UPSTREAM + n, f + skipped - relay_latency)) errors++;
+		}
+	}
+
+	printf("%s: %u frames, %u slot samples checked\n", name, frames, checked);
+	printf("  SAI lanes: rx %X, tx %X; FIFO overruns %u, underruns %u\n",
+		sim_sai1_rx_lanes(), sim_sai1_tx_lanes(), sim_sai1_rx_overruns(),
+		sim_sai1_tx_underruns());
+	printf("  audio blocks max %u of %u planned\n", AudioStream::memory_used_max, planned);
+	bool ok = framed && locked && relay_locked && errors == 0 && sim_sai1_rx_overruns() == 0 &&
+		AudioStream::memory_used_max <= planned;
+	if (passthrough) {
+		bool tapped = tap.errors == 0;
+		for (unsigned int c=0; c < Mics::channels; c++) tapped &= tap.blocks[c] != 0;
+		printf("  tap: %u samples checked, %u mismatches; %u slips\n",
+			tap.checked, tap.errors, Mics::passthroughSlips());
+		// a few frames: the lead, one segment and the FIFO
+		ok &= tapped && Mics::passthroughSlips() == 0 &&
+			latency <= Mics::passthrough_lead + Mics::passthrough_frames * 2;
+	}
+	if (relaying) {
+		printf("  upstream slots 0-%u relayed at %u frames\n", offset - 1, relay_latency);
+		ok &= relay_locked && relay_latency == latency;
+	}
+	if (!framed) {
+		printf("  FAIL: SAI1 not set up for both objects\n");
+	} else {
+		printf("  mic to wire latency %u frames, %u mismatches: %s\n",
+			latency, errors, ok ? "ok" : "FAIL");
+	}
+	for (unsigned int c=0; c < Mics::channels; c++) delete cords[c];
+	delete mics;
+	delete tdm;
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int frames = 20000;
+	if (argc > 1) frames = strtoul(argv[1], nullptr, 0);
+
+	bool ok = true;
+	unsigned int full = 0, sketch = 0;
+	typedef AudioInputTDM_Sparse Tdm;
+	ok &= run_scenario<Tdm>("TDM, all slots (AudioInputTDM)", 0xFFFF, frames, 0xFFFF, &full);
+	ok &= run_scenario<Tdm>("TDM, slots 0-3 and 15", 0x800F, frames, 0x800F, &sketch);
+	ok &= run_scenario<Tdm>("TDM, upper halves only", 0x0055, frames, 0x0055);
+	ok &= run_scenario<Tdm>("TDM, lower halves only", 0x2002, frames, 0x2002);
+	ok &= run_scenario<Tdm>("TDM, runtime mask change", 0x000F, frames, 0x0F00);
+	// the sparse mask has to take fewer blocks from the pool
+	bool lighter = sketch < full;
+	printf("pool high-water: %u blocks for all slots, %u for slots 0-3 and 15: %s\n",
+		full, sketch, lighter ? "ok" : "FAIL");
+	ok &= lighter;
+
+	typedef AudioInputI2SQuadTDMT<2> Quad2;
+	ok &= run_scenario<AudioInputI2SQuadTDM>("I2S quad + TDM lane, all", 0x00FF, frames, 0x00FF);
+	ok &= run_scenario<Quad2>("I2S quad + 2 TDM lanes, all", 0x0FFF, frames, 0x0FFF);
+	ok &= run_scenario<Quad2>("master sketch (local, slave 0-3 and 7)", 0x08FF, frames, 0x08FF);
+	ok &= run_scenario<Quad2>("slave lower halves only", 0x0AA0, frames, 0x0AA0);
+	ok &= run_scenario<Quad2>("local only, then slave only", 0x000F, frames, 0x0FF0);
+	ok &= run_meter<Quad2, 8>("master sketch meter", 0x08FF, frames, 0x08FF, 1, 7);
+	ok &= run_meter<Quad2, 8>("meter, local only then slave only", 0x000F, frames, 0x0FF0, 4, 1500);
+	ok &= run_liveness("slave liveness, dead channels passed through", false);
+	ok &= run_liveness("slave liveness, marker on dead channels", true);
+
+	ok &= run_scenario<AudioInputI2SQuadSlave>("I2S quad slave", 0x0F, frames, 0x0F);
+	ok &= run_scenario<AudioInputI2SOctSlave>("I2S octo slave", 0xFF, frames, 0xFF);
+	ok &= run_scenario<AudioInputI2SOctSlave>("I2S octo slave, left mics", 0x55, frames, 0x55);
+	typedef AudioOutputTDM_SlaveT<8, 16, 2, 2> SlaveTdm;
+	ok &= run_slave_chain<SlaveTdm>("slave sketch, output begun first", true, frames);
+	ok &= run_slave_chain<SlaveTdm>("slave sketch, mics begun first", false, frames);
+	ok &= run_slave_chain<SlaveTdm>("graph inputs at slot offset 4", true, frames, false, 4);
+	ok &= run_slave_chain<SlaveTdm>("slave sketch, pass-through", true, frames, true);
+	ok &= run_slave_chain<SlaveTdm>("slave sketch, pass-through, mics begun first", false, frames, true);
+	ok &= run_slave_chain<AudioOutputTDM_SlaveT<4, 32, 2, 2> >("32-bit slots, pass-through", true, frames, true);
+
+	// a two slave chain: the far board sends its microphones on TXD0, the
+	// near one relays them from RXD2 and adds its own at slot 4
+	ok &= run_scenario<AudioInputI2SQuadSlaveChain>("I2S quad slave + upstream lane", 0x0F, frames, 0x0F);
+	ok &= run_slave_chain<AudioOutputTDM_SlaveT<4, 16, 2, 1> >("far chain board", true, frames, true);
+	ok &= run_slave_chain<SlaveTdm, AudioInputI2SQuadSlaveChain>("near chain board, offset 4",
+		true, frames, true, 4);
+	ok &= run_slave_chain<SlaveTdm, AudioInputI2SQuadSlaveChain>("near chain board, mics begun first",
+		false, frames, true, 4);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/* Bit-exactness check and host benchmark for the TDM packing kernels
+ *
+ * Compares tdm_pack_pair() against the original scalar loop kept as
+ * tdm_pack_pair_ref(), and tdm_pack_single() against a per-sample loop,
+ * for the strides used by the instantiated AudioOutputTDM_SlaveT layouts.
+ * Destination buffers are pre-filled with a sentinel so writes outside a
+ * slot's column are caught as well.
+ *
+ * usage: tdm_pack_bench [iterations]
+ */
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "AudioStream.h"
+#include "tdm_pack.h"
+
+#define MAX_STRIDE	16
+#define SENTINEL	0xA5A5A5A5u
+
+static uint32_t dest_ref[AUDIO_BLOCK_SAMPLES * MAX_STRIDE];
+static uint32_t dest_opt[AUDIO_BLOCK_SAMPLES * MAX_STRIDE];
+static uint32_t src[MAX_STRIDE * 2][AUDIO_BLOCK_SAMPLES/2];
+
+static uint32_t rng_state = 0x12345678;
+static uint32_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+template <unsigned int Stride>
+static void tdm_pack_single_ref(uint32_t *dest, const uint32_t *s)
+{
+	const int16_t *in = (const int16_t *)s;
+	for (unsigned int i=0; i < AUDIO_BLOCK_SAMPLES; i++) {
+		dest[i * Stride] = (uint32_t)(uint16_t)in[i] << 16;
+	}
+}
+
+template <unsigned int Stride>
+static void fill_pair(uint32_t *dest, void (*kernel)(uint32_t *, const uint32_t *, const uint32_t *))
+{
+	for (unsigned int p=0; p < Stride; p++) kernel(dest + p, src[p*2], src[p*2+1]);
+}
+
+template <unsigned int Stride>
+static void fill_single(uint32_t *dest, void (*kernel)(uint32_t *, const uint32_t *))
+{
+	for (unsigned int c=0; c < Stride; c++) kernel(dest + c, src[c]);
+}
+
+template <class Fill>
+static double time_ns(Fill fill, unsigned int iterations)
+{
+	uint64_t t0 = sim_nanos();
+	for (unsigned int n=0; n < iterations; n++) {
+		fill();
+		asm volatile("" ::: "memory");
+	}
+	return (double)(sim_nanos() - t0) / iterations;
+}
+
+template <unsigned int Stride>
+static bool bench(unsigned int iterations)
+{
+	bool ok = true;
+	unsigned int words = AUDIO_BLOCK_SAMPLES * Stride;
+
+	// bit-exactness over several random data sets, with only some columns
+	// written so that stray stores show up against the sentinel
+	for (unsigned int trial=0; trial < 16; trial++) {
+		for (auto &s : src) for (auto &w : s) w = rng();
+		for (unsigned int i=0; i < words; i++) dest_ref[i] = dest_opt[i] = SENTINEL;
+		for (unsigned int p=0; p < Stride; p += 1 + (trial & 1)) {
+			tdm_pack_pair_ref<Stride>(dest_ref + p, src[p*2], src[p*2+1]);
+			tdm_pack_pair<Stride>(dest_opt + p, src[p*2], src[p*2+1]);
+		}
+		if (memcmp(dest_ref, dest_opt, words * 4) != 0) ok = false;
+
+		for (unsigned int i=0; i < words; i++) dest_ref[i] = dest_opt[i] = SENTINEL;
+		for (unsigned int c=0; c < Stride; c += 1 + (trial & 1)) {
+			tdm_pack_single_ref<Stride>(dest_ref + c, src[c]);
+			tdm_pack_single<Stride>(dest_opt + c, src[c]);
+		}
+		if (memcmp(dest_ref, dest_opt, words * 4) != 0) ok = false;
+	}
+
+	double pr = time_ns([]{ fill_pair<Stride>(dest_ref, tdm_pack_pair_ref<Stride>); }, iterations);
+	double po = time_ns([]{ fill_pair<Stride>(dest_opt, tdm_pack_pair<Stride>); }, iterations);
+	double sr = time_ns([]{ fill_single<Stride>(dest_ref, tdm_pack_single_ref<Stride>); }, iterations);
+	double so = time_ns([]{ fill_single<Stride>(dest_opt, tdm_pack_single<Stride>); }, iterations);
+
+	printf("stride %2u words: pair  ref %7.1f ns  opt %7.1f ns  (x%.2f)\n",
+		Stride, pr, po, pr / po);
+	printf("                 single ref %7.1f ns  opt %7.1f ns  (x%.2f)  %s\n",
+		sr, so, sr / so, ok ? "bit-exact" : "MISMATCH");
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = 20000;
+	if (argc > 1) iterations = strtoul(argv[1], nullptr, 0);
+
+	printf("TDM packing, one buffer half (%u samples) per call, %s kernels\n",
+		AUDIO_BLOCK_SAMPLES, AUDIO_PACK_DSP ? "PKHBT/PKHTB" : "portable");
+	bool ok = true;
+	ok &= bench<4>(iterations);
+	ok &= bench<8>(iterations);
+	ok &= bench<16>(iterations);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+/* Host simulation of the telemetry ring
+ *
+ * Builds the real audio_telemetry.cpp and queues the sketches' records at
+ * a steady rate into a port whose free space varies from write to write,
+ * with stretches where the host stops reading altogether.  drain() must
+ * never write more than the port reports free, frames that do not fit
+ * must be dropped whole and counted, and the captured byte stream must
+ * parse back into exactly the frames that were accepted, in order, with
+ * text lines (as the sketches' serial commands print) between them, also
+ * those printed while frames were still waiting in the ring.
+ *
+ * The capture is written to the file given on the command line, for
+ * host_src/telemetry.py --check.
+ *
+ * usage: telemetry_sim [capture file]
+ */
+
+#include <stdio.h>
+#include <vector>
+#include "Arduino.h"
+#include "AudioStream.h"
+#include "audio_telemetry.h"
+
+// A serial port with a varying amount of room, at most 'limit', and none
+// at all while 'stalled'.
+class SimPort : public Print
+{
+public:
+	SimPort() : step(0), stalled(false), limit(80), room(0), overflows(0) { }
+	virtual int availableForWrite(void) {
+		if (stalled) return room = 0;
+		step = step * 1103515245u + 12345u;
+		room = (step >> 16) % limit;
+		return room;
+	}
+	virtual size_t write(const uint8_t *buffer, size_t size) {
+		if ((int)size > room) overflows++;
+		room -= size;
+		wire.insert(wire.end(), buffer, buffer + size);
+		return size;
+	}
+	uint32_t step;
+	bool stalled;
+	int limit;
+	int room;
+	unsigned int overflows;
+	std::vector<uint8_t> wire;
+};
+
+// AudioOutputUSB's controller readings, as AudioTelemetry::usb() takes them
+struct SimUsbOutput {
+	unsigned int fill(void) { return 150; }
+	unsigned int fillTarget(void) { return 150; }
+	void fillRange(unsigned int *min, unsigned int *max) { *min = 80; *max = 245; }
+	int correction(void) { return -976; }
+	uint32_t underruns(void) { return 2; }
+	uint32_t overruns(void) { return 5; }
+};
+
+struct SimFrame {
+	uint8_t type;
+	std::vector<uint8_t> payload;
+};
+
+// Queue one record and remember it if the ring took it.
+template <class Record>
+static void queue(AudioTelemetry &t, std::vector<SimFrame> &sent, unsigned int &attempts,
+	const Record &r)
+{
+	attempts++;
+	if (!t.send(r)) return;
+	const uint8_t *p = (const uint8_t *)&r;
+	sent.push_back(SimFrame{Record::type, std::vector<uint8_t>(p, p + sizeof(r))});
+}
+
+int main(int argc, char **argv)
+{
+	const unsigned int iterations = 20000;
+	AudioTelemetry t(3);
+	SimPort port;
+	std::vector<SimFrame> sent;
+	unsigned int attempts = 0, levels = 0, texts = 0, partial_texts = 0;
+	audio_meter_snapshot_t<8> meter = audio_meter_snapshot_t<8>();
+	audio_profile_t profile = audio_profile_t();
+	AudioAnalyzeTDMStatus status;
+	AudioEffectLiveness4 live;
+	SimUsbOutput usb;
+
+	for (unsigned int i=0; i < iterations; i++) {
+		// the host stops reading for a while, twice
+		port.stalled = (i >= 5000 && i < 6000) || (i >= 12000 && i < 12400);
+		if (i % 10 == 0) {
+			telemetry_system_t s = telemetry_system_t();
+			s.millis = i;
+			s.memory = i % 40;
+			s.dropped = t.dropped();
+			queue(t, sent, attempts, s);
+			telemetry_passthrough_t pt;
+			pt.slips = i / 1000;
+			queue(t, sent, attempts, pt);
+		}
+		if (i % 25 == 0) {
+			meter.sequence++;
+			meter.samples = AUDIO_BLOCK_SAMPLES * 8;
+			for (unsigned int c=0; c < 8; c++) {
+				meter.channel[c].peak = (i * 7 + c * 1000) % 32769;
+				meter.channel[c].clips = c == 5 ? 70000 : i % 3;
+				meter.channel[c].sum_squares = (uint64_t)meter.channel[c].peak *
+					meter.channel[c].peak * meter.samples / 4;
+			}
+			attempts++;
+			if (t.levels(meter, 4)) {
+				levels++;
+				telemetry_levels_t h;
+				h.window = meter.sequence;
+				h.samples = meter.samples;
+				h.first = 4;
+				h.count = 8;
+				SimFrame f{TELEMETRY_LEVELS, std::vector<uint8_t>((uint8_t *)&h, (uint8_t *)&h + sizeof(h))};
+				for (unsigned int c=0; c < 8; c++) {
+					telemetry_level_t l;
+					l.peak = meter.channel[c].peak;
+					l.rms = meter.rms(c) * 32767.0f + 0.5f;
+					l.clips = meter.channel[c].clips < 0xFFFF ? meter.channel[c].clips : 0xFFFF;
+					f.payload.insert(f.payload.end(), (uint8_t *)&l, (uint8_t *)&l + sizeof(l));
+				}
+				sent.push_back(f);
+			}
+		}
+		if (i % 50 == 0) {
+			audio_profile_record(&profile, 100 + i % 900);
+			attempts += 2;
+			telemetry_profile_t r;
+			if (t.profile(TELEMETRY_PROFILE_UPDATE_ALL, &profile)) {
+				audio_profile_t s;
+				audio_profile_snapshot(&profile, &s);
+				r.id = TELEMETRY_PROFILE_UPDATE_ALL;
+				memset(r.reserved, 0, sizeof(r.reserved));
+				r.count = s.count;
+				r.min = s.min;
+				r.mean = audio_profile_mean(&s);
+				r.max = s.max;
+				const uint8_t *p = (const uint8_t *)&r;
+				sent.push_back(SimFrame{TELEMETRY_PROFILE, std::vector<uint8_t>(p, p + sizeof(r))});
+			}
+			if (t.link(status)) {
+				telemetry_link_t l = telemetry_link_t();
+				l.errors = status.errors();
+				const uint8_t *p = (const uint8_t *)&l;
+				sent.push_back(SimFrame{TELEMETRY_LINK, std::vector<uint8_t>(p, p + sizeof(l))});
+			}
+			attempts++;
+			if (t.liveness(live, 4)) {
+				telemetry_liveness_t l = telemetry_liveness_t();
+				l.first = 4;
+				l.count = 4;
+				const uint8_t *p = (const uint8_t *)&l;
+				sent.push_back(SimFrame{TELEMETRY_LIVENESS, std::vector<uint8_t>(p, p + sizeof(l))});
+			}
+			attempts++;
+			if (t.usb(usb)) {
+				telemetry_usb_t u;
+				u.fill = 150;
+				u.fill_min = 80;
+				u.fill_max = 245;
+				u.target = 150;
+				u.correction = -976;
+				u.underruns = 2;
+				u.overruns = 5;
+				const uint8_t *p = (const uint8_t *)&u;
+				sent.push_back(SimFrame{TELEMETRY_USB, std::vector<uint8_t>(p, p + sizeof(u))});
+			}
+		}
+		t.drain(port);
+		// a serial command's text, printed straight to the port as the
+		// sketches do, also when the drain left frames in the ring: every
+		// other time the port has just had room for part of two frames
+		if (i % 499 == 0 && !port.stalled) {
+			if (i % 998 == 0) {
+				telemetry_passthrough_t pt;
+				pt.slips = i;
+				queue(t, sent, attempts, pt);
+				queue(t, sent, attempts, pt);
+				port.limit = 2 * (sizeof(pt) + TELEMETRY_OVERHEAD) - 4;
+				t.drain(port);
+				port.limit = 80;
+			}
+			const char *text = "Profile reset\r\n";
+			port.wire.insert(port.wire.end(), text, text + strlen(text));
+			texts++;
+			if (t.pending()) partial_texts++;
+		}
+	}
+	// the host catches up
+	port.stalled = false;
+	while (t.pending()) t.drain(port);
+
+	// parse the capture back
+	unsigned int parsed = 0, mismatches = 0, skipped = 0;
+	const std::vector<uint8_t> &w = port.wire;
+	size_t k = 0;
+	while (k < w.size()) {
+		if (k + TELEMETRY_OVERHEAD > w.size() || w[k] != TELEMETRY_SYNC0 || w[k + 1] != TELEMETRY_SYNC1) {
+			skipped++;
+			k++;
+			continue;
+		}
+		unsigned int n = w[k + 3];
+		uint16_t crc = telemetry_crc16(0xFFFF, &w[k + 2], TELEMETRY_HEADER - 2 + n);
+		const uint8_t *c = &w[k + TELEMETRY_HEADER + n];
+		bool good = (c[0] | (c[1] << 8)) == crc && w[k + 4] == 3 &&
+			w[k + 5] == (uint8_t)parsed && parsed < sent.size() &&
+			w[k + 2] == sent[parsed].type && n == sent[parsed].payload.size() &&
+			memcmp(&w[k + TELEMETRY_HEADER], sent[parsed].payload.data(), n) == 0;
+		if (!good) {
+			if (mismatches++ < 4) printf("  mismatch in frame %u at byte %zu\n", parsed, k);
+			k++;
+			continue;
+		}
+		parsed++;
+		k += TELEMETRY_OVERHEAD + n;
+	}
+
+	printf("telemetry ring: %u bytes, %u iterations, host stalled twice\n",
+		TELEMETRY_RING_BYTES, iterations);
+	printf("  %u records offered, %u queued (%u levels), %u dropped; %zu bytes on the wire\n",
+		attempts, (unsigned int)sent.size(), levels, (unsigned int)t.dropped(), w.size());
+	printf("  %u frames parsed back, %u text bytes between them (%u lines after a partial drain),"
+		" %u port overflows\n", parsed, skipped, partial_texts, port.overflows);
+	bool ok = port.overflows == 0 && mismatches == 0 && parsed == sent.size() &&
+		t.dropped() > 0 && sent.size() + t.dropped() == attempts &&
+		skipped == texts * strlen("Profile reset\r\n") && partial_texts > 0;
+	printf("  %u mismatches: %s\n", mismatches, ok ? "ok" : "FAIL");
+
+	if (argc > 1) {
+		FILE *f = fopen(argv[1], "wb");
+		if (!f || fwrite(w.data(), 1, w.size(), f) != w.size()) {
+			printf("  FAIL: cannot write %s\n", argv[1]);
+			ok = false;
+		}
+		if (f) fclose(f);
+	}
+	return ok ? 0 : 1;
+}
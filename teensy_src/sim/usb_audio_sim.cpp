@@ -0,0 +1,523 @@
+/* Host simulation of the USB audio streaming
+ *
+ * Builds the patched usb_audio.cpp against the endpoint model in
+ * shim/sim_usb.cpp.  The master sketch's path runs end to end: microphone
+ * and slave words clocked into AudioInputI2SQuadTDMT, its outputs into
+ * AudioOutputUSB (the receiver's 12 at most, the rest sent as silence),
+ * and a USB frame every 44.1 SAI frames, as the host's SOF and the audio
+ * clock agree on average, then with the audio clock 1000 ppm fast and
+ * slow.  Once the queue has settled every sample in the IN packets must
+ * follow the wire pattern without a gap, and the wire to host latency is
+ * reported.  The other direction sends 44/45-sample OUT packets into
+ * AudioInputUSB, whose blocks must be just as continuous.
+ *
+ * A last transmit run has the host stop polling for 3 ms every 250 ms.
+ * The default queue has no room for that and must report overruns;
+ * usb_audio_sim_deep, built with a 4-block USB_AUDIO_TX_QUEUE_BLOCKS, must
+ * ride it out without a gap.
+ *
+ * Built with USB_AUDIO_MICROFRAMES (usb_audio_sim_hs), every run is
+ * repeated at high speed with a packet each way every 125 us micro-frame.
+ *
+ * Above 10 channels a full speed packet does not fit, and the full speed
+ * run only checks that nothing streams there.
+ *
+ * The Makefile builds it once per block size (16, 32, 64 and 128 samples)
+ * and once per channel count (4, 8, 12 and 16, AUDIO_CHANNELS; 12 and 16
+ * with USB_AUDIO_MICROFRAMES).
+ *
+ * usage: usb_audio_sim [milliseconds]
+ */
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "AudioStream.h"
+#include "AudioInputI2SQuadTDM.h"
+#include "usb_dev.h"
+#include "usb_audio.h"
+#include "audio_profile.h"
+#include "audio_memory.h"
+#include "audio_dma_mem.h"
+
+#define CHANNELS		AUDIO_CHANNELS
+// milliseconds before the queues are expected to have settled
+#define SETTLE_MS		50
+// a busy host: it stops polling the IN endpoint for STALL_FRAMES frames
+// every STALL_PERIOD, in the transmit run that asks for it
+#define STALL_FRAMES		3
+#define STALL_PERIOD		250
+// length of the receive run whose host paces its packets by the feedback
+// endpoint: the stock controller is an integrator, so its fill swings
+// slowly about the target and the mean lag needs most of a minute
+#define FOLLOW_MS		60000
+
+extern volatile uint32_t usb_audio_underrun_count;
+extern volatile uint32_t usb_audio_overrun_count;
+
+// Unique, never-zero sample for channel c at absolute sample index n.
+static int16_t pattern(unsigned int c, uint32_t n)
+{
+	uint32_t x = (n + 1) * 2654435761u ^ (c + 1) * 0x9E3779B9u;
+	x ^= x >> 15;
+	x *= 0x85EBCA6Bu;
+	x ^= x >> 13;
+	return (int16_t)(x | 1);
+}
+
+typedef AudioInputI2SQuadTDMT<2> Rx;
+
+// channels with a receiver output behind them
+static const unsigned int wired = CHANNELS < Rx::channels ? CHANNELS : Rx::channels;
+
+// The master's wire: microphone words on the local lanes (output c is
+// pattern(c, n)), slave slots on the others.  The SAI model asks for word
+// 0 of every enabled lane, then word 1, so the call count locates them.
+static uint32_t wire_word(unsigned int lane, void *arg)
+{
+	uint32_t k = (*(uint32_t *)arg)++;
+	uint32_t n = k / (Rx::words_per_frame * Rx::lanes);
+	unsigned int w = (k / Rx::lanes) % Rx::words_per_frame;
+	if (lane < Rx::local_lanes) return (uint32_t)(uint16_t)pattern(lane * 2 + w, n) << 16;
+	unsigned int c = Rx::local_channels + (lane - Rx::local_lanes) * 4 + w * 2;
+	return ((uint32_t)(uint16_t)pattern(c, n) << 16) | (uint16_t)pattern(c + 1, n);
+}
+
+// SAI frames and USB (micro-)frames clocked so far
+static uint32_t sai_frames;
+static unsigned int usb_frames;
+static bool host_stalls;
+// packets each way per millisecond, 8 in micro-frames
+static unsigned int packets_per_ms = 1;
+
+static unsigned int usb_ms(void)
+{
+	return usb_frames / packets_per_ms;
+}
+
+// The host end of the IN endpoint: follows the sample stream through the
+// packets, locking on again after a gap, and measures how long each
+// packet's first sample took from the wire.
+struct SimHost {
+	bool locked;
+	uint32_t next;			// wire frame of the next sample
+	unsigned int packets;
+	unsigned int errors;		// samples out of sequence after settling
+	unsigned int latency_min;
+	unsigned int latency_max;
+	uint64_t latency_sum;
+	unsigned int measured;
+};
+
+static const int16_t *packet_sample(const uint8_t *data, unsigned int i)
+{
+	return (const int16_t *)(data + i * CHANNELS * 2);
+}
+
+static void host_packet(int endpoint, const uint8_t *data, unsigned int len, void *arg)
+{
+	SimHost *h = (SimHost *)arg;
+	if (endpoint != AUDIO_TX_ENDPOINT) return;
+	unsigned int n = len / (CHANNELS * 2);
+	bool settled = usb_ms() > SETTLE_MS;
+	h->packets++;
+	for (unsigned int i=0; i < n; i++) {
+		const int16_t *s = packet_sample(data, i);
+		bool good = h->locked;
+		for (unsigned int c=0; good && c < CHANNELS; c++) {
+			good = s[c] == (c < wired ? pattern(c, h->next) : 0);
+		}
+		if (!good && i + 1 < n) {
+			if (settled && h->locked) h->errors++;
+			// find the wire frame this sample came from
+			h->locked = false;
+			for (uint32_t k=0; k <= sai_frames; k++) {
+				if (s[0] == pattern(0, k) && packet_sample(data, i + 1)[0] == pattern(0, k + 1)) {
+					h->locked = true;
+					h->next = k;
+					break;
+				}
+			}
+			good = h->locked;
+		}
+		if (!good) continue;
+		if (i == 0 && settled) {
+			unsigned int latency = sai_frames - h->next;
+			if (!h->measured || latency < h->latency_min) h->latency_min = latency;
+			if (!h->measured || latency > h->latency_max) h->latency_max = latency;
+			h->latency_sum += latency;
+			h->measured++;
+		}
+		h->next++;
+	}
+}
+
+// Clock SAI frames up to 'ms' milliseconds, with a USB frame each time
+// the frame count passes the next multiple of 44.1 (5.5125 in
+// micro-frames), or of that x (1 + ppm / 10^6) for an audio clock that
+// fast against the host's frames.
+static void run_clocks(unsigned int ms, int ppm = 0)
+{
+	uint32_t end = (uint32_t)((uint64_t)ms * 441 * (1000000 + ppm) / 10000000);
+	while (sai_frames < end) {
+		sim_sai1_rx_frame();
+		sai_frames++;
+		while ((uint64_t)(usb_frames + 1) * 441 * (1000000 + ppm) <=
+			(uint64_t)sai_frames * 10000000 * packets_per_ms) {
+			usb_frames++;
+			if (host_stalls && usb_ms() > SETTLE_MS &&
+				usb_frames % (STALL_PERIOD * packets_per_ms) == 0) {
+				sim_usb_pause(STALL_FRAMES * packets_per_ms);
+			}
+			sim_usb_frame();
+		}
+	}
+}
+
+// The host's speed: at 480 Mbit a USB_AUDIO_MICROFRAMES build sends a
+// packet every micro-frame.
+static void usb_start(bool high_speed)
+{
+	usb_high_speed = high_speed;
+	usb_audio_configure();
+	packets_per_ms = AudioOutputUSB::packetsPerFrame();
+}
+
+static bool run_transmit(unsigned int ms, int ppm, bool stalls = false, bool high_speed = false)
+{
+	sim_reset();
+	sim_usb_reset();
+	AudioMemory(16 * CHANNELS);
+	sai_frames = 0;
+	usb_frames = 0;
+	host_stalls = stalls;
+
+	uint32_t wire = 0;
+	sim_sai1_set_rx_source(wire_word, &wire);
+	SimHost host = SimHost();
+	sim_usb_set_sink(host_packet, &host);
+
+	Rx rx(0x00FF | ((1u << wired) - 1));
+	AudioOutputUSB usb;
+	AudioConnection *cords[wired];
+	for (unsigned int c=0; c < wired; c++) {
+		cords[c] = new AudioConnection(rx, c, usb, c);
+	}
+	usb_start(high_speed);
+	usb_audio_transmit_setting = 1;
+	audio_profile_begin();
+	audio_profile_reset(&audio_profile_usb_tx);
+	unsigned int planned = AudioMemoryUser::blocksNeeded();
+
+	run_clocks(SETTLE_MS, ppm);
+	uint32_t underruns = AudioOutputUSB::underruns();
+	uint32_t overruns = AudioOutputUSB::overruns();
+	unsigned int fill_min, fill_max;
+	AudioOutputUSB::fillRange(&fill_min, &fill_max);
+	run_clocks(ms, ppm);
+	underruns = AudioOutputUSB::underruns() - underruns;
+	overruns = AudioOutputUSB::overruns() - overruns;
+	AudioOutputUSB::fillRange(&fill_min, &fill_max);
+	int correction = AudioOutputUSB::correction();
+
+	float mean = host.measured ? (float)host.latency_sum / host.measured : 0.0f;
+	printf("device to host, %u-sample blocks, %u-block queue, audio clock %+d ppm%s%s: %u ms, %u packets\n",
+		AUDIO_BLOCK_SAMPLES, USB_AUDIO_TX_QUEUE_BLOCKS, ppm, stalls ? ", host stalls" : "",
+		packets_per_ms > 1 ? ", micro-frames" : "", usb_ms(), host.packets);
+	audio_profile_print(sim_stdout, "  usb tx", &audio_profile_usb_tx);
+	printf("  wire to host latency: min %u, mean %.1f, max %u samples (%.2f ms mean)\n",
+		host.latency_min, mean, host.latency_max, mean * 1000.0f / AUDIO_SAMPLE_RATE_EXACT);
+	printf("  queue %u samples (%u to %u), target %u; correction %+d ppm, %u underruns, %u overruns\n",
+		AudioOutputUSB::fill(), fill_min, fill_max, AudioOutputUSB::fillTarget(),
+		correction, underruns, overruns);
+	printf("  cache maintenance: %u calls, %llu bytes\n",
+		sim_dcache_calls, (unsigned long long)sim_dcache_bytes);
+	// the controller must have learned the clock offset; with stalls it
+	// also makes up for the packets the host did not take
+	bool ok = host.measured > 0 && host.errors == 0 && sim_usb_missed() == 0 &&
+		underruns == 0 && overruns == 0 && (stalls || abs(correction - ppm) <= 100) &&
+		AudioStream::memory_used_max <= planned && (!AUDIO_DMA_DTCM || sim_dcache_calls == 0);
+	if (stalls && USB_AUDIO_TX_QUEUE_BLOCKS == USB_AUDIO_QUEUE_BLOCKS) {
+		// the default queue has no room for a stall: it must show
+		ok = overruns > 0;
+	}
+	printf("  audio blocks max %u of %u planned, %u samples out of sequence after %u ms: %s\n",
+		AudioStream::memory_used_max, planned, host.errors, SETTLE_MS, ok ? "ok" : "FAIL");
+	// the host stops streaming; the queue goes back to the pool before the
+	// next run installs its own
+	usb_audio_transmit_setting = 0;
+	usb.update();
+	for (unsigned int c=0; c < wired; c++) delete cords[c];
+	return ok;
+}
+
+// The host's OUT stream: 44 samples per packet, 45 every tenth, or 5 and
+// 6 for 5.5125 per micro-frame.  A following host sends what the feedback
+// endpoint asks for instead, carrying the fraction over to the next packet.
+struct SimSource {
+	uint32_t next;
+	unsigned int packets;
+	bool follow;
+	uint32_t fraction;
+};
+
+static unsigned int host_send(int endpoint, uint8_t *data, unsigned int size, void *arg)
+{
+	SimSource *s = (SimSource *)arg;
+	if (endpoint != AUDIO_RX_ENDPOINT) return 0;
+	unsigned int k = s->packets++, per = 10 * packets_per_ms;
+	unsigned int n = (k + 1) * 441 / per - k * 441 / per;
+	if (s->follow) {
+		s->fraction += usb_high_speed ? usb_audio_sync_feedback : usb_audio_sync_feedback << 2;
+		n = s->fraction >> 16;
+		s->fraction &= 0xFFFF;
+	}
+	if (n * CHANNELS * 2 > size) n = size / (CHANNELS * 2);
+	int16_t *p = (int16_t *)data;
+	for (unsigned int i=0; i < n; i++) {
+		for (unsigned int c=0; c < CHANNELS; c++) {
+			*p++ = pattern(c, s->next);
+		}
+		s->next++;
+	}
+	return n * CHANNELS * 2;
+}
+
+// Checks that the blocks out of AudioInputUSB continue the host's stream,
+// and how far behind the host they are.
+class SimUsbSink : public AudioStream
+{
+public:
+	SimUsbSink(SimSource *source) : AudioStream(CHANNELS, inputQueueArray),
+		source(source), settled(false), locked(false), next(0), errors(0),
+		blocks(0), lag_min(0), lag_max(0), lag_sum(0) { }
+	virtual void update(void) {
+		audio_block_t *block[CHANNELS];
+		for (unsigned int c=0; c < CHANNELS; c++) block[c] = receiveReadOnly(c);
+		if (block[0]) {
+			bool good = locked;
+			for (unsigned int c=0; c < CHANNELS; c++) {
+				for (unsigned int i=0; good && block[c] && i < AUDIO_BLOCK_SAMPLES; i++) {
+					good = block[c]->data[i] == pattern(c, next + i);
+				}
+				good &= block[c] != NULL;
+			}
+			if (!good) {
+				if (settled && locked) errors++;
+				locked = false;
+				for (uint32_t k=0; k < source->next; k++) {
+					if (block[0]->data[0] == pattern(0, k) && block[0]->data[1] == pattern(0, k + 1)) {
+						locked = true;
+						next = k;
+						break;
+					}
+				}
+			}
+			if (locked && settled) {
+				// samples the host had sent beyond this block's first
+				unsigned int lag = source->next - next;
+				if (!blocks || lag < lag_min) lag_min = lag;
+				if (!blocks || lag > lag_max) lag_max = lag;
+				lag_sum += lag;
+				blocks++;
+			}
+			next += AUDIO_BLOCK_SAMPLES;
+		}
+		for (unsigned int c=0; c < CHANNELS; c++) {
+			if (block[c]) release(block[c]);
+		}
+	}
+	SimSource *source;
+	bool settled;
+	bool locked;
+	uint32_t next;
+	unsigned int errors;
+	unsigned int blocks;
+	unsigned int lag_min;
+	unsigned int lag_max;
+	uint64_t lag_sum;
+private:
+	audio_block_t *inputQueueArray[CHANNELS];
+};
+
+static bool run_receive(unsigned int ms, bool high_speed = false, bool follow = false)
+{
+	sim_reset();
+	sim_usb_reset();
+	AudioMemory(16 * CHANNELS);
+	sai_frames = 0;
+	usb_frames = 0;
+
+	uint32_t wire = 0;
+	sim_sai1_set_rx_source(wire_word, &wire);
+	SimSource source = SimSource();
+	source.follow = follow;
+	sim_usb_set_source(host_send, &source);
+
+	// the receiver only provides the update clock
+	Rx rx(0x00FF);
+	AudioInputUSB usb;
+	SimUsbSink sink(&source);
+	AudioConnection *cords[CHANNELS];
+	for (unsigned int c=0; c < CHANNELS; c++) {
+		cords[c] = new AudioConnection(usb, c, sink, c);
+	}
+	usb_start(high_speed);
+	usb_audio_receive_setting = 1;
+	audio_profile_reset(&audio_profile_usb_rx);
+	unsigned int planned = AudioMemoryUser::blocksNeeded();
+
+	run_clocks(SETTLE_MS);
+	sink.settled = true;
+	uint32_t underruns = usb_audio_underrun_count;
+	uint32_t overruns = usb_audio_overrun_count;
+	run_clocks(ms);
+	underruns = usb_audio_underrun_count - underruns;
+	overruns = usb_audio_overrun_count - overruns;
+
+	printf("host to device, %u-sample blocks, %u-block queue%s%s: %u ms, %u packets\n",
+		AUDIO_BLOCK_SAMPLES, USB_AUDIO_QUEUE_BLOCKS, packets_per_ms > 1 ? ", micro-frames" : "",
+		follow ? ", host follows feedback" : "", usb_ms(), source.packets);
+	audio_profile_print(sim_stdout, "  usb rx", &audio_profile_usb_rx);
+	printf("  host to graph lag: %u to %u samples, mean %.0f; after %u ms: %u underruns, %u overruns\n",
+		sink.lag_min, sink.lag_max, sink.blocks ? (double)sink.lag_sum / sink.blocks : 0.0,
+		SETTLE_MS, underruns, overruns);
+	bool ok = sink.blocks > 0 && sink.errors == 0 && underruns == 0 && overruns == 0 &&
+		sim_usb_missed() == 0 && AudioStream::memory_used_max <= planned;
+	printf("  audio blocks max %u of %u planned, %u blocks checked, %u out of sequence: %s\n",
+		AudioStream::memory_used_max, planned, sink.blocks, sink.errors, ok ? "ok" : "FAIL");
+	for (unsigned int c=0; c < CHANNELS; c++) delete cords[c];
+	return ok;
+}
+
+#if !AUDIO_TX_SIZE_12
+// Above 10 channels the full speed streaming alternates are zero
+// bandwidth: the audio endpoints stay unconfigured, and with alternate 1
+// selected anyway AudioOutputUSB must drop its blocks, not queue them.
+static bool run_zero_bandwidth(unsigned int ms)
+{
+	sim_reset();
+	sim_usb_reset();
+	AudioMemory(16 * CHANNELS);
+	sai_frames = 0;
+	usb_frames = 0;
+	host_stalls = false;
+
+	uint32_t wire = 0;
+	sim_sai1_set_rx_source(wire_word, &wire);
+	SimHost host = SimHost();
+	sim_usb_set_sink(host_packet, &host);
+	SimSource source = SimSource();
+	sim_usb_set_source(host_send, &source);
+
+	Rx rx(0x00FF | ((1u << wired) - 1));
+	AudioOutputUSB usb;
+	AudioConnection *cords[wired];
+	for (unsigned int c=0; c < wired; c++) {
+		cords[c] = new AudioConnection(rx, c, usb, c);
+	}
+	usb_start(false);
+	usb_audio_transmit_setting = 1;
+	usb_audio_receive_setting = 1;
+	unsigned int planned = AudioMemoryUser::blocksNeeded();
+	uint32_t overruns = AudioOutputUSB::overruns();
+
+	run_clocks(ms);
+	overruns = AudioOutputUSB::overruns() - overruns;
+
+	bool ok = host.packets == 0 && source.packets == 0 && overruns == 0 &&
+		AudioOutputUSB::fill() == 0 && AudioStream::memory_used_max <= planned;
+	printf("full speed, %u channels: zero bandwidth, %u ms, %u packets in, %u out\n",
+		CHANNELS, usb_ms(), host.packets, source.packets);
+	printf("  queue %u samples, %u overruns; audio blocks max %u of %u planned: %s\n",
+		AudioOutputUSB::fill(), overruns, AudioStream::memory_used_max, planned,
+		ok ? "ok" : "FAIL");
+	usb_audio_transmit_setting = 0;
+	usb_audio_receive_setting = 0;
+	usb.update();
+	for (unsigned int c=0; c < wired; c++) delete cords[c];
+	return ok;
+}
+#endif
+
+// The configuration descriptors usb_desc.c builds, as the host reads them.
+extern "C" const uint8_t usb_config_descriptor_480[];
+extern "C" const uint8_t usb_config_descriptor_12[];
+
+// Walks one speed's configuration descriptor.  The lengths must add up,
+// every channel count in the audio interfaces must be AUDIO_CHANNELS, and
+// each audio endpoint's wMaxPacketSize must be the size
+// usb_audio_configure() gives the controller, at most the 1023 bytes of an
+// isochronous packet, with a bInterval that matches its packet rate.
+static bool check_descriptor(bool high_speed)
+{
+	const uint8_t *config = high_speed ? usb_config_descriptor_480 : usb_config_descriptor_12;
+	sim_reset();
+	sim_usb_reset();
+	usb_start(high_speed);
+
+	unsigned int total = config[2] | (config[3] << 8);
+	unsigned int pos = 0, errors = 0, endpoints = 0;
+	unsigned int ac_length = 0, ac_total = 0;
+	unsigned int sizes[3] = {0, 0, 0};	// transmit, receive, sync
+	int subclass = -1;			// of the audio interface, -1 another class
+	while (pos + 2 <= total && config[pos] >= 2 && pos + config[pos] <= total) {
+		const uint8_t *d = config + pos;
+		pos += d[0];
+		if (d[1] == 4) {
+			subclass = d[5] == 1 ? d[6] : -1;
+		} else if (d[1] == 0x24 && subclass == 1) {
+			ac_length += d[0];
+			if (d[2] == 1) ac_total = d[5] | (d[6] << 8);
+			if (d[2] == 2 && d[7] != CHANNELS) errors++;	// input terminal
+			if (d[2] == 6 && d[0] != 8 + CHANNELS) errors++;	// feature unit
+		} else if (d[1] == 0x24 && subclass == 2) {
+			if (d[2] == 2 && d[4] != CHANNELS) errors++;	// type I format
+		} else if (d[1] == 5 && subclass == 2 && (d[3] & 3) == 1) {
+			int ep = d[2] & 0x0F, transmit = d[2] >> 7;
+			unsigned int size = d[4] | (d[5] << 8);
+			bool feedback = (d[3] & 0x30) == 0x10;
+			unsigned int slot = feedback ? 2 : transmit ? 0 : 1;
+			sizes[slot] = size;
+			if (size > 1023 || size != sim_usb_packet_size(ep, transmit)) errors++;
+			// data every 1 ms at full speed, 2^(bInterval-1) micro-frames at high
+			unsigned int interval = high_speed ? 1u << (d[6] - 1) : d[6] * 8;
+			if (!feedback && interval != 8 / packets_per_ms) errors++;
+			endpoints++;
+		}
+	}
+	if (pos != total || ac_length != ac_total || endpoints != 3) errors++;
+
+	printf("%s speed descriptor, %u channels: %u bytes, packets %u/%u/%u bytes in/out/feedback: %s\n",
+		high_speed ? "high" : "full", CHANNELS, total, sizes[0], sizes[1], sizes[2],
+		errors ? "FAIL" : "ok");
+	return errors == 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int ms = 2000;
+	if (argc > 1) ms = strtoul(argv[1], nullptr, 0);
+
+	bool ok = true;
+	ok &= check_descriptor(false);
+	ok &= check_descriptor(true);
+#if AUDIO_TX_SIZE_12
+	ok &= run_transmit(ms, 0);
+	ok &= run_transmit(ms, 1000);
+	ok &= run_transmit(ms, -1000);
+	ok &= run_transmit(ms, 0, true);
+	ok &= run_receive(ms);
+	ok &= run_receive(FOLLOW_MS, false, true);
+#else
+	ok &= run_zero_bandwidth(ms);
+#endif
+#ifdef USB_AUDIO_MICROFRAMES
+	ok &= run_transmit(ms, 0, false, true);
+	ok &= run_transmit(ms, 1000, false, true);
+	ok &= run_transmit(ms, -1000, false, true);
+	ok &= run_transmit(ms, 0, true, true);
+	ok &= run_receive(ms, true);
+	ok &= run_receive(FOLLOW_MS, true, true);
+#endif
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+/* Bit-exactness check and host benchmark for the USB interleave kernels
+ *
+ * Compares usb_audio_interleave() and usb_audio_deinterleave() against the
+ * per-sample loops kept as the _ref kernels, for 4, 8 and 16 channels.
+ * Runs start and end at every alignment within a block, as packets do, and
+ * destinations are pre-filled with a sentinel so stores outside the run
+ * are caught as well.  The timing is one 45 sample packet per call.
+ *
+ * usage: usb_pack_bench [iterations]
+ */
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "AudioStream.h"
+#include "usb_audio_pack.h"
+
+#define MAX_CHANNELS	16
+#define PACKET		45
+#define SENTINEL	0xA5A5A5A5u
+
+static int16_t block[MAX_CHANNELS][AUDIO_BLOCK_SAMPLES] __attribute__((aligned(4)));
+static int16_t out_ref[MAX_CHANNELS][AUDIO_BLOCK_SAMPLES] __attribute__((aligned(4)));
+static int16_t out_opt[MAX_CHANNELS][AUDIO_BLOCK_SAMPLES] __attribute__((aligned(4)));
+static uint32_t wire[AUDIO_BLOCK_SAMPLES * MAX_CHANNELS / 2];
+static uint32_t wire_ref[AUDIO_BLOCK_SAMPLES * MAX_CHANNELS / 2 + 1];
+static uint32_t wire_opt[AUDIO_BLOCK_SAMPLES * MAX_CHANNELS / 2 + 1];
+
+static uint32_t rng_state = 0x12345678;
+static uint32_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+template <class Fill>
+static double time_ns(Fill fill, unsigned int iterations)
+{
+	uint64_t t0 = sim_nanos();
+	for (unsigned int n=0; n < iterations; n++) {
+		fill();
+		asm volatile("" ::: "memory");
+	}
+	return (double)(sim_nanos() - t0) / iterations;
+}
+
+template <unsigned int Channels>
+static bool bench(unsigned int iterations)
+{
+	const int16_t *src[Channels];
+	int16_t *dst_ref[Channels], *dst_opt[Channels];
+	bool ok = true;
+	unsigned int runs = 0;
+
+	for (unsigned int ch=0; ch < Channels; ch++) {
+		src[ch] = block[ch];
+		dst_ref[ch] = out_ref[ch];
+		dst_opt[ch] = out_opt[ch];
+	}
+	// every start and a range of lengths, including empty and odd runs
+	for (unsigned int offset=0; offset < AUDIO_BLOCK_SAMPLES; offset++) {
+		for (unsigned int trial=0; trial < 8; trial++) {
+			unsigned int len = rng() % (AUDIO_BLOCK_SAMPLES - offset + 1);
+			unsigned int words = len * Channels / 2;
+			for (auto &b : block) for (auto &s : b) s = rng();
+			for (auto &w : wire) w = rng();
+
+			for (auto &w : wire_ref) w = SENTINEL;
+			for (auto &w : wire_opt) w = SENTINEL;
+			usb_audio_interleave_ref<Channels>(wire_ref, src, offset, len);
+			usb_audio_interleave<Channels>(wire_opt, src, offset, len);
+			if (memcmp(wire_ref, wire_opt, sizeof(wire_ref)) != 0) ok = false;
+			if (wire_opt[words] != SENTINEL) ok = false;
+
+			memset(out_ref, 0xA5, sizeof(out_ref));
+			memset(out_opt, 0xA5, sizeof(out_opt));
+			usb_audio_deinterleave_ref<Channels>(dst_ref, offset, wire, len);
+			usb_audio_deinterleave<Channels>(dst_opt, offset, wire, len);
+			if (memcmp(out_ref, out_opt, sizeof(out_ref)) != 0) ok = false;
+			runs++;
+		}
+	}
+
+	// a packet's worth from an odd start, the worst case for alignment
+	const unsigned int offset = AUDIO_BLOCK_SAMPLES > PACKET ? 1 : 0;
+	const unsigned int len = AUDIO_BLOCK_SAMPLES > PACKET ? PACKET : AUDIO_BLOCK_SAMPLES - offset;
+	double ir = time_ns([&]{ usb_audio_interleave_ref<Channels>(wire_ref, src, offset, len); }, iterations);
+	double io = time_ns([&]{ usb_audio_interleave<Channels>(wire_opt, src, offset, len); }, iterations);
+	double dr = time_ns([&]{ usb_audio_deinterleave_ref<Channels>(dst_ref, offset, wire, len); }, iterations);
+	double dd = time_ns([&]{ usb_audio_deinterleave<Channels>(dst_opt, offset, wire, len); }, iterations);
+
+	printf("%2u channels: interleave   ref %7.1f ns  opt %7.1f ns  (x%.2f)\n",
+		Channels, ir, io, ir / io);
+	printf("             deinterleave ref %7.1f ns  opt %7.1f ns  (x%.2f)  %u runs %s\n",
+		dr, dd, dr / dd, runs, ok ? "bit-exact" : "MISMATCH");
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = 20000;
+	if (argc > 1) iterations = strtoul(argv[1], nullptr, 0);
+
+	printf("USB interleaving, %u sample packet per call, %s kernels\n",
+		AUDIO_BLOCK_SAMPLES > PACKET ? PACKET : AUDIO_BLOCK_SAMPLES - 1,
+		AUDIO_PACK_DSP ? "PKHBT/PKHTB" : "portable");
+	bool ok = true;
+	ok &= bench<4>(iterations);
+	ok &= bench<8>(iterations);
+	ok &= bench<16>(iterations);
+	return ok ? 0 : 1;
+}
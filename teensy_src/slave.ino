@@ -1,81 +1,132 @@
-/* Teensy B Slave - 8-Channel Sine Wave TDM Generator
+/* Teensy B Slave - 4 Microphones + 3 Sine Waves over TDM
  *
- * This sketch generates 8 sine waves at different frequencies and transmits
- * them via TDM slave mode to Teensy A master.
+ * This sketch samples 4 I2S microphones on the master's clocks, adds 3
+ * test sine waves, and transmits them via TDM slave mode to Teensy A
+ * master, with the in-band status packet in the eighth slot.
  *
  * Hardware connections for Teensy 4.1 Slave (B):
- * Clock inputs (from Master A):
+ * Clock inputs (from Master A), shared with the microphones:
  * - Pin 21: SAI1_RX_BCLK - Bit clock (from master)
  * - Pin 20: SAI1_RX_SYNC - Frame sync/LRCLK (from master)
  *
- * TDM output to Master A:
- * - Pin 7: SAI1_TXD0 - TDM data to master (8 channels in slots 0-7)
+ * Microphones (AudioInputI2SQuadSlave, one DMA stream for both lanes):
+ * - Pin 8:  SAI1_RXD0 - mics 0 (L) and 1 (R), slots 0 and 1
+ * - Pin 6:  SAI1_RXD1 - mics 2 (L) and 3 (R), slots 2 and 3
+ * The microphones pass straight through to the TDM buffer from the receive
+ * DMA interrupt and reach the wire a few frames after capture; they are
+ * also tapped into one AudioAnalyzeMeterT for the telemetry levels.
  *
- * Generated sine wave frequencies:
- * - Ch0: 440 Hz (A4)    - Ch4: 880 Hz (A5)
- * - Ch1: 523 Hz (C5)    - Ch5: 1047 Hz (C6)
- * - Ch2: 659 Hz (E5)    - Ch6: 1319 Hz (E6)
- * - Ch3: 784 Hz (G5)    - Ch7: 1568 Hz (G6)
+ * TDM output to Master A, in the master's I2S frame (64 BCLKs) so it shares
+ * SAI1 with the master's microphones (AudioInputI2SQuadTDMT<2>):
+ * - Pin 7:  SAI1_TXD0 - slots 0-3, to master pin 9 (SAI1_RXD2)
+ * - Pin 32: SAI1_TXD1 - slots 4-7, to master pin 32 (SAI1_RXD3)
+ *
+ * Slots:
+ * - Ch0-3: microphones  - Ch5: 1047 Hz (C6)
+ * - Ch4: 880 Hz (A5)    - Ch6: 1319 Hz (E6)
+ *                       - Ch7: status packet
+ *
+ * Daisy chain (SLAVE_CHAIN_NEAR 1): a second slave sits between this one
+ * and the master, sharing the master's clocks.  It relays this board's
+ * slots 0-3 (pin 7 here to pin 9, SAI1_RXD2, there) and sends its own
+ * microphones in slots 4-7 instead of the sines and status packet, so the
+ * master receives 8 slave microphones over the same two lanes.  The master
+ * is then built with MASTER_CHAIN 1, which sends all 12 over USB.
  */
 
 #include <Audio.h>
 #include "AudioOutputTDM_Slave.h"
-
-// Create 8 sine wave generators
-AudioSynthWaveformSine sine1;
-AudioSynthWaveformSine sine2;
-AudioSynthWaveformSine sine3;
-AudioSynthWaveformSine sine4;
+#include "AudioInputI2SQuadSlave.h"
+#include "AudioAnalyzeMeter.h"
+#include "audio_telemetry.h"
+#include <audio_profile.h>
+#include <audio_memory.h>
+
+// 1 on the slave next to the master in a two slave chain
+#define SLAVE_CHAIN_NEAR 0
+
+#if SLAVE_CHAIN_NEAR
+// 4 microphones and the far slave's TXD0, clocked by the master
+AudioInputI2SQuadSlaveChain mics;
+
+// Slots 0-3 relayed from the far slave, the microphones from slot 4
+AudioOutputTDM_SlaveT<8, 16, 2, 2> tdmTX(4);
+#else
+// 4 microphones clocked by the master
+AudioInputI2SQuadSlave mics;
+
+// Create 3 sine wave generators
 AudioSynthWaveformSine sine5;
 AudioSynthWaveformSine sine6;
 AudioSynthWaveformSine sine7;
-AudioSynthWaveformSine sine8;
 
-// TDM slave output (uses external clocks from master)
-AudioOutputTDM_Slave tdmTX;
+// TDM slave output (uses external clocks from master): 8 slots of 16 bits
+// over two lanes, four per I2S frame
+AudioOutputTDM_SlaveT<8, 16, 2, 2> tdmTX;
 
-// Connect sine generators to TDM output slots 0-7
-AudioConnection c0(sine1, 0, tdmTX, 0);  // Ch0 -> TDM slot 0
-AudioConnection c1(sine2, 0, tdmTX, 1);  // Ch1 -> TDM slot 1
-AudioConnection c2(sine3, 0, tdmTX, 2);  // Ch2 -> TDM slot 2
-AudioConnection c3(sine4, 0, tdmTX, 3);  // Ch3 -> TDM slot 3
+// Sine generators to slots 4-6 (slots 0-3 are passed through)
 AudioConnection c4(sine5, 0, tdmTX, 4);  // Ch4 -> TDM slot 4
 AudioConnection c5(sine6, 0, tdmTX, 5);  // Ch5 -> TDM slot 5
 AudioConnection c6(sine7, 0, tdmTX, 6);  // Ch6 -> TDM slot 6
-AudioConnection c7(sine8, 0, tdmTX, 7);  // Ch7 -> TDM slot 7
+#endif
+
+// Microphone levels, tapped from the pass-through: one meter for all four,
+// publishing a window about every second
+AudioAnalyzeMeterT<4> micLevels(AUDIO_SAMPLE_RATE_EXACT / AUDIO_BLOCK_SAMPLES);
+AudioConnection p0(mics, 0, micLevels, 0);
+AudioConnection p1(mics, 1, micLevels, 1);
+AudioConnection p2(mics, 2, micLevels, 2);
+AudioConnection p3(mics, 3, micLevels, 3);
+
+// Binary status frames for host_src/telemetry.py: board 1, or 2 when near
+AudioTelemetry telemetry(SLAVE_CHAIN_NEAR ? 2 : 1);
 
 void setup() {
-  // Audio initialization
-  AudioMemory(200);
+  // Audio blocks for the objects above, from the heap (RAM2); the sines
+  // do not report theirs and fit in the margin
+  unsigned int audioBlocks = AudioMemoryAuto();
+
+#if !SLAVE_CHAIN_NEAR
+  // Slot 7 carries the in-band status packet the master verifies
+  tdmTX.statusSlot(7);
+#endif
+
+  // Microphones straight into slots 0-3 (4-7 after the chain offset)
+  bool passthrough = mics.passthrough(tdmTX, 0);
 
   Serial.begin(115200);
   delay(1000);
 
+  Serial.print("Audio memory: ");
+  Serial.print(audioBlocks);
+  Serial.println(audioBlocks ? " blocks reserved" : " blocks, allocation FAILED");
   Serial.println("===============================================");
-  Serial.println("Teensy 4.1 Slave - 8-Channel TDM Sine Generator");
+  Serial.println("Teensy 4.1 Slave - 4 Mics + 3 Sines over TDM");
   Serial.println("===============================================");
   Serial.println();
   Serial.println("Clock inputs (from Master A):");
   Serial.println("  Pin 21: SAI1_RX_BCLK (from master)");
   Serial.println("  Pin 20: SAI1_RX_SYNC (from master)");
+  Serial.println();
+  Serial.println("Microphones:");
+  Serial.println("  Pin 8:  SAI1_RXD0 (mics 0-1)");
+  Serial.println("  Pin 6:  SAI1_RXD1 (mics 2-3)");
+#if SLAVE_CHAIN_NEAR
+  Serial.println("  Pin 9:  SAI1_RXD2 (far slave, relayed to slots 0-3)");
+#endif
   Serial.println();
   Serial.println("TDM output to Master A:");
-  Serial.println("  Pin 7:  SAI1_TXD0 (TDM data to master)");
+  Serial.println("  Pin 7:  SAI1_TXD0 (slots 0-3)");
+  Serial.println("  Pin 32: SAI1_TXD1 (slots 4-7)");
   Serial.println();
 
+#if SLAVE_CHAIN_NEAR
+  Serial.println("TDM slots:");
+  Serial.println("  TDM Slots 0-3: far slave microphones (relayed)");
+  Serial.println(passthrough ? "  TDM Slots 4-7: microphones (pass-through)"
+                             : "  TDM Slots 4-7: pass-through FAILED");
+#else
   // Configure sine wave generators
-  sine1.frequency(440.0);   // A4
-  sine1.amplitude(0.5);
-
-  sine2.frequency(523.25);  // C5
-  sine2.amplitude(0.5);
-
-  sine3.frequency(659.25);  // E5
-  sine3.amplitude(0.5);
-
-  sine4.frequency(783.99);  // G5
-  sine4.amplitude(0.5);
-
   sine5.frequency(880.0);   // A5
   sine5.amplitude(0.5);
 
@@ -85,28 +136,55 @@ void setup() {
   sine7.frequency(1318.5);  // E6
   sine7.amplitude(0.5);
 
-  sine8.frequency(1568.0);  // G6
-  sine8.amplitude(0.5);
-
-  Serial.println("Generated TDM frequencies:");
-  Serial.println("  TDM Slot 0: 440 Hz (A4)");
-  Serial.println("  TDM Slot 1: 523 Hz (C5)");
-  Serial.println("  TDM Slot 2: 659 Hz (E5)");
-  Serial.println("  TDM Slot 3: 784 Hz (G5)");
+  Serial.println("TDM slots:");
+  Serial.println(passthrough ? "  TDM Slots 0-3: microphones (pass-through)"
+                             : "  TDM Slots 0-3: pass-through FAILED");
   Serial.println("  TDM Slot 4: 880 Hz (A5)");
   Serial.println("  TDM Slot 5: 1047 Hz (C6)");
   Serial.println("  TDM Slot 6: 1319 Hz (E6)");
-  Serial.println("  TDM Slot 7: 1568 Hz (G6)");
+  Serial.println("  TDM Slot 7: status packet (sequence, dropouts)");
+#endif
   Serial.println();
   Serial.println("TDM slave mode - waiting for master clocks...");
+  Serial.println("Status is sent as binary telemetry: python host_src/telemetry.py <port>");
+  Serial.println("Serial commands: 'p' = print ISR profile, 'r' = reset profile");
+
+  audio_profile_begin();
 }
 
 void loop() {
-  // Print status every second
-  delay(1000);
-  Serial.print("CPU Usage: ");
-  Serial.print(AudioProcessorUsage());
-  Serial.print("%, Memory: ");
-  Serial.print(AudioMemoryUsage());
-  Serial.println(" blocks");
+  // Profiling commands from the serial monitor
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c == 'p') {
+      audio_profile_print(Serial, "tdm isr", &audio_profile_tdm_isr);
+      audio_profile_print(Serial, "i2s rx", &audio_profile_i2s_rx);
+      audio_profile_print(Serial, "update_all", &audio_profile_update_all);
+    } else if (c == 'r') {
+      audio_profile_reset(&audio_profile_tdm_isr);
+      audio_profile_reset(&audio_profile_i2s_rx);
+      audio_profile_reset(&audio_profile_update_all);
+      Serial.println("Profile reset");
+    }
+  }
+
+  // Microphone levels whenever the meter finishes a window
+  AudioAnalyzeMeterT<4>::snapshot_t levels;
+  if (micLevels.available() && micLevels.read(levels)) {
+    telemetry.levels(levels);
+  }
+
+  // Status every second
+  static elapsedMillis timeout = 0;
+  if (timeout >= 1000) {
+    timeout = 0;
+    telemetry.system();
+    telemetry.passthrough(mics.passthroughSlips());
+    telemetry.profile(TELEMETRY_PROFILE_TDM_ISR, &audio_profile_tdm_isr);
+    telemetry.profile(TELEMETRY_PROFILE_I2S_RX, &audio_profile_i2s_rx);
+    telemetry.profile(TELEMETRY_PROFILE_UPDATE_ALL, &audio_profile_update_all);
+  }
+
+  // Never waits for the host: what does not fit now stays in the ring
+  telemetry.drain(Serial);
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+/* TDM slot packing kernels
+ *
+ * Interleave 16-bit audio blocks into strided 32-bit SAI words, and split
+ * received words back into blocks.  The halfword merges come from
+ * patches/audio_pack_dsp.h: single PKHBT/PKHTB instructions on Cortex-M7,
+ * bit-exact plain C++ everywhere else (including the host simulation in
+ * sim/).
+ *
+ * The main loops consume one 32-byte cache line of each source per
+ * iteration: 16 samples, loaded as word pairs so the M7 can dual-issue
+ * the loads with the packs of the previous pair.
+ */
+
+#ifndef tdm_pack_h_
+#define tdm_pack_h_
+
+#include <stdint.h>
+#include <AudioStream.h>
+#include "audio_pack_dsp.h"
+
+static_assert((AUDIO_BLOCK_SAMPLES % 4) == 0, "TDM packing needs blocks of 4n samples");
+
+// Reference kernel: the original scalar loop, two samples per load.
+template <unsigned int Stride>
+static void tdm_pack_pair_ref(uint32_t *dest, const uint32_t *src1, const uint32_t *src2)
+{
+	uint32_t i, in1, in2, out1, out2;
+
+	for (i=0; i < AUDIO_BLOCK_SAMPLES/4; i++) {
+
+		in1 = *src1++;
+		in2 = *src2++;
+		out1 = (in1 << 16) | (in2 & 0xFFFF);
+		out2 = (in1 & 0xFFFF0000) | (in2 >> 16);
+		*dest = out1;
+		*(dest + Stride) = out2;
+
+		in1 = *src1++;
+		in2 = *src2++;
+		out1 = (in1 << 16) | (in2 & 0xFFFF);
+		out2 = (in1 & 0xFFFF0000) | (in2 >> 16);
+		*(dest + Stride*2) = out1;
+		*(dest + Stride*3) = out2;
+
+		dest += Stride*4;
+	}
+}
+
+// Four samples (two words) of each source into four strided slots.
+#define TDM_PACK_PAIR_4(d, a0, a1, b0, b1) \
+	*(d)            = audio_pack_bb(a0, b0); \
+	*((d) + Stride)   = audio_pack_tt(a0, b0); \
+	*((d) + Stride*2) = audio_pack_bb(a1, b1); \
+	*((d) + Stride*3) = audio_pack_tt(a1, b1);
+
+// Two 16-bit channels per SAI word: src1 in the upper half (first on the
+// wire), src2 in the lower.  Stride is the number of words per frame.
+template <unsigned int Stride>
+static void tdm_pack_pair(uint32_t *dest, const uint32_t *src1, const uint32_t *src2)
+{
+	const uint32_t *end = src1 + AUDIO_BLOCK_SAMPLES/2;
+	const uint32_t *line_end = src1 + (AUDIO_BLOCK_SAMPLES/16)*8;
+
+	while (src1 < line_end) {
+		uint32_t a0 = src1[0], a1 = src1[1], b0 = src2[0], b1 = src2[1];
+		uint32_t a2 = src1[2], a3 = src1[3], b2 = src2[2], b3 = src2[3];
+		TDM_PACK_PAIR_4(dest, a0, a1, b0, b1)
+		TDM_PACK_PAIR_4(dest + Stride*4, a2, a3, b2, b3)
+		a0 = src1[4]; a1 = src1[5]; b0 = src2[4]; b1 = src2[5];
+		a2 = src1[6]; a3 = src1[7]; b2 = src2[6]; b3 = src2[7];
+		TDM_PACK_PAIR_4(dest + Stride*8, a0, a1, b0, b1)
+		TDM_PACK_PAIR_4(dest + Stride*12, a2, a3, b2, b3)
+		src1 += 8;
+		src2 += 8;
+		dest += Stride*16;
+	}
+	while (src1 < end) {
+		uint32_t a0 = src1[0], a1 = src1[1], b0 = src2[0], b1 = src2[1];
+		TDM_PACK_PAIR_4(dest, a0, a1, b0, b1)
+		src1 += 2;
+		src2 += 2;
+		dest += Stride*4;
+	}
+}
+
+#undef TDM_PACK_PAIR_4
+
+// One channel per 32-bit SAI word, sample left-justified.
+template <unsigned int Stride>
+static void tdm_pack_single(uint32_t *dest, const uint32_t *src)
+{
+	const uint32_t *end = src + AUDIO_BLOCK_SAMPLES/2;
+	const uint32_t *line_end = src + (AUDIO_BLOCK_SAMPLES/16)*8;
+
+	while (src < line_end) {
+		uint32_t a0 = src[0], a1 = src[1], a2 = src[2], a3 = src[3];
+		*dest = a0 << 16;
+		*(dest + Stride) = a0 & 0xFFFF0000;
+		*(dest + Stride*2) = a1 << 16;
+		*(dest + Stride*3) = a1 & 0xFFFF0000;
+		*(dest + Stride*4) = a2 << 16;
+		*(dest + Stride*5) = a2 & 0xFFFF0000;
+		*(dest + Stride*6) = a3 << 16;
+		*(dest + Stride*7) = a3 & 0xFFFF0000;
+		a0 = src[4]; a1 = src[5]; a2 = src[6]; a3 = src[7];
+		*(dest + Stride*8) = a0 << 16;
+		*(dest + Stride*9) = a0 & 0xFFFF0000;
+		*(dest + Stride*10) = a1 << 16;
+		*(dest + Stride*11) = a1 & 0xFFFF0000;
+		*(dest + Stride*12) = a2 << 16;
+		*(dest + Stride*13) = a2 & 0xFFFF0000;
+		*(dest + Stride*14) = a3 << 16;
+		*(dest + Stride*15) = a3 & 0xFFFF0000;
+		src += 8;
+		dest += Stride*16;
+	}
+	while (src < end) {
+		uint32_t a0 = src[0], a1 = src[1];
+		*dest = a0 << 16;
+		*(dest + Stride) = a0 & 0xFFFF0000;
+		*(dest + Stride*2) = a1 << 16;
+		*(dest + Stride*3) = a1 & 0xFFFF0000;
+		src += 2;
+		dest += Stride*4;
+	}
+}
+
+// Receive side: the reverse of tdm_pack_pair.  Each output word holds two
+// consecutive samples, so every step merges the same half of two frames.
+// dest1 gets the upper halves (the even slot), dest2 the lower.
+template <unsigned int Stride>
+static void tdm_unpack_pair(uint32_t *dest1, uint32_t *dest2, const uint32_t *src)
+{
+	uint32_t i, in1, in2, in3, in4;
+
+	for (i=0; i < AUDIO_BLOCK_SAMPLES/4; i++) {
+		in1 = *src;
+		in2 = *(src + Stride);
+		in3 = *(src + Stride*2);
+		in4 = *(src + Stride*3);
+		*dest1++ = audio_pack_tt(in2, in1);
+		*dest2++ = audio_pack_bb(in2, in1);
+		*dest1++ = audio_pack_tt(in4, in3);
+		*dest2++ = audio_pack_bb(in4, in3);
+		src += Stride*4;
+	}
+}
+
+// Only the upper (even) or lower (odd) slot of each word.
+template <unsigned int Stride>
+static void tdm_unpack_upper(uint32_t *dest, const uint32_t *src)
+{
+	uint32_t i;
+
+	for (i=0; i < AUDIO_BLOCK_SAMPLES/4; i++) {
+		*dest++ = audio_pack_tt(*(src + Stride), *src);
+		*dest++ = audio_pack_tt(*(src + Stride*3), *(src + Stride*2));
+		src += Stride*4;
+	}
+}
+
+template <unsigned int Stride>
+static void tdm_unpack_lower(uint32_t *dest, const uint32_t *src)
+{
+	uint32_t i;
+
+	for (i=0; i < AUDIO_BLOCK_SAMPLES/4; i++) {
+		*dest++ = audio_pack_bb(*(src + Stride), *src);
+		*dest++ = audio_pack_bb(*(src + Stride*3), *(src + Stride*2));
+		src += Stride*4;
+	}
+}
+
+// Pass-through: I2S words (sample in the upper half) straight into a
+// transmit buffer, one frame per step.  SrcStride is the received frame,
+// stride the transmitted one.  The pair form puts src and src[right] in
+// the two 16-bit halves of one word; the single form keeps the top 24
+// bits of a 32-bit slot, and the relay form copies words unchanged.
+template <unsigned int SrcStride>
+static void tdm_repack_pair(uint32_t *dest, unsigned int stride, const uint32_t *src,
+	unsigned int right, unsigned int frames)
+{
+	for (unsigned int i=0; i < frames; i++) {
+		*dest = audio_pack_tt(src[0], src[right]);
+		src += SrcStride;
+		dest += stride;
+	}
+}
+
+template <unsigned int SrcStride>
+static void tdm_relay_word(uint32_t *dest, unsigned int stride, const uint32_t *src,
+	unsigned int frames)
+{
+	for (unsigned int i=0; i < frames; i++) {
+		*dest = *src;
+		src += SrcStride;
+		dest += stride;
+	}
+}
+
+template <unsigned int SrcStride>
+static void tdm_repack_single(uint32_t *dest, unsigned int stride, const uint32_t *src,
+	unsigned int frames)
+{
+	for (unsigned int i=0; i < frames; i++) {
+		*dest = *src & 0xFFFFFF00;
+		src += SrcStride;
+		dest += stride;
+	}
+}
+
+#endif
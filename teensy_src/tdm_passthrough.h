@@ -0,0 +1,40 @@
+/* Zero-copy pass-through into a TDM transmit buffer
+ *
+ * An input on the same SAI1 as AudioOutputTDM_SlaveT runs on the same
+ * frame clock as the transmitter, so its DMA interrupt can write captured
+ * words straight into the transmit DMA buffer, a fixed number of frames
+ * ahead of the transmit DMA, instead of passing blocks through update().
+ * The output reserves the slots (AudioOutputTDM_SlaveT::passthroughTarget)
+ * and describes its buffer here; the input does the writing
+ * (AudioInputI2SSlaveT::passthrough).
+ *
+ * In a daisy chain the writer also relays an upstream board's lanes: word
+ * w of upstream lane k is copied unchanged to relay_column[k][w], so a
+ * board forwards everything before it with a few frames of delay.
+ */
+
+#ifndef tdm_passthrough_h_
+#define tdm_passthrough_h_
+
+#include <stdint.h>
+
+#define TDM_PASSTHROUGH_MAX_CHANNELS	8
+#define TDM_PASSTHROUGH_MAX_RELAY_LANES	2
+#define TDM_PASSTHROUGH_NONE		0xFF
+
+struct tdm_passthrough_t {
+	uint32_t *buffer;		// the transmit DMA buffer
+	unsigned int frames;		// frames in it
+	unsigned int stride;		// words per frame
+	bool wide;			// 32-bit slots, else 16-bit pairs
+	// word column of each channel; with 16-bit slots channels 2n and
+	// 2n+1 share the column of 2n, upper half first
+	uint8_t column[TDM_PASSTHROUGH_MAX_CHANNELS];
+	// relayed upstream words of a two word frame, TDM_PASSTHROUGH_NONE
+	// where the slot is this board's own
+	uint8_t relay_column[TDM_PASSTHROUGH_MAX_RELAY_LANES][2];
+	// frame the transmit DMA reads next
+	unsigned int (*position)(void);
+};
+
+#endif
@@ -0,0 +1,142 @@
+/* In-band status packet carried in a spare TDM slot
+ *
+ * The slave writes one packet at the start of every block in its status
+ * slot (AudioOutputTDM_SlaveT::statusSlot) and silence in the rest of the
+ * block.  The samples of a packet are:
+ *
+ *   0, 1  TDM_STATUS_SYNC0, TDM_STATUS_SYNC1
+ *   2, 3  block sequence number, low and high half
+ *   4, 5  slave queue underruns and overruns, low 16 bits
+ *   6     slave latency: samples from update() to the wire
+ *   7     check word, ~(xor of samples 0-6)
+ *
+ * TDMStatusParser runs on the master over the received slot.  It is
+ * stateful, so a packet may straddle two of the master's blocks.  Sequence
+ * gaps count lost blocks, a sequence that goes backwards counts a slave
+ * reset, and a bad check word or two blocks without a packet (the slot has
+ * slipped, or the slave stopped) count errors and clear synced.
+ */
+
+#ifndef tdm_status_h_
+#define tdm_status_h_
+
+#include <stdint.h>
+
+#define TDM_STATUS_SYNC0	0x5AA5
+#define TDM_STATUS_SYNC1	0xC33C
+#define TDM_STATUS_WORDS	8
+
+static inline uint16_t tdm_status_check(const uint16_t *w) __attribute__((unused));
+static inline uint16_t tdm_status_check(const uint16_t *w)
+{
+	uint16_t x = 0;
+	for (int i=0; i < TDM_STATUS_WORDS - 1; i++) x ^= w[i];
+	return ~x;
+}
+
+// Fill the first TDM_STATUS_WORDS samples of a status block.
+static inline void tdm_status_fill(int16_t *data, uint32_t sequence, uint16_t underruns,
+	uint16_t overruns, uint16_t latency) __attribute__((unused));
+static inline void tdm_status_fill(int16_t *data, uint32_t sequence, uint16_t underruns,
+	uint16_t overruns, uint16_t latency)
+{
+	uint16_t *w = (uint16_t *)data;
+	w[0] = TDM_STATUS_SYNC0;
+	w[1] = TDM_STATUS_SYNC1;
+	w[2] = sequence;
+	w[3] = sequence >> 16;
+	w[4] = underruns;
+	w[5] = overruns;
+	w[6] = latency;
+	w[7] = tdm_status_check(w);
+}
+
+class TDMStatusParser
+{
+public:
+	TDMStatusParser() { reset(); }
+	void reset(void) {
+		count = 0;
+		idle_blocks = 0;
+		start = 0;
+		synced = false;
+		packets = 0;
+		sequence = 0;
+		lost = 0;
+		resets = 0;
+		errors = 0;
+		phase = 0;
+		underruns = 0;
+		overruns = 0;
+		latency = 0;
+	}
+	// Consume one received block of the status slot.
+	void parse(const int16_t *data, unsigned int n) {
+		bool seen = false;
+		for (unsigned int i=0; i < n; i++) {
+			uint16_t s = data[i];
+			if (count == 0) {
+				if (s != TDM_STATUS_SYNC0) continue;
+				start = (int)i;
+			} else if (count == 1 && s != TDM_STATUS_SYNC1) {
+				count = 0;
+				if (s == TDM_STATUS_SYNC0) {
+					start = (int)i;
+					word[count++] = s;
+				}
+				continue;
+			}
+			word[count++] = s;
+			if (count == TDM_STATUS_WORDS) {
+				count = 0;
+				seen = true;
+				packet();
+			}
+		}
+		// a packet still being collected started in this block
+		if (count) start -= (int)n;
+		if (seen) {
+			idle_blocks = 0;
+		} else if (++idle_blocks >= 2 && synced) {
+			synced = false;
+			errors++;
+		}
+	}
+
+	bool synced;
+	uint32_t packets;		// valid packets received
+	uint32_t sequence;		// last sequence number
+	uint32_t lost;			// blocks missing between packets
+	uint32_t resets;		// times the sequence went backwards
+	uint32_t errors;		// bad check words and losses of sync
+	int phase;			// sample offset of the last packet in its block
+	uint16_t underruns;		// slave-reported counters
+	uint16_t overruns;
+	uint16_t latency;
+private:
+	void packet(void) {
+		if (word[TDM_STATUS_WORDS - 1] != tdm_status_check(word)) {
+			errors++;
+			synced = false;
+			return;
+		}
+		uint32_t seq = word[2] | ((uint32_t)word[3] << 16);
+		if (packets) {
+			if (seq <= sequence) resets++;
+			else if (seq != sequence + 1) lost += seq - sequence - 1;
+		}
+		sequence = seq;
+		packets++;
+		synced = true;
+		phase = start;
+		underruns = word[4];
+		overruns = word[5];
+		latency = word[6];
+	}
+	uint16_t word[TDM_STATUS_WORDS];
+	unsigned int count;
+	unsigned int idle_blocks;
+	int start;
+};
+
+#endif
@@ -2,7 +2,7 @@
  *
  * This sketch receives:
  * - 4 local I2S microphone channels (SAI1 RX)
- * - 4 remote TDM channels from Teensy B slave (first 4 of 8 TDM slots)
+ * - 4 remote microphones from Teensy B slave (first 4 of 8 TDM slots)
  * - Routes all 8 channels to USB output
  *
  * Hardware connections for Teensy 4.1 Master (A):
@@ -15,58 +15,141 @@
  * - Pin 20 (GPIO_AD_B1_10): SAI1_SYNC - Frame sync/LRCLK (drives slave)
  * - Pin 23 (GPIO_AD_B1_09): SAI1_MCLK - Master clock
  *
- * TDM data from Teensy B slave:
- * - Pin 8: SAI1_RXD0 - TDM data from slave (using slots 0-3 of 16)
+ * TDM data from Teensy B slave (AudioOutputTDM_SlaveT<8, 16, 2, 2>):
+ * - Pin 9 (GPIO_B0_11):  SAI1_RXD2 - slave slots 0-3 (from slave pin 7)
+ * - Pin 32 (GPIO_B0_12): SAI1_RXD3 - slave slots 4-7 (from slave pin 32)
  *
- * Note: Pin 8 serves dual purpose - local I2S RX and remote TDM RX
+ * All four lanes share SAI1's I2S frame (64 BCLKs) and are read by one
+ * AudioInputI2SQuadTDM object: one DMA channel, one interrupt.
+ *
+ * Daisy chain (MASTER_CHAIN 1), with a slave built with SLAVE_CHAIN_NEAR
+ * between this board and the far slave: slots 0-3 are the far slave's
+ * microphones and slots 4-7 the near slave's, with no status packet.  All
+ * 12 microphones go to USB, which takes USB type Audio built with
+ * -DAUDIO_CHANNELS=12 -DUSB_AUDIO_MICROFRAMES on a high-speed port.
  */
 
  #include <Audio.h>
  #include <Wire.h>
  #include <SPI.h>
+ #include <audio_profile.h>
+ #include <audio_memory.h>
+ #include "AudioAnalyzeTDMStatus.h"
+ #include "AudioEffectLiveness.h"
+ #include "AudioAnalyzeMeter.h"
+ #include "audio_telemetry.h"
+ #include "AudioInputI2SQuadTDM.h"
+
+ // 1 at the end of a two slave daisy chain
+ #define MASTER_CHAIN 0
+
+ #if MASTER_CHAIN && AUDIO_CHANNELS < 12
+ #error "MASTER_CHAIN sends 12 channels: USB type Audio with -DAUDIO_CHANNELS=12 -DUSB_AUDIO_MICROFRAMES"
+ #endif
  
  // Create audio objects
- AudioInputI2SQuad    i2sQuadIn;      // 4-channel local I2S input using SAI1_RXD0 and RXD1
- AudioInputTDM        tdmIn;          // 16-channel TDM input (using channels 0-7 from slave)
+ #if MASTER_CHAIN
+ // SAI1 receive: outputs 0-3 local mics, 4-11 slave slots 0-7, all of
+ // them microphones
+ AudioInputI2SQuadTDMT<2> sai1In(0x0FFF);
+ AudioOutputUSB       usbOut;         // 12-channel USB output to PC
+
+ // Slave channels checked block by block on their way to USB; a chain has
+ // no status packet to watch
+ AudioEffectLivenessT<8> slaveLive;
+ #else
+ // SAI1 receive: outputs 0-3 local mics, 4-11 slave slots 0-7.  Only the
+ // local mics, slave slots 0-3 and the status slot 7 are received.
+ AudioInputI2SQuadTDMT<2> sai1In(0x08FF);
  AudioOutputUSB       usbOut;         // 8-channel USB output to PC
 
+ // Slave status packet in slave slot 7: sequence, dropouts, latency
+ AudioAnalyzeTDMStatus tdmStatus;
+ AudioConnection patchCord17(sai1In, 11, tdmStatus, 0);
+
+ // Slave channels checked block by block on their way to USB; after
+ // tdmStatus, so both see the same block
+ AudioEffectLiveness4 slaveLive;
+ #endif
+
  // Connect local I2S inputs to USB channels 0-3
- AudioConnection patchCord1(i2sQuadIn, 0, usbOut, 0);   // Local Ch0 (L1 from RXD0)
- AudioConnection patchCord2(i2sQuadIn, 1, usbOut, 1);   // Local Ch1 (R1 from RXD0)
- AudioConnection patchCord3(i2sQuadIn, 2, usbOut, 2);   // Local Ch2 (L2 from RXD1)
- AudioConnection patchCord4(i2sQuadIn, 3, usbOut, 3);   // Local Ch3 (R2 from RXD1)
-
- // Connect remote TDM inputs to USB channels 4-7 (first 4 of 8 TDM channels)
- AudioConnection patchCord5(tdmIn, 0, usbOut, 4);       // Remote Ch0 (440 Hz)
- AudioConnection patchCord6(tdmIn, 1, usbOut, 5);       // Remote Ch1 (523 Hz)
- AudioConnection patchCord7(tdmIn, 2, usbOut, 6);       // Remote Ch2 (659 Hz)
- AudioConnection patchCord8(tdmIn, 3, usbOut, 7);       // Remote Ch3 (784 Hz)
-
- // Monitor audio levels - local channels
- AudioAnalyzePeak     peakLocal[4];
- AudioConnection patchCord9(i2sQuadIn, 0, peakLocal[0], 0);
- AudioConnection patchCord10(i2sQuadIn, 1, peakLocal[1], 0);
- AudioConnection patchCord11(i2sQuadIn, 2, peakLocal[2], 0);
- AudioConnection patchCord12(i2sQuadIn, 3, peakLocal[3], 0);
-
- // Monitor audio levels - remote TDM channels (first 4)
- AudioAnalyzePeak     peakRemote[4];
- AudioConnection patchCord13(tdmIn, 0, peakRemote[0], 0);
- AudioConnection patchCord14(tdmIn, 1, peakRemote[1], 0);
- AudioConnection patchCord15(tdmIn, 2, peakRemote[2], 0);
- AudioConnection patchCord16(tdmIn, 3, peakRemote[3], 0);
+ AudioConnection patchCord1(sai1In, 0, usbOut, 0);      // Local Ch0 (L1 from RXD0)
+ AudioConnection patchCord2(sai1In, 1, usbOut, 1);      // Local Ch1 (R1 from RXD0)
+ AudioConnection patchCord3(sai1In, 2, usbOut, 2);      // Local Ch2 (L2 from RXD1)
+ AudioConnection patchCord4(sai1In, 3, usbOut, 3);      // Local Ch3 (R2 from RXD1)
+
+ #if MASTER_CHAIN
+ // Connect remote TDM inputs to USB channels 4-11 (slave slots 0-7)
+ AudioConnection patchCord5(sai1In, 4, slaveLive, 0);   // Far slave mic 0 (far slave pin 8 L)
+ AudioConnection patchCord6(sai1In, 5, slaveLive, 1);   // Far slave mic 1 (far slave pin 8 R)
+ AudioConnection patchCord7(sai1In, 6, slaveLive, 2);   // Far slave mic 2 (far slave pin 6 L)
+ AudioConnection patchCord8(sai1In, 7, slaveLive, 3);   // Far slave mic 3 (far slave pin 6 R)
+ AudioConnection patchCord22(sai1In, 8, slaveLive, 4);  // Near slave mic 0 (near slave pin 8 L)
+ AudioConnection patchCord23(sai1In, 9, slaveLive, 5);  // Near slave mic 1 (near slave pin 8 R)
+ AudioConnection patchCord24(sai1In, 10, slaveLive, 6); // Near slave mic 2 (near slave pin 6 L)
+ AudioConnection patchCord25(sai1In, 11, slaveLive, 7); // Near slave mic 3 (near slave pin 6 R)
+ AudioConnection patchCord18(slaveLive, 0, usbOut, 4);
+ AudioConnection patchCord19(slaveLive, 1, usbOut, 5);
+ AudioConnection patchCord20(slaveLive, 2, usbOut, 6);
+ AudioConnection patchCord21(slaveLive, 3, usbOut, 7);
+ AudioConnection patchCord26(slaveLive, 4, usbOut, 8);
+ AudioConnection patchCord27(slaveLive, 5, usbOut, 9);
+ AudioConnection patchCord28(slaveLive, 6, usbOut, 10);
+ AudioConnection patchCord29(slaveLive, 7, usbOut, 11);
+ #else
+ // Connect remote TDM inputs to USB channels 4-7 (slave slots 0-3)
+ AudioConnection patchCord5(sai1In, 4, slaveLive, 0);   // Remote mic 0 (slave pin 8 L)
+ AudioConnection patchCord6(sai1In, 5, slaveLive, 1);   // Remote mic 1 (slave pin 8 R)
+ AudioConnection patchCord7(sai1In, 6, slaveLive, 2);   // Remote mic 2 (slave pin 6 L)
+ AudioConnection patchCord8(sai1In, 7, slaveLive, 3);   // Remote mic 3 (slave pin 6 R)
+ AudioConnection patchCord18(slaveLive, 0, usbOut, 4);
+ AudioConnection patchCord19(slaveLive, 1, usbOut, 5);
+ AudioConnection patchCord20(slaveLive, 2, usbOut, 6);
+ AudioConnection patchCord21(slaveLive, 3, usbOut, 7);
+ #endif
+
+ // Monitor audio levels of all 8 USB channels: peak, RMS and clips in one
+ // object, published about every second (0-3 local, 4-7 remote TDM)
+ AudioAnalyzeMeter8   levels(AUDIO_SAMPLE_RATE_EXACT / AUDIO_BLOCK_SAMPLES);
+ AudioConnection patchCord9(sai1In, 0, levels, 0);
+ AudioConnection patchCord10(sai1In, 1, levels, 1);
+ AudioConnection patchCord11(sai1In, 2, levels, 2);
+ AudioConnection patchCord12(sai1In, 3, levels, 3);
+ AudioConnection patchCord13(sai1In, 4, levels, 4);
+ AudioConnection patchCord14(sai1In, 5, levels, 5);
+ AudioConnection patchCord15(sai1In, 6, levels, 6);
+ AudioConnection patchCord16(sai1In, 7, levels, 7);
+ #if MASTER_CHAIN
+ // and USB channels 8-11, the near slave's microphones
+ AudioAnalyzeMeterT<4> levelsChain(AUDIO_SAMPLE_RATE_EXACT / AUDIO_BLOCK_SAMPLES);
+ AudioConnection patchCord30(sai1In, 8, levelsChain, 0);
+ AudioConnection patchCord31(sai1In, 9, levelsChain, 1);
+ AudioConnection patchCord32(sai1In, 10, levelsChain, 2);
+ AudioConnection patchCord33(sai1In, 11, levelsChain, 3);
+ #endif
+
+ // Binary status frames for host_src/telemetry.py, board id 0
+ AudioTelemetry       telemetry(0);
  
  void setup() {
    Serial.begin(115200);
 
-   // Audio initialization - increased memory for 12 channels
-   AudioMemory(40);
+   // Audio blocks for the objects above, from the heap (RAM2)
+   unsigned int audioBlocks = AudioMemoryAuto();
 
    // Wait for serial monitor
    delay(1000);
 
+   Serial.print("Audio memory: ");
+   Serial.print(audioBlocks);
+   Serial.println(audioBlocks ? " blocks reserved" : " blocks, allocation FAILED");
+
    Serial.println("=============================================");
+ #if MASTER_CHAIN
+   Serial.println("Teensy 4.1 Master - 12-Channel USB Audio, daisy chain");
+ #else
    Serial.println("Teensy 4.1 Master - 8-Channel USB Audio");
+ #endif
    Serial.println("=============================================");
    Serial.println();
    Serial.println("Local I2S microphones (4 channels):");
@@ -78,105 +161,102 @@
    Serial.println("  Pin 20: SAI1_SYNC/LRCLK (drives slave)");
    Serial.println("  Pin 23: SAI1_MCLK");
    Serial.println();
-   Serial.println("TDM from Teensy B slave (first 4 of 8 channels):");
-   Serial.println("  Pin 8:  SAI1_RXD0 (TDM data from slave)");
+ #if MASTER_CHAIN
+   Serial.println("TDM from the near slave (slots 0-7 microphones):");
+   Serial.println("  Pin 9:  SAI1_RXD2 (slots 0-3, far slave relayed)");
+   Serial.println("  Pin 32: SAI1_RXD3 (slots 4-7, near slave)");
+   Serial.println();
+   Serial.println("USB Audio Channels:");
+   Serial.println("  Ch 0-3:  Local I2S microphones");
+   Serial.println("  Ch 4-7:  Far slave microphones 0-3 (slots 0-3)");
+   Serial.println("  Ch 8-11: Near slave microphones 0-3 (slots 4-7)");
+   Serial.println();
+   Serial.println("USB Audio: Should appear as 'Teensy Audio 12CH'");
+   Serial.println("Starting 12-channel audio streaming...");
+ #else
+   Serial.println("TDM from Teensy B slave (slots 0-3 microphones, 7 status):");
+   Serial.println("  Pin 9:  SAI1_RXD2 (slave slots 0-3)");
+   Serial.println("  Pin 32: SAI1_RXD3 (slave slots 4-7)");
    Serial.println();
    Serial.println("USB Audio Channels:");
    Serial.println("  Ch 0-3: Local I2S microphones");
-   Serial.println("  Ch 4-7: Remote TDM from slave");
-   Serial.println("    Ch 4: 440 Hz (A4)");
-   Serial.println("    Ch 5: 523 Hz (C5)");
-   Serial.println("    Ch 6: 659 Hz (E5)");
-   Serial.println("    Ch 7: 784 Hz (G5)");
+   Serial.println("  Ch 4-7: Remote microphones from slave");
+   Serial.println("    Ch 4: Remote mic 0 (slave slot 0, slave pin 8 L)");
+   Serial.println("    Ch 5: Remote mic 1 (slave slot 1, slave pin 8 R)");
+   Serial.println("    Ch 6: Remote mic 2 (slave slot 2, slave pin 6 L)");
+   Serial.println("    Ch 7: Remote mic 3 (slave slot 3, slave pin 6 R)");
    Serial.println();
    Serial.println("USB Audio: Should appear as 'Teensy Audio 8CH'");
    Serial.println("Starting 8-channel audio streaming...");
+ #endif
+   Serial.println("Status is sent as binary telemetry: python host_src/telemetry.py <port>");
+   Serial.println("Serial commands: 'p' = print ISR profile, 'r' = reset profile,");
+   Serial.println("                 'm' = marker blocks on dead slave channels on/off");
    Serial.println();
+
+   // Garbage on the slave lanes shows as a lost status packet
+ #if !MASTER_CHAIN
+   slaveLive.watch(tdmStatus);
+ #endif
+   audio_profile_begin();
  }
  
  void loop() {
-   // Print peak levels every 1000ms
-   static elapsedMillis timeout = 0;
-
-   if (timeout >= 1000) {
-     timeout = 0;
-
-     // Check if peak analyzers have data
-     bool hasLocalData = true;
-     bool hasRemoteData = true;
-
-     for (int i = 0; i < 4; i++) {
-       if (!peakLocal[i].available()) hasLocalData = false;
-     }
-     for (int i = 0; i < 4; i++) {
-       if (!peakRemote[i].available()) hasRemoteData = false;
-     }
-
-     if (hasLocalData || hasRemoteData) {
-       Serial.println("=== AUDIO LEVELS ===");
-
-       // Local I2S channels
-       if (hasLocalData) {
-         Serial.print("Local I2S: ");
-         for (int i = 0; i < 4; i++) {
-           float level = peakLocal[i].read();
-           Serial.print("Ch");
-           Serial.print(i);
-           Serial.print(":");
-           printBarCompact(level);
-           Serial.print(" ");
-         }
-         Serial.println();
-       }
-
-       // Remote TDM channels
-       if (hasRemoteData) {
-         Serial.print("Remote TDM: ");
-         for (int i = 0; i < 4; i++) {
-           float level = peakRemote[i].read();
-           Serial.print("Ch");
-           Serial.print(i + 4);  // USB channels 4-7
-           Serial.print(":");
-           printBarCompact(level);
-           Serial.print(" ");
-         }
-         Serial.println();
-       }
-       Serial.println();
+   // Profiling commands from the serial monitor
+   while (Serial.available()) {
+     char c = Serial.read();
+     if (c == 'p') {
+       audio_profile_print(Serial, "update_all", &audio_profile_update_all);
+       audio_profile_print(Serial, "tdm rx", &audio_profile_tdm_rx);
+       audio_profile_print(Serial, "usb tx", &audio_profile_usb_tx);
+       audio_profile_print(Serial, "usb rx", &audio_profile_usb_rx);
+     } else if (c == 'r') {
+       audio_profile_reset(&audio_profile_update_all);
+       audio_profile_reset(&audio_profile_tdm_rx);
+       audio_profile_reset(&audio_profile_usb_tx);
+       audio_profile_reset(&audio_profile_usb_rx);
+       Serial.println("Profile reset");
+     } else if (c == 'm') {
+       static bool marker = false;
+       marker = !marker;
+       slaveLive.marker(marker);
+       Serial.println(marker ? "Dead slave channels: marker" : "Dead slave channels: passed through");
      }
    }
 
-   // Print memory usage every 5 seconds
-   static elapsedMillis statusTimeout = 0;
-   if (statusTimeout >= 5000) {
-     statusTimeout = 0;
-     Serial.print("Audio memory: ");
-     Serial.print(AudioMemoryUsage());
-     Serial.print("/");
-     Serial.print(AudioMemoryUsageMax());
-     Serial.print("  CPU: ");
-     Serial.print(AudioProcessorUsage());
-     Serial.println("%");
-     Serial.println();
+   // Slave channels going dead or coming back, as soon as it happens
+   static uint32_t slaveDead = 0;
+   uint32_t dead = slaveLive.dead();
+   if (dead != slaveDead && telemetry.liveness(slaveLive, 4)) slaveDead = dead;
+
+   // Levels whenever the meter finishes a window (about every second)
+   AudioAnalyzeMeter8::snapshot_t meter;
+   if (levels.available() && levels.read(meter)) {
+     telemetry.levels(meter);
    }
- }
- 
- void printBar(float level) {
-   Serial.print("[");
-   int bars = level * 20;
-   for (int i = 0; i < 20; i++) {
-     if (i < bars) Serial.print("=");
-     else Serial.print(" ");
+ #if MASTER_CHAIN
+   AudioAnalyzeMeterT<4>::snapshot_t chainMeter;
+   if (levelsChain.available() && levelsChain.read(chainMeter)) {
+     telemetry.levels(chainMeter, 8);
    }
-   Serial.print("]");
- }
+ #endif
 
- void printBarCompact(float level) {
-   Serial.print("[");
-   int bars = level * 8;  // Shorter bar for compact display
-   for (int i = 0; i < 8; i++) {
-     if (i < bars) Serial.print("=");
-     else Serial.print(" ");
+   // System, ISR profile and slave link records every second
+   static elapsedMillis timeout = 0;
+   if (timeout >= 1000) {
+     timeout = 0;
+     telemetry.system();
+ #if !MASTER_CHAIN
+     telemetry.link(tdmStatus);
+ #endif
+     telemetry.liveness(slaveLive, 4);
+     telemetry.usb(usbOut);
+     telemetry.profile(TELEMETRY_PROFILE_UPDATE_ALL, &audio_profile_update_all);
+     telemetry.profile(TELEMETRY_PROFILE_TDM_RX, &audio_profile_tdm_rx);
+     telemetry.profile(TELEMETRY_PROFILE_USB_TX, &audio_profile_usb_tx);
+     telemetry.profile(TELEMETRY_PROFILE_USB_RX, &audio_profile_usb_rx);
    }
-   Serial.print("]");
+
+   // Only what the USB serial buffer takes now; the rest waits in the ring
+   telemetry.drain(Serial);
  }
\ No newline at end of file